@@ -0,0 +1,92 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "ext/metadata/store/jsonfs.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::bench::BenchDir;
+using sf::ext::metadata::bench::ensureResolved;
+using sf::ext::metadata::bench::timeMicros;
+
+
+static const std::vector<size_t> BATCH_SIZES = {10, 100, 1000};
+
+
+//! Returns the keys used by a batch of the given size.
+static std::vector<std::string> batch_keys(size_t size) {
+  std::vector<std::string> keys;
+  for (size_t index = 0; index < size; index++) {
+    keys.push_back("cluster.nodes.node-" + std::to_string(index));
+  }
+  return keys;
+}
+
+//! Returns a result entry comparing single key and batch calls.
+static json batch_result(
+    std::string operation, size_t size, double single, double batch
+) {
+  return {
+    {"operation", operation},
+    {"keys", size},
+    {"single_us", single},
+    {"batch_us", batch},
+    {"speedup", single / batch}
+  };
+}
+
+
+//! Compares N single key calls with one batch call of N keys.
+JSONFS_BENCHMARK(batch) {
+  for (size_t size : BATCH_SIZES) {
+    BenchDir dir;
+    std::vector<std::string> keys = batch_keys(size);
+    JsonFsStore single(dir.file("single.json"));
+    JsonFsStore batch(dir.file("batch.json"));
+    ensureResolved(single.load());
+    ensureResolved(batch.load());
+
+    // Set.
+    double single_set = timeMicros([&single, &keys]() {
+      for (size_t index = 0; index < keys.size(); index++) {
+        ensureResolved(single.set(keys[index], json(index)));
+      }
+    });
+    std::map<std::string, json> values;
+    for (size_t index = 0; index < keys.size(); index++) {
+      values[keys[index]] = json(index);
+    }
+    double batch_set = timeMicros([&batch, &values]() {
+      ensureResolved(batch.setMany(values));
+    });
+    results->push_back(batch_result("set", size, single_set, batch_set));
+
+    // Get.
+    double single_get = timeMicros([&single, &keys]() {
+      for (auto& key : keys) {
+        ensureResolved(single.get(key));
+      }
+    });
+    double batch_get = timeMicros([&batch, &keys]() {
+      ensureResolved(batch.getMany(keys));
+    });
+    results->push_back(batch_result("get", size, single_get, batch_get));
+
+    // Erase.
+    double single_erase = timeMicros([&single, &keys]() {
+      for (auto& key : keys) {
+        ensureResolved(single.erase(key));
+      }
+    });
+    double batch_erase = timeMicros([&batch, &keys]() {
+      ensureResolved(batch.eraseMany(keys));
+    });
+    results->push_back(batch_result("erase", size, single_erase, batch_erase));
+  }
+}
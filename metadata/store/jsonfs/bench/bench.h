@@ -0,0 +1,68 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_BENCH_BENCH_H_
+#define EXT_METADATA_STORE_JSONFS_BENCH_BENCH_H_
+
+#include <functional>
+#include <map>
+#include <string>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+namespace bench {
+
+  //! A benchmark appends its results to the given JSON array.
+  typedef std::function<void(nlohmann::json* results)> Benchmark;
+
+  //! Registers benchmarks to be run by the bench binary.
+  class BenchmarkRegistry {
+   public:
+    static std::map<std::string, Benchmark>* Benchmarks();
+    BenchmarkRegistry(std::string name, Benchmark benchmark);
+  };
+
+  //! Temporary directory for store files, removed on destruction.
+  class BenchDir {
+   protected:
+    std::string path_;
+
+   public:
+    BenchDir();
+    ~BenchDir();
+
+    //! Returns the path of a file in the directory.
+    std::string file(std::string name) const;
+  };
+
+  //! Returns the time it takes to run the function in microseconds.
+  double timeMicros(std::function<void()> function);
+
+  //! Returns the number of bytes currently allocated on the heap.
+  size_t heapBytes();
+
+  //! Returns the key of the node record with the given index.
+  std::string nodeKey(size_t index);
+
+  //! Returns a store with the given number of node records.
+  nlohmann::json makeStore(size_t size);
+
+  //! Throws if the promise is not settled and resolved.
+  void ensureResolved(const poolqueue::Promise& promise);
+
+}  // namespace bench
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+
+//! Defines and registers a benchmark.
+#define JSONFS_BENCHMARK(name)                                    \
+  static void jsonfs_bench_##name(nlohmann::json* results);       \
+  static sf::ext::metadata::bench::BenchmarkRegistry              \
+      jsonfs_bench_registry_##name(#name, jsonfs_bench_##name);   \
+  static void jsonfs_bench_##name(nlohmann::json* results)
+
+#endif  // EXT_METADATA_STORE_JSONFS_BENCH_BENCH_H_
@@ -0,0 +1,124 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <dirent.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+
+#include "bench.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::bench::Benchmark;
+using sf::ext::metadata::bench::BenchmarkRegistry;
+using sf::ext::metadata::bench::BenchDir;
+
+
+std::map<std::string, Benchmark>* BenchmarkRegistry::Benchmarks() {
+  static std::map<std::string, Benchmark> benchmarks;
+  return &benchmarks;
+}
+
+BenchmarkRegistry::BenchmarkRegistry(std::string name, Benchmark benchmark) {
+  (*BenchmarkRegistry::Benchmarks())[name] = benchmark;
+}
+
+
+BenchDir::BenchDir() {
+  char* path = strdup("tmp.sf-jsonfs.bench.XXXXXX");
+  if (mkdtemp(path) == nullptr) {
+    free(path);
+    throw std::runtime_error("Unable to create benchmark directory");
+  }
+  this->path_ = std::string(path);
+  free(path);
+}
+
+BenchDir::~BenchDir() {
+  DIR* dir = opendir(this->path_.c_str());
+  if (dir) {
+    struct dirent* entry = nullptr;
+    while ((entry = readdir(dir)) != nullptr) {
+      std::string name(entry->d_name);
+      if (name != "." && name != "..") {
+        unlink(this->file(name).c_str());
+      }
+    }
+    closedir(dir);
+  }
+  rmdir(this->path_.c_str());
+}
+
+std::string BenchDir::file(std::string name) const {
+  return this->path_ + "/" + name;
+}
+
+
+size_t sf::ext::metadata::bench::heapBytes() {
+  return mallinfo2().uordblks;
+}
+
+double sf::ext::metadata::bench::timeMicros(std::function<void()> function) {
+  auto start = std::chrono::steady_clock::now();
+  function();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+std::string sf::ext::metadata::bench::nodeKey(size_t index) {
+  return "cluster.nodes.node-" + std::to_string(index);
+}
+
+json sf::ext::metadata::bench::makeStore(size_t size) {
+  json data = json::object();
+  for (size_t index = 0; index < size; index++) {
+    std::string node = "node-" + std::to_string(index);
+    data[nodeKey(index)] = {
+      {"name", node},
+      {"address", "10.0.0.1"},
+      {"port", 8080 + (index % 100)},
+      {"tags", {"metadata", "jsonfs"}}
+    };
+  }
+  return data;
+}
+
+void sf::ext::metadata::bench::ensureResolved(const Promise& promise) {
+  if (!promise.settled() || promise.rejected()) {
+    throw std::runtime_error("Benchmark operation did not complete");
+  }
+}
+
+
+//! Runs all benchmarks, or the ones named on the command line.
+/*!
+ * Results are printed to stdout as a JSON object keyed by
+ * benchmark name so they can be stored and compared over time.
+ */
+int main(int argc, char** argv) {
+  json report = json::object();
+  for (auto& pair : *BenchmarkRegistry::Benchmarks()) {
+    bool selected = argc < 2;
+    for (int arg = 1; arg < argc; arg++) {
+      selected = selected || pair.first == argv[arg];
+    }
+    if (!selected) {
+      continue;
+    }
+
+    json results = json::array();
+    pair.second(&results);
+    report[pair.first] = results;
+  }
+  std::cout << report.dump(2) << std::endl;
+  return 0;
+}
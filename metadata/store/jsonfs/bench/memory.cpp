@@ -0,0 +1,67 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+using nlohmann::json;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsTable;
+using sf::ext::metadata::bench::BenchDir;
+using sf::ext::metadata::bench::ensureResolved;
+using sf::ext::metadata::bench::heapBytes;
+using sf::ext::metadata::bench::makeStore;
+using sf::ext::metadata::bench::nodeKey;
+using sf::ext::metadata::bench::timeMicros;
+
+
+static const std::vector<size_t> STORE_SIZES = {10000, 100000, 1000000};
+
+//! Number of keys read to measure lookups.
+static const size_t LOOKUPS = 1000;
+
+
+//! Compares the memory of JSON trees and tables and times loading.
+JSONFS_BENCHMARK(memory) {
+  for (size_t size : STORE_SIZES) {
+    BenchDir dir;
+    std::string path = dir.file("store.cbor");
+    size_t tree_bytes = 0;
+    size_t table_bytes = 0;
+    {
+      size_t before = heapBytes();
+      json data = makeStore(size);
+      tree_bytes = heapBytes() - before;
+      JsonFsTable table(data);
+      table_bytes = table.memory();
+      JsonFsCodec::Dump(path, data, JsonFsFormat::CBOR);
+    }
+
+    // Load the store from file and read some keys.
+    JsonFsStore store(path, JsonFsFormat::CBOR);
+    double load = timeMicros([&store]() {
+      ensureResolved(store.load());
+    });
+    double get = timeMicros([&store, size]() {
+      for (size_t index = 0; index < LOOKUPS; index++) {
+        ensureResolved(store.get(nodeKey((index * 7919) % size)));
+      }
+    });
+
+    results->push_back({
+      {"keys", size},
+      {"tree_bytes", tree_bytes},
+      {"table_bytes", table_bytes},
+      {"saving", 1.0 - static_cast<double>(table_bytes) / tree_bytes},
+      {"load_us", load},
+      {"get_us", get / LOOKUPS}
+    });
+  }
+}
@@ -0,0 +1,199 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <functional>
+#include <random>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bench.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+using nlohmann::json;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsTable;
+using sf::ext::metadata::bench::BenchDir;
+using sf::ext::metadata::bench::ensureResolved;
+using sf::ext::metadata::bench::makeStore;
+using sf::ext::metadata::bench::nodeKey;
+using sf::ext::metadata::bench::timeMicros;
+
+
+static const std::vector<size_t> STORE_SIZES = {
+  10, 100, 1000, 10000, 100000, 1000000
+};
+
+//! Formats and compression of the store files.
+static const std::vector<std::pair<JsonFsFormat, JsonFsCompression>> FORMATS = {
+  {JsonFsFormat::JSON, JsonFsCompression::NONE},
+  {JsonFsFormat::JSON, JsonFsCompression::ZSTD},
+  {JsonFsFormat::CBOR, JsonFsCompression::NONE},
+  {JsonFsFormat::CBOR, JsonFsCompression::ZSTD},
+  {JsonFsFormat::INDEXED, JsonFsCompression::NONE}
+};
+
+//! Number of keys read at each size.
+static const size_t LOOKUPS = 1000;
+
+
+//! Returns the number of mutations to time at each size.
+/*!
+ * Every mutation rewrites the store file so large stores
+ * are sampled less to keep the run time reasonable.
+ */
+static size_t mutations(size_t size) {
+  return std::max<size_t>(5, std::min<size_t>(100, 1000000 / size));
+}
+
+//! Returns the size of a file, or 0 if it does not exist.
+static size_t file_bytes(const std::string& path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    return 0;
+  }
+  return info.st_size;
+}
+
+//! Times inserting the keys in a table, then reading them in order.
+static double insert(const std::vector<std::string>& keys) {
+  json node = {{"name", "node"}, {"port", 8080}};
+  std::vector<uint8_t> value = json::to_cbor(node);
+  return timeMicros([&keys, &value]() {
+    JsonFsTable table;
+    for (const std::string& key : keys) {
+      table.set(key, value.data(), value.size());
+    }
+    table.key(0);
+  });
+}
+
+//! Returns latency and throughput statistics for the timings.
+static json latency(std::vector<double> timings) {
+  std::sort(timings.begin(), timings.end());
+  double total = 0;
+  for (double timing : timings) {
+    total += timing;
+  }
+  size_t count = timings.size();
+  return {
+    {"count", count},
+    {"mean_us", total / count},
+    {"p50_us", timings[count / 2]},
+    {"p99_us", timings[std::min(count - 1, count * 99 / 100)]},
+    {"max_us", timings.back()},
+    {"ops_per_sec", count / total * 1000000}
+  };
+}
+
+//! Times a mutation on each key, recording the bytes written.
+static json mutate(
+    const std::string& path, size_t size,
+    std::function<void(const std::string&)> operation
+) {
+  std::vector<double> timings;
+  size_t written = 0;
+  for (size_t index = 0; index < mutations(size); index++) {
+    std::string key = nodeKey((index * 7919) % size);
+    timings.push_back(timeMicros([&operation, &key]() {
+      operation(key);
+    }));
+    written += file_bytes(path);
+  }
+  json result = latency(timings);
+  result["bytes_per_write"] = written / timings.size();
+  return result;
+}
+
+
+//! Times single key operations and loads against store sizes.
+/*!
+ * Every store rewrites the full file on commit so bytes written
+ * per mutation are the size of the file after the commit.
+ *
+ * Sets with a TTL are not measured: JsonFS stores don't implement
+ * TTLs and only log a warning before doing a plain set.
+ */
+JSONFS_BENCHMARK(store) {
+  for (size_t size : STORE_SIZES) {
+    for (auto& pair : FORMATS) {
+      JsonFsFormat format = pair.first;
+      JsonFsCompression compression = pair.second;
+      BenchDir dir;
+      std::string path = dir.file("store");
+      JsonFsCodec::Dump(path, makeStore(size), format, compression);
+      size_t file_size = file_bytes(path);
+
+      // Cold load from disk.
+      JsonFsStore store(
+          path, format, JsonFsIoThreadRef(), false, compression
+      );
+      double load = timeMicros([&store]() {
+        ensureResolved(store.load());
+      });
+
+      // Gets of existing keys.
+      std::vector<double> gets;
+      for (size_t index = 0; index < LOOKUPS; index++) {
+        std::string key = nodeKey((index * 7919) % size);
+        gets.push_back(timeMicros([&store, &key]() {
+          ensureResolved(store.get(key));
+        }));
+      }
+
+      // Mutations, each followed by a commit.
+      json value = {{"name", "updated"}, {"port", 9090}};
+      json set = mutate(path, size, [&store, &value](const std::string& key) {
+        ensureResolved(store.set(key, value));
+      });
+      json erase = mutate(path, size, [&store](const std::string& key) {
+        ensureResolved(store.erase(key));
+      });
+
+      results->push_back({
+        {"keys", size},
+        {"format", JsonFsCodec::FormatName(format)},
+        {"compression", JsonFsCodec::CompressionName(compression)},
+        {"file_bytes", file_size},
+        {"load_us", load},
+        {"get", latency(gets)},
+        {"set", set},
+        {"erase", erase}
+      });
+    }
+  }
+}
+
+//! Times inserting keys into a table in key order and shuffled.
+/*!
+ * Keys are loaded in whatever order files and writers give
+ * them, so both orders should scale the same way.
+ */
+JSONFS_BENCHMARK(insert) {
+  std::mt19937 random(42);
+  for (size_t size : STORE_SIZES) {
+    std::vector<std::string> keys;
+    keys.reserve(size);
+    for (size_t index = 0; index < size; index++) {
+      keys.push_back(nodeKey(index));
+    }
+    std::sort(keys.begin(), keys.end());
+    double sorted = insert(keys);
+    std::shuffle(keys.begin(), keys.end(), random);
+    double unsorted = insert(keys);
+
+    results->push_back({
+      {"keys", size},
+      {"sorted_us", sorted},
+      {"unsorted_us", unsorted}
+    });
+  }
+}
@@ -2,9 +2,23 @@
 #ifndef EXT_METADATA_STORE_JSONFS_H_
 #define EXT_METADATA_STORE_JSONFS_H_
 
+#include <exception>
+#include <map>
+#include <memory>
+#include <set>
 #include <string>
+#include <vector>
 
 #include "core/interface/metadata/store.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/io.h"
+#include "ext/metadata/store/jsonfs/loader.h"
+#include "ext/metadata/store/jsonfs/revision.h"
+#include "ext/metadata/store/jsonfs/scan.h"
+#include "ext/metadata/store/jsonfs/snapshot.h"
+#include "ext/metadata/store/jsonfs/table.h"
+#include "ext/metadata/store/jsonfs/view.h"
+#include "ext/metadata/store/jsonfs/watch.h"
 
 
 namespace sf {
@@ -19,20 +33,186 @@ namespace metadata {
    *      "<key>": <value>,
    *      ...
    *    }
+   *
+   * The file can be encoded as text JSON or in a binary format
+   * (see JsonFsFormat).
+   * Existing files are loaded in whatever format they are in
+   * and written back in the configured format.
+   * Files other than INDEXED ones can also be compressed
+   * (see JsonFsCompression), which is detected in the same way.
+   *
+   * Loaded data is kept in a JsonFsTable, with values encoded
+   * in an arena, rather than as a tree of JSON nodes.
+   * Files are streamed into the table by JsonFsLoader so the
+   * document is never fully parsed in memory.
+   *
+   * Stores in the INDEXED format are not parsed when loaded:
+   * the file is mapped as a JsonFsSnapshot and `cache_` only
+   * holds the changes made since the last commit.
+   *
+   * Keys are kept in order, both in `cache_` and in snapshots,
+   * so prefix and range scans cost O(log N + matches).
+   *
+   * Committed changes are delivered to watches on keys or prefixes
+   * (see JsonFsWatchList) and JsonFsWatcher refreshes the store
+   * when the file is changed by other processes.
+   *
+   * When a JsonFsIoThread is given, files are read and written
+   * on the I/O thread and promises settle on the event loop.
+   * Keys are handed to the loop as they are loaded so gets can
+   * be served before the whole file is parsed.
+   * Without one all disk access happens on the calling thread.
+   *
+   * Shared stores can be used by several processes at once
+   * (see JsonFsRevisionLock): every operation checks the revision
+   * of the file and reloads it only if another process changed it.
+   * Writes are applied to the latest revision while holding an
+   * exclusive lock so changes from other processes are never lost.
+   * Shared stores always perform I/O on the calling thread.
+   *
+   * Point-in-time reads and exports go through JsonFsView:
+   * the store preserves the old value of a key in every live view
+   * before changing it so views never block writers.
    */
   class JsonFsStore : public sf::core::interface::MetaDataStore {
+    friend class JsonFsView;
+
    protected:
     std::string store_;
-    nlohmann::json cache_;
+    JsonFsFormat format_;
+    JsonFsCompression compression_;
+    std::unique_ptr<JsonFsTable> cache_;
+
+    //! Lazily loaded base for INDEXED stores.
+    std::shared_ptr<JsonFsSnapshot> snapshot_;
+
+    //! Keys erased from snapshot_ since the last commit.
+    std::set<std::string> erased_;
+
+    //! Optional thread to perform disk I/O on.
+    JsonFsIoThreadRef io_;
+
+    //! Set while the store file is being loaded.
+    bool loading_;
+    poolqueue::Promise load_;
+    JsonFsLoadCallback progress_;
+
+    //! Keys loaded so far by an asynchronous load.
+    std::unique_ptr<JsonFsTable> partial_;
 
-    //! Returns (loading from file if needed) the JSON cache.
+    //! Gets waiting for keys not loaded yet.
+    std::multimap<std::string, poolqueue::Promise> parked_;
+
+    //! Number of snapshot commits still being written.
+    unsigned int commits_;
+
+    //! Watches on the store and changes waiting to be delivered.
+    JsonFsWatchList watches_;
+
+    //! Stamp of the store file after the last local write.
+    JsonFsStamp stamp_;
+
+    //! Lock shared with other processes, if the store is shared.
+    JsonFsRevisionLockRef lock_;
+
+    //! Revision of the file loaded in the cache.
+    uint64_t revision_;
+
+    //! Views that need old values of changed keys.
+    std::vector<std::weak_ptr<JsonFsView>> views_;
+
+    //! Runs disk work on the I/O thread, or inline if there is none.
+    poolqueue::Promise io(std::function<void()> work);
+
+    //! Returns a promise resolved when the cache is loaded.
     poolqueue::Promise cache();
 
+    //! Adds a batch of keys loaded on the I/O thread to partial_.
+    void loadBatch(
+        JsonFsLoader::Batch* batch, const JsonFsLoadProgress& progress
+    );
+
+    //! Settles gets parked during a load, with an error if it failed.
+    void settleParked(std::exception_ptr error);
+
+    //! Reloads shared stores if the revision moved, the lock must be held.
+    void sync();
+
+    //! Replaces the loaded data, notifying watches of differences.
+    void replace(
+        std::unique_ptr<JsonFsTable> cache,
+        std::shared_ptr<JsonFsSnapshot> snapshot
+    );
+
+    //! Applies a change to the loaded cache and commits it.
+    poolqueue::Promise update(std::function<void()> change);
+
+    //! Writes the cache and notifies watches once it is on disk.
+    poolqueue::Promise commit();
+
     //! Helper method that writes the current cache to file.
-    void commitCache();
+    poolqueue::Promise commitCache();
+
+    //! Writes snapshot_ and the pending changes as a new snapshot.
+    poolqueue::Promise commitSnapshot();
+
+    //! Returns the value of a key from the loaded cache.
+    nlohmann::json lookup(const std::string& key) const;
+
+    //! Drops expired views and returns true if any are left.
+    bool pruneViews();
+
+    //! Passes the old value of a key to all live views.
+    void preserveKey(const std::string& key, const uint8_t* data, size_t size);
+
+    //! Passes the current value of a key to all live views.
+    void preserveCurrent(const std::string& key);
+
+    //! Removes a key from the loaded cache, without committing.
+    void eraseKey(const std::string& key);
+
+    //! Sets a key in the loaded cache, without committing.
+    void setKey(const std::string& key, const nlohmann::json& value);
+
+    //! Returns up to limit keys in a range of the loaded cache.
+    nlohmann::json collectRange(
+        const std::string& from, bool inclusive,
+        const std::string& end, size_t limit
+    ) const;
 
    public:
-    explicit JsonFsStore(std::string store);
+    explicit JsonFsStore(
+        std::string store, JsonFsFormat format = JsonFsFormat::JSON,
+        JsonFsIoThreadRef io = JsonFsIoThreadRef(), bool shared = false,
+        JsonFsCompression compression = JsonFsCompression::NONE
+    );
+
+    //! Returns the path of the store file.
+    std::string path() const;
+
+    //! Loads the store file, if it was not loaded already.
+    poolqueue::Promise load();
+
+    //! Sets a callback to report the progress of loads.
+    void loadProgress(JsonFsLoadCallback callback);
+
+    //! Reloads the store file if it was changed by someone else.
+    /*!
+     * Watches are notified of all keys that differ from the
+     * previously loaded data.
+     * Nothing is reloaded while local commits are being written:
+     * the pending commits will replace the file anyway.
+     */
+    poolqueue::Promise refresh();
+
+    //! Calls the callback after every committed change to the key.
+    uint64_t watch(std::string key, JsonFsWatchCallback callback);
+
+    //! Calls the callback after every committed change under a prefix.
+    uint64_t watchPrefix(std::string prefix, JsonFsWatchCallback callback);
+
+    //! Removes a watch.
+    void unwatch(uint64_t id);
 
     poolqueue::Promise erase(std::string key);
     poolqueue::Promise get(std::string key);
@@ -41,6 +221,42 @@ namespace metadata {
         std::string key, nlohmann::json value,
         std::chrono::duration<int> ttl
     );
+
+    //! Erases all the keys with a single commit.
+    poolqueue::Promise eraseMany(std::vector<std::string> keys);
+
+    //! Resolves to an object with the value of each key.
+    /*!
+     * Missing keys are included with a null value.
+     */
+    poolqueue::Promise getMany(std::vector<std::string> keys);
+
+    //! Sets all the key/value pairs with a single commit.
+    poolqueue::Promise setMany(std::map<std::string, nlohmann::json> values);
+
+    //! Resolves to an object with up to limit keys in a range.
+    /*!
+     * See JsonFsScan::Fetch for the meaning of the arguments.
+     */
+    poolqueue::Promise range(
+        std::string from, bool inclusive, std::string end, size_t limit
+    );
+
+    //! Returns a scan over all the keys that start with prefix.
+    JsonFsScanRef scan(std::string prefix, size_t batch = 100);
+
+    //! Returns a scan over the keys in [begin, end).
+    /*!
+     * An empty end scans to the last key.
+     */
+    JsonFsScanRef scan(std::string begin, std::string end, size_t batch = 100);
+
+    //! Returns a read-only view of the store as it is now.
+    /*!
+     * Changes made after this call are not visible through the view.
+     * The view must not outlive the store.
+     */
+    JsonFsViewRef view();
   };
 
 }  // namespace metadata
@@ -0,0 +1,149 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_CACHED_H_
+#define EXT_METADATA_STORE_JSONFS_CACHED_H_
+
+#include <stdint.h>
+
+#include <chrono>
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Read-through LRU cache in front of any MetaDataStore.
+  /*!
+   * Gets are served from a bounded LRU of recently used keys
+   * without calling the wrapped store.
+   * Missing keys are cached as null values (negative caching)
+   * unless disabled.
+   *
+   * Sets and erases invalidate the key before they are forwarded
+   * and cache the written value once the store confirms it.
+   * Values set with a TTL expire from the cache with the TTL and
+   * all entries can be given a maximum age to bound how long
+   * changes made by someone else can go unnoticed.
+   *
+   * Values fetched while a key is being written are not cached
+   * as they may be older than the write.
+   *
+   * The cache can be used from several threads (for example in
+   * front of a JsonFsShardedStore): its state is guarded by a
+   * mutex that is never held while the wrapped store is called.
+   */
+  class CachedMetaDataStore : public sf::core::interface::MetaDataStore {
+   public:
+    typedef std::chrono::steady_clock Clock;
+
+   protected:
+    struct Entry {
+      std::string key;
+      nlohmann::json value;
+
+      //! Time the entry expires, Clock::time_point::max() if never.
+      Clock::time_point expires;
+    };
+    typedef std::list<Entry> Entries;
+
+    sf::core::interface::MetaDataStoreRef store_;
+    size_t capacity_;
+    bool negative_;
+    Clock::duration max_age_;
+
+    //! Guards the entries, the in-flight writes and the stats.
+    mutable std::mutex lock_;
+
+    //! Entries, most recently used first.
+    Entries entries_;
+    std::unordered_map<std::string, Entries::iterator> index_;
+
+    //! Number of writes to each key still in flight.
+    std::unordered_map<std::string, unsigned int> writing_;
+
+    //! Number of writes started, to detect gets racing with writes.
+    uint64_t writes_;
+
+    uint64_t hits_;
+    uint64_t misses_;
+
+    //! Returns the current time, virtual so tests can move it.
+    virtual Clock::time_point now() const;
+
+    //! Returns the expiry time for an entry with the given TTL.
+    Clock::time_point expiry(Clock::duration ttl) const;
+
+    //! Drops a key from the cache, the lock must be held.
+    void drop(const std::string& key);
+
+    //! Adds or replaces an entry, the lock must be held.
+    /*!
+     * Evicts the least recently used entry if the cache is full.
+     */
+    void insert(
+        const std::string& key, const nlohmann::json& value,
+        Clock::time_point expires
+    );
+
+    //! Invalidates a key before a write is forwarded to the store.
+    /*!
+     * Must be called before the store is, as stores can settle
+     * the write (and gets racing with it) before returning.
+     */
+    void start(const std::string& key);
+
+    //! Caches the written value once the store confirms the write.
+    poolqueue::Promise write(
+        const std::string& key, const nlohmann::json& value,
+        Clock::time_point expires, poolqueue::Promise written
+    );
+
+   public:
+    //! Wraps the store with a cache of up to capacity keys.
+    /*!
+     * A zero max age means entries do not expire unless set
+     * with a TTL.
+     */
+    CachedMetaDataStore(
+        sf::core::interface::MetaDataStoreRef store, size_t capacity,
+        bool negative = true,
+        std::chrono::duration<int> max_age = std::chrono::duration<int>(0)
+    );
+
+    //! Drops a key from the cache.
+    /*!
+     * Used to forward changes made to the wrapped store by others.
+     */
+    void invalidate(const std::string& key);
+
+    //! Drops all keys from the cache.
+    void clear();
+
+    //! Number of keys in the cache.
+    size_t size() const;
+
+    //! Number of gets served from the cache.
+    uint64_t hits() const;
+
+    //! Number of gets forwarded to the wrapped store.
+    uint64_t misses() const;
+
+    poolqueue::Promise erase(std::string key);
+    poolqueue::Promise get(std::string key);
+    poolqueue::Promise set(std::string key, nlohmann::json value);
+    poolqueue::Promise set(
+        std::string key, nlohmann::json value,
+        std::chrono::duration<int> ttl
+    );
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_CACHED_H_
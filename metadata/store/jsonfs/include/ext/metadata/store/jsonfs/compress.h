@@ -0,0 +1,87 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_COMPRESS_H_
+#define EXT_METADATA_STORE_JSONFS_COMPRESS_H_
+
+#include <fstream>
+#include <istream>
+#include <memory>
+#include <string>
+
+#include "ext/metadata/store/jsonfs/format.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  class JsonFsZstdReader;
+  class JsonFsZstdWriter;
+
+
+  //! Streams a store file, decompressing it if needed.
+  /*!
+   * Compressed files are recognised by their magic bytes and
+   * decompressed a block at a time as the stream is read,
+   * so the decompressed file is never held in memory.
+   * Missing files are read as empty streams.
+   *
+   * Decompression errors are thrown as JsonFsCorruptStore.
+   */
+  class JsonFsInputFile {
+   public:
+    //! Magic bytes at the start of every zstd frame.
+    static const char ZSTD_MAGIC[4];
+
+   protected:
+    std::ifstream file_;
+    size_t size_;
+    JsonFsCompression compression_;
+    std::unique_ptr<JsonFsZstdReader> zstd_;
+    std::unique_ptr<std::istream> stream_;
+
+   public:
+    explicit JsonFsInputFile(std::string path);
+    ~JsonFsInputFile();
+
+    //! Compression the file was written with.
+    JsonFsCompression compression() const;
+
+    //! Size of the file on disk.
+    size_t size() const;
+
+    //! Bytes of the file on disk read so far.
+    size_t position();
+
+    //! Stream of the decompressed content.
+    std::istream& stream();
+  };
+
+
+  //! Writes a store file, compressing it if requested.
+  /*!
+   * Data is compressed and written a block at a time.
+   * The file is truncated when opened and complete once
+   * close() returns; errors are thrown as ErrNoException.
+   */
+  class JsonFsOutputFile {
+   protected:
+    std::string path_;
+    std::ofstream file_;
+    std::unique_ptr<JsonFsZstdWriter> zstd_;
+
+   public:
+    JsonFsOutputFile(std::string path, JsonFsCompression compression);
+    ~JsonFsOutputFile();
+
+    //! Appends data to the file.
+    void write(const char* data, size_t size);
+
+    //! Flushes compressed data and closes the file.
+    void close();
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_COMPRESS_H_
@@ -5,18 +5,49 @@
 #include <string>
 
 #include "core/interface/config/node.h"
+#include "ext/metadata/store/jsonfs/format.h"
 
 
 namespace sf {
 namespace ext {
 namespace metadata {
 
+  //! Optional settings of JsonFsStore intents.
+  struct JsonFsStoreOptions {
+    //! Encoding of the store files.
+    JsonFsFormat format;
+
+    //! Compression of the store files.
+    JsonFsCompression compression;
+
+    //! Number of files to shard keys across, 1 disables sharding.
+    size_t shards;
+
+    //! Perform disk I/O on a dedicated thread, off the event loop.
+    bool async;
+
+    //! Reload the store when its file is changed by other processes.
+    bool watch;
+
+    //! Coordinate access with other processes using the same files.
+    bool shared;
+
+    //! Number of keys to keep in a CachedMetaDataStore, 0 disables it.
+    size_t cache;
+
+    //! Seconds cached keys are valid for, 0 for no limit.
+    int cache_age;
+
+    JsonFsStoreOptions();
+  };
+
+
   //! Configuration options for JsonFsStore.
   class JsonFsStoreConfig {
    public:
     static void AttachLuaInit();
     static sf::core::interface::NodeConfigIntentRef MakeIntent(
-        std::string path
+        std::string path, JsonFsStoreOptions options = JsonFsStoreOptions()
     );
   };
 
@@ -0,0 +1,21 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_EXCEPTIONS_H_
+#define EXT_METADATA_STORE_JSONFS_EXCEPTIONS_H_
+
+#include <string>
+
+#include "core/exceptions/base.h"
+
+
+namespace sf {
+namespace ext {
+namespace exception {
+
+  //! Thrown when a JsonFsStore file cannot be decoded.
+  MSG_EXCEPTION(sf::core::exception::SfException, JsonFsCorruptStore);
+
+}  // namespace exception
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_EXCEPTIONS_H_
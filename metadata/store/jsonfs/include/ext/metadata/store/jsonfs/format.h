@@ -0,0 +1,114 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_FORMAT_H_
+#define EXT_METADATA_STORE_JSONFS_FORMAT_H_
+
+#include <istream>
+#include <string>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! On-disk encodings supported by JsonFsStore.
+  /*!
+   * The INDEXED format is described in JsonFsSnapshot and allows
+   * stores to be loaded lazily.
+   */
+  enum class JsonFsFormat {
+    JSON,
+    CBOR,
+    MSGPACK,
+    INDEXED
+  };
+
+  //! Compression applied to store files.
+  /*!
+   * Compressed files are detected when loaded so stores can
+   * switch compression on and off like they switch format.
+   * INDEXED stores are memory mapped and can't be compressed.
+   */
+  enum class JsonFsCompression {
+    NONE,
+    ZSTD
+  };
+
+
+  //! Encodes and decodes store files in any JsonFsFormat.
+  /*!
+   * Files are loaded with automatic format detection so stores
+   * can switch format without a manual conversion step:
+   * the file is read in whatever format it is and
+   * written back in the configured one.
+   */
+  class JsonFsCodec {
+   public:
+    //! Returns the format with the given name.
+    /*!
+     * Valid names are json, cbor, msgpack and indexed.
+     */
+    static JsonFsFormat FormatFromName(std::string name);
+
+    //! Returns the name of the given format.
+    static std::string FormatName(JsonFsFormat format);
+
+    //! Returns the compression with the given name.
+    /*!
+     * Valid names are none and zstd.
+     */
+    static JsonFsCompression CompressionFromName(std::string name);
+
+    //! Returns the name of the given compression.
+    static std::string CompressionName(JsonFsCompression compression);
+
+    //! Detects the format of the data in the stream without consuming it.
+    /*!
+     * Empty streams are reported as JSON.
+     */
+    static JsonFsFormat Detect(std::istream& source);
+
+    //! Loads a store file, detecting its format and compression.
+    /*!
+     * Missing and empty files are loaded as an empty object.
+     */
+    static nlohmann::json Load(std::string path);
+
+    //! Encodes the data in the given format.
+    /*!
+     * The INDEXED format is written by JsonFsSnapshotWriter
+     * and is not supported by this method.
+     */
+    static std::string Encode(const nlohmann::json& data, JsonFsFormat format);
+
+    //! Replaces the content of a store file with the given bytes.
+    static void Write(
+        std::string path, const std::string& content,
+        JsonFsCompression compression = JsonFsCompression::NONE
+    );
+
+    //! Writes the data to a store file in the given format.
+    static void Dump(
+        std::string path, const nlohmann::json& data, JsonFsFormat format,
+        JsonFsCompression compression = JsonFsCompression::NONE
+    );
+
+    //! Rewrites a store file in the given format.
+    /*!
+     * The file keeps its compression, INDEXED files are
+     * always written uncompressed.
+     */
+    static void Migrate(std::string path, JsonFsFormat format);
+
+    //! Rewrites a store file in the given format and compression.
+    static void Migrate(
+        std::string path, JsonFsFormat format, JsonFsCompression compression
+    );
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_FORMAT_H_
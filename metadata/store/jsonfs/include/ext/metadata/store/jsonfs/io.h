@@ -0,0 +1,99 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_IO_H_
+#define EXT_METADATA_STORE_JSONFS_IO_H_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+#include "core/model/event.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Runs JsonFsStore disk operations on a dedicated thread.
+  /*!
+   * Work is executed in submission order on the I/O thread.
+   * Completions are not settled there: the I/O thread signals an
+   * eventfd and the promises are settled when the event loop
+   * fetches from this source.
+   * Promise callbacks therefore always run on the loop thread
+   * and the loop never blocks on disk.
+   */
+  class JsonFsIoThread : public sf::core::model::EventSource {
+   protected:
+    //! Work submitted to the I/O thread.
+    /*!
+     * Completed tasks with a callback are callbacks posted by the
+     * I/O thread to run on the loop thread.
+     */
+    struct Task {
+      std::function<void()> work;
+      std::function<void()> callback;
+      poolqueue::Promise result;
+      std::exception_ptr error;
+    };
+
+    int event_fd_;
+    bool stopping_;
+    std::thread worker_;
+
+    std::mutex lock_;
+    std::condition_variable wakeup_;
+    std::deque<Task> queue_;
+    std::vector<Task> completed_;
+
+    //! Body of the I/O thread.
+    void run();
+
+    //! Rejects completed tasks the event loop can't be told about.
+    /*!
+     * Called by the I/O thread, with the lock held, if the eventfd
+     * can't be signalled: the promises are rejected with the error
+     * on the I/O thread so they don't hang.
+     */
+    void abandon(
+        std::exception_ptr error, std::unique_lock<std::mutex>* guard
+    );
+
+    //! Settles the promises of completed tasks and runs callbacks.
+    sf::core::model::EventRef parse();
+
+   public:
+    explicit JsonFsIoThread(std::string id);
+    ~JsonFsIoThread();
+
+    int fd();
+
+    //! Runs the work on the I/O thread.
+    /*!
+     * The returned promise is resolved with nullptr, or rejected
+     * with the exception thrown by the work, once the event loop
+     * fetches from this source.
+     */
+    poolqueue::Promise submit(std::function<void()> work);
+
+    //! Runs the callback on the loop thread, can be called by any thread.
+    /*!
+     * Callbacks and completions are processed in the order they
+     * are queued so callbacks posted by a task run before the
+     * task's promise is settled.
+     */
+    void post(std::function<void()> callback);
+  };
+  typedef std::shared_ptr<JsonFsIoThread> JsonFsIoThreadRef;
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_IO_H_
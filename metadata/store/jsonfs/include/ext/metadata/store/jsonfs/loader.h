@@ -0,0 +1,77 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_LOADER_H_
+#define EXT_METADATA_STORE_JSONFS_LOADER_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Progress of a store file being loaded.
+  struct JsonFsLoadProgress {
+    //! Keys loaded so far.
+    size_t keys;
+
+    //! Bytes of the file parsed so far and total size of the file.
+    size_t bytes;
+    size_t total;
+  };
+
+  //! Callback invoked as batches of keys are loaded.
+  typedef std::function<void(const JsonFsLoadProgress&)> JsonFsLoadCallback;
+
+
+  //! Streams the top-level keys of a store file, a batch at a time.
+  /*!
+   * JSON, CBOR and MessagePack files are parsed with the nlohmann
+   * SAX interface so the document is never built in memory:
+   * only the value being parsed is, and it is encoded to CBOR
+   * (as stored by JsonFsTable) as soon as it is complete.
+   * Indexed snapshots are mapped and their values are copied
+   * without decoding them.
+   * Compressed files are decompressed as they are parsed
+   * (see JsonFsInputFile) and progress is reported in bytes
+   * of the compressed file.
+   *
+   * Missing and empty files have no keys.
+   * Files that are not objects raise JsonFsCorruptStore.
+   */
+  class JsonFsLoader {
+   public:
+    //! Keys and their CBOR encoded values.
+    typedef std::vector<std::pair<std::string, std::vector<uint8_t>>> Batch;
+
+    //! Receives each batch, which can be moved from, and the progress.
+    typedef std::function<void(
+        Batch* batch, const JsonFsLoadProgress& progress
+    )> BatchCallback;
+
+   protected:
+    std::string path_;
+    size_t batch_size_;
+
+   public:
+    explicit JsonFsLoader(std::string path, size_t batch_size = 1024);
+
+    //! Parses the file calling the callback for every batch.
+    void load(BatchCallback callback);
+
+    //! Loads the file into a table.
+    void load(JsonFsTable* table, JsonFsLoadCallback progress = nullptr);
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_LOADER_H_
@@ -0,0 +1,74 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_REVISION_H_
+#define EXT_METADATA_STORE_JSONFS_REVISION_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Coordinates processes sharing a JsonFsStore file.
+  /*!
+   * Uses a sidecar `<store>.lock` file that is never replaced:
+   * store files are truncated or renamed over when written
+   * so they can't carry the lock themselves.
+   *
+   * The sidecar holds the revision of the store (a u64 at offset 0)
+   * which is incremented by every write.
+   * Readers take a shared flock and compare the revision with the
+   * one they loaded: the store file is read again only if it moved.
+   * Writers take an exclusive flock for the whole read-modify-write.
+   */
+  class JsonFsRevisionLock {
+   protected:
+    std::string path_;
+    int fd_;
+
+   public:
+    //! Returns the path of the lock file for a store.
+    static std::string LockPath(std::string store);
+
+    explicit JsonFsRevisionLock(std::string store);
+    ~JsonFsRevisionLock();
+
+    JsonFsRevisionLock(const JsonFsRevisionLock&) = delete;
+    JsonFsRevisionLock& operator=(const JsonFsRevisionLock&) = delete;
+
+    //! Blocks until the lock is acquired.
+    void lock(bool exclusive);
+
+    //! Releases the lock.
+    void unlock();
+
+    //! Reads the current revision, 0 for new stores.
+    uint64_t revision();
+
+    //! Updates the revision, the lock must be held exclusively.
+    void revision(uint64_t revision);
+  };
+  typedef std::shared_ptr<JsonFsRevisionLock> JsonFsRevisionLockRef;
+
+
+  //! Holds a JsonFsRevisionLock for the lifetime of the guard.
+  class JsonFsRevisionGuard {
+   protected:
+    JsonFsRevisionLock* lock_;
+
+   public:
+    JsonFsRevisionGuard(JsonFsRevisionLock* lock, bool exclusive);
+    ~JsonFsRevisionGuard();
+
+    JsonFsRevisionGuard(const JsonFsRevisionGuard&) = delete;
+    JsonFsRevisionGuard& operator=(const JsonFsRevisionGuard&) = delete;
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_REVISION_H_
@@ -0,0 +1,66 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_SCAN_H_
+#define EXT_METADATA_STORE_JSONFS_SCAN_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Incremental scan over a range of ordered keys.
+  /*!
+   * Results are returned in key order, a batch at a time.
+   * The scan only remembers the last key it returned and every
+   * batch seeks past it so stores can change between batches.
+   */
+  class JsonFsScan {
+   public:
+    //! Resolves to an object with up to `limit` keys in the range.
+    /*!
+     * The range starts at `from` (included only if `inclusive`)
+     * and stops before `end`, an empty end means no upper bound.
+     */
+    typedef std::function<poolqueue::Promise(
+        const std::string& from, bool inclusive,
+        const std::string& end, size_t limit
+    )> Fetch;
+
+   protected:
+    Fetch fetch_;
+    std::string from_;
+    bool inclusive_;
+    std::string end_;
+    size_t batch_;
+    bool done_;
+
+   public:
+    //! Returns the first key after all keys starting with prefix.
+    /*!
+     * Returns an empty string (no upper bound) if there is none.
+     */
+    static std::string PrefixEnd(std::string prefix);
+
+    JsonFsScan(Fetch fetch, std::string begin, std::string end, size_t batch);
+
+    //! True once all the keys in the range have been returned.
+    bool done() const;
+
+    //! Resolves to an object with the next batch of keys.
+    /*!
+     * The object is empty once the scan is done.
+     */
+    poolqueue::Promise next();
+  };
+  typedef std::shared_ptr<JsonFsScan> JsonFsScanRef;
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_SCAN_H_
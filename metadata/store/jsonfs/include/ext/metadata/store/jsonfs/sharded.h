@@ -0,0 +1,111 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_SHARDED_H_
+#define EXT_METADATA_STORE_JSONFS_SHARDED_H_
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+#include "ext/metadata/store/jsonfs.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! JsonFsStore split across several files.
+  /*!
+   * Keys are hashed across N shards, each a JsonFsStore
+   * with its own file (`<store>.<index>`) and cache.
+   *
+   * Every shard is guarded by a reader-writer lock so the store
+   * can be used from several threads: reads of a shard share
+   * the lock and writes to different shards proceed in parallel.
+   * Each commit only rewrites the shard that owns the key.
+   * Shared shards are locked across processes one file at a time.
+   * Their reads resync the cache and use the shard's lock file,
+   * so they take the exclusive lock like writes.
+   *
+   * JsonFsStore settles promises before returning so the lock
+   * of a shard is held for the whole operation.
+   */
+  class JsonFsShardedStore : public sf::core::interface::MetaDataStore {
+   protected:
+    //! A shard and the lock that guards it.
+    struct Shard {
+      std::shared_ptr<JsonFsStore> store;
+      std::atomic<bool> loaded;
+      pthread_rwlock_t lock;
+    };
+    std::vector<std::unique_ptr<Shard>> shards_;
+    bool shared_;
+
+    //! Returns the shard that owns the key.
+    Shard* shard(const std::string& key);
+
+    //! Runs a read operation on a shard, loading it if needed.
+    poolqueue::Promise readShard(
+        Shard* shard, std::function<poolqueue::Promise(JsonFsStore*)> operation
+    );
+
+    //! Runs a write operation on a shard.
+    poolqueue::Promise writeShard(
+        Shard* shard, std::function<poolqueue::Promise(JsonFsStore*)> operation
+    );
+
+    //! Runs a read operation on the shard that owns the key.
+    poolqueue::Promise read(
+        const std::string& key,
+        std::function<poolqueue::Promise(JsonFsStore*)> operation
+    );
+
+    //! Runs a write operation on the shard that owns the key.
+    poolqueue::Promise write(
+        const std::string& key,
+        std::function<poolqueue::Promise(JsonFsStore*)> operation
+    );
+
+   public:
+    //! Returns a stable hash of the key used to pick shards.
+    static uint64_t Hash(const std::string& key);
+
+    //! Returns the path of a shard file.
+    static std::string ShardPath(std::string store, size_t index);
+
+    JsonFsShardedStore(
+        std::string store, size_t shards,
+        JsonFsFormat format = JsonFsFormat::JSON, bool shared = false,
+        JsonFsCompression compression = JsonFsCompression::NONE
+    );
+    ~JsonFsShardedStore();
+
+    poolqueue::Promise erase(std::string key);
+    poolqueue::Promise get(std::string key);
+    poolqueue::Promise set(std::string key, nlohmann::json value);
+    poolqueue::Promise set(
+        std::string key, nlohmann::json value,
+        std::chrono::duration<int> ttl
+    );
+
+    //! Returns a scan over all the keys that start with prefix.
+    /*!
+     * Each batch takes up to `batch` keys from every shard
+     * and keeps the first `batch` of the merged result.
+     */
+    JsonFsScanRef scan(std::string prefix, size_t batch = 100);
+
+    //! Returns a scan over the keys in [begin, end).
+    JsonFsScanRef scan(std::string begin, std::string end, size_t batch = 100);
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_SHARDED_H_
@@ -0,0 +1,138 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_SNAPSHOT_H_
+#define EXT_METADATA_STORE_JSONFS_SNAPSHOT_H_
+
+#include <stdint.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Read-only, memory mapped, indexed JsonFsStore snapshot.
+  /*!
+   * Indexed snapshots are laid out as:
+   *
+   *    header:    "SFJI" | version (u32) | count (u64)
+   *    directory: count x {key offset (u64), key size (u32),
+   *                        value size (u32), value offset (u64)}
+   *    keys:      the raw bytes of all keys.
+   *    values:    one CBOR blob per value.
+   *
+   * The directory is sorted by key so lookups are binary searches
+   * over the mapped file and values are decoded only when requested.
+   * Opening a snapshot does not depend on the number of keys and
+   * only the pages that are accessed are loaded in memory.
+   */
+  class JsonFsSnapshot {
+    friend class JsonFsSnapshotWriter;
+
+   public:
+    //! Magic bytes at the start of every indexed snapshot.
+    static const char MAGIC[4];
+
+    //! Version of the layout written by JsonFsSnapshotWriter.
+    static const uint32_t VERSION;
+
+   protected:
+    //! Directory entry, as stored in the file.
+    struct Entry {
+      uint64_t key_offset;
+      uint32_t key_size;
+      uint32_t value_size;
+      uint64_t value_offset;
+    };
+
+    std::string path_;
+    const uint8_t* data_;
+    size_t size_;
+    uint64_t count_;
+    const Entry* directory_;
+
+    //! Returns the directory entry at index, checking its bounds.
+    const Entry* entry(size_t index) const;
+
+    //! Compares the key at index with the given key, like memcmp.
+    int compare(size_t index, const std::string& key) const;
+
+   public:
+    explicit JsonFsSnapshot(std::string path);
+    ~JsonFsSnapshot();
+
+    JsonFsSnapshot(const JsonFsSnapshot&) = delete;
+    JsonFsSnapshot& operator=(const JsonFsSnapshot&) = delete;
+
+    //! Number of keys in the snapshot.
+    size_t count() const;
+
+    //! Returns the index of the key or count() if it is missing.
+    size_t find(const std::string& key) const;
+
+    //! Returns the index of the first key not less than the given one.
+    size_t lowerBound(const std::string& key) const;
+
+    //! Returns the key at the given index.
+    std::string key(size_t index) const;
+
+    //! Returns the encoded value at the given index.
+    const uint8_t* blob(size_t index, size_t* size) const;
+
+    //! Decodes the value at the given index.
+    nlohmann::json value(size_t index) const;
+
+    //! Decodes the value for the key or returns null if missing.
+    nlohmann::json get(const std::string& key) const;
+
+    //! Decodes the full snapshot into a JSON object.
+    nlohmann::json toJson() const;
+  };
+
+
+  //! Writes indexed snapshots in the format read by JsonFsSnapshot.
+  /*!
+   * Keys must be added in strictly increasing order.
+   * The snapshot is written to a temporary file and renamed
+   * over the destination so readers never see a partial file.
+   */
+  class JsonFsSnapshotWriter {
+   protected:
+    struct Entry {
+      std::string key;
+      const uint8_t* data;
+      size_t size;
+      std::vector<uint8_t> owned;
+    };
+    std::vector<Entry> entries_;
+    std::vector<std::shared_ptr<JsonFsSnapshot>> sources_;
+
+   public:
+    //! Keeps a snapshot mapped for as long as the writer exists.
+    /*!
+     * Used to make sure values added by reference stay valid.
+     */
+    void retain(std::shared_ptr<JsonFsSnapshot> snapshot);
+
+    //! Adds a value by reference, the data must outlive write().
+    void add(std::string key, const uint8_t* data, size_t size);
+
+    //! Adds a copy of an encoded value.
+    void copy(std::string key, const uint8_t* data, size_t size);
+
+    //! Adds a value encoding it.
+    void add(std::string key, const nlohmann::json& value);
+
+    //! Writes the snapshot to the given path.
+    void write(std::string path);
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_SNAPSHOT_H_
@@ -0,0 +1,154 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_TABLE_H_
+#define EXT_METADATA_STORE_JSONFS_TABLE_H_
+
+#include <stdint.h>
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Compact in-memory key/value table used by JsonFsStore.
+  /*!
+   * Keys and CBOR encoded values are appended to a single arena
+   * so the table needs a handful of allocations regardless of
+   * the number of keys, instead of several per key and per node
+   * of a JSON tree.
+   * Values are decoded only when they are returned.
+   *
+   * Lookups use an open-addressing hash index (linear probing)
+   * and an array of entry ids sorted by key provides ordered
+   * access by position, with the same interface as JsonFsSnapshot.
+   * New keys are appended to the array and sorted into place on
+   * the next ordered access, so loading keys in any order costs
+   * O(N log N) rather than O(N) per key.
+   *
+   * Replaced and erased data is left in the arena until it makes
+   * up more than half of it, then the arena is compacted.
+   */
+  class JsonFsTable {
+   protected:
+    //! Location of a key and its value in the arena.
+    struct Entry {
+      uint64_t key_offset;
+      uint64_t value_offset;
+      uint32_t key_size;
+      uint32_t value_size;
+    };
+
+    std::vector<uint8_t> arena_;
+    std::vector<Entry> entries_;
+    std::vector<uint32_t> free_;
+
+    //! Ids of live entries, sorted by key up to sorted_.
+    mutable std::vector<uint32_t> order_;
+    mutable std::atomic<size_t> sorted_;
+    mutable std::mutex sort_lock_;
+
+    //! Hash index of entry ids (plus one), see EMPTY and TOMBSTONE.
+    std::vector<uint32_t> slots_;
+    size_t used_slots_;
+
+    //! Bytes in the arena no longer referenced by any entry.
+    size_t garbage_;
+
+    //! Compares the key of an entry with the given key, like memcmp.
+    int compare(uint32_t id, const uint8_t* key, size_t size) const;
+    int compare(uint32_t id, const std::string& key) const;
+
+    //! Sorts the keys appended since the last ordered access.
+    /*!
+     * Readers sharing the table can call this concurrently.
+     */
+    void sort() const;
+
+    //! Returns the slot index that holds the key or slots_.size().
+    size_t lookup(const std::string& key) const;
+
+    //! Returns the position in order_ of the first key not less than key.
+    size_t position(const std::string& key) const;
+
+    //! Copies data at the end of the arena and returns its offset.
+    uint64_t append(const uint8_t* data, size_t size);
+
+    //! Rebuilds the hash index with room for at least count keys.
+    void rehash(size_t count);
+
+    //! Drops unreferenced data from the arena.
+    void compact();
+
+   public:
+    //! Slot that was never used.
+    static const uint32_t EMPTY;
+
+    //! Slot of an erased entry: lookups must keep probing.
+    static const uint32_t TOMBSTONE;
+
+    //! Returns a stable 64-bit FNV-1a hash of the key.
+    /*!
+     * std::hash is not guaranteed to be stable across builds
+     * and the hash is also used to map keys to shard files.
+     */
+    static uint64_t Hash(const std::string& key);
+
+    JsonFsTable();
+
+    //! Creates a table with the keys and values of a JSON object.
+    explicit JsonFsTable(const nlohmann::json& object);
+
+    //! Number of keys in the table.
+    size_t count() const;
+
+    //! Approximate number of bytes allocated by the table.
+    size_t memory() const;
+
+    //! Checks if the key is in the table.
+    bool contains(const std::string& key) const;
+
+    //! Returns the encoded value of a key or nullptr if it is missing.
+    const uint8_t* find(const std::string& key, size_t* size) const;
+
+    //! Decodes the value for the key or returns null if missing.
+    nlohmann::json get(const std::string& key) const;
+
+    //! Sets the value of a key.
+    void set(const std::string& key, const nlohmann::json& value);
+
+    //! Sets the encoded value of a key.
+    void set(const std::string& key, const uint8_t* data, size_t size);
+
+    //! Removes a key, returns false if it was missing.
+    bool erase(const std::string& key);
+
+    //! Returns the index of the first key not less than the given one.
+    size_t lowerBound(const std::string& key) const;
+
+    //! Returns the key at the given index, in key order.
+    std::string key(size_t index) const;
+
+    //! Returns the encoded value at the given index.
+    const uint8_t* blob(size_t index, size_t* size) const;
+
+    //! Decodes the value at the given index.
+    nlohmann::json value(size_t index) const;
+
+    //! Decodes the full table into a JSON object.
+    nlohmann::json toJson() const;
+
+    //! Encodes the full table as a CBOR map without decoding values.
+    std::string toCbor() const;
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_TABLE_H_
@@ -0,0 +1,102 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_VIEW_H_
+#define EXT_METADATA_STORE_JSONFS_VIEW_H_
+
+#include <stdint.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/scan.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  class JsonFsStore;
+
+
+  //! Read-only view of a JsonFsStore at the time it was created.
+  /*!
+   * Views do not copy the store: before a key is changed the store
+   * preserves its old value (encoded) in every live view, so a view
+   * only holds the keys changed since it was created.
+   * Reads look at the preserved values first and fall back to the
+   * store, so writers are never blocked by views.
+   *
+   * Views must not outlive the store they were created from.
+   */
+  class JsonFsView {
+   protected:
+    JsonFsStore* store_;
+
+    //! Values of keys before they changed, null for new keys.
+    std::map<std::string, std::unique_ptr<std::vector<uint8_t>>> preserved_;
+
+    //! Returns up to limit keys in a range as they were in the view.
+    nlohmann::json collectRange(
+        const std::string& from, bool inclusive,
+        const std::string& end, size_t limit
+    ) const;
+
+    //! Writes the rest of the scan then closes the output.
+    poolqueue::Promise dumpNext(
+        JsonFsScanRef scan,
+        std::function<void(const nlohmann::json&)> write,
+        std::function<void()> close
+    );
+
+   public:
+    explicit JsonFsView(JsonFsStore* store);
+
+    JsonFsView(const JsonFsView&) = delete;
+    JsonFsView& operator=(const JsonFsView&) = delete;
+
+    //! Preserves the value of a key before the store changes it.
+    /*!
+     * A null data pointer means the key did not exist.
+     * Only the first value preserved for a key is kept.
+     */
+    void preserve(const std::string& key, const uint8_t* data, size_t size);
+
+    //! Number of keys changed in the store since the view was created.
+    size_t preserved() const;
+
+    //! Resolves to the value of the key in the view, null if missing.
+    poolqueue::Promise get(std::string key);
+
+    //! Resolves to an object with up to limit keys in a range.
+    /*!
+     * See JsonFsScan::Fetch for the meaning of the arguments.
+     */
+    poolqueue::Promise range(
+        std::string from, bool inclusive, std::string end, size_t limit
+    );
+
+    //! Returns a scan over all the keys in the view that start with prefix.
+    JsonFsScanRef scan(std::string prefix, size_t batch = 100);
+
+    //! Returns a scan over the keys in the view in [begin, end).
+    JsonFsScanRef scan(std::string begin, std::string end, size_t batch = 100);
+
+    //! Writes the view to a store file in the given format.
+    /*!
+     * The view is written a batch at a time (on the store I/O thread
+     * if it has one) so stores are not blocked while it is written.
+     * The file is written to `<path>.tmp` and renamed when complete.
+     */
+    poolqueue::Promise dump(std::string path, JsonFsFormat format);
+  };
+  typedef std::shared_ptr<JsonFsView> JsonFsViewRef;
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_VIEW_H_
@@ -0,0 +1,156 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_JSONFS_WATCH_H_
+#define EXT_METADATA_STORE_JSONFS_WATCH_H_
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <time.h>
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "core/interface/metadata/store.h"
+#include "core/model/event.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  class JsonFsStore;
+
+
+  //! A committed change to a key.
+  struct JsonFsChange {
+    std::string key;
+
+    //! The new value, null if the key was erased.
+    nlohmann::json value;
+
+    //! Revision of the commit, grows with every notification.
+    uint64_t revision;
+  };
+
+  //! Callback invoked with changes to watched keys.
+  typedef std::function<void(const JsonFsChange&)> JsonFsWatchCallback;
+
+
+  //! Identifies the content of a file without reading it.
+  struct JsonFsStamp {
+    ino_t inode;
+    off_t size;
+    struct timespec mtime;
+
+    JsonFsStamp();
+
+    //! Returns the stamp of a file, or an empty stamp if it is missing.
+    static JsonFsStamp Of(const std::string& path);
+
+    bool operator==(const JsonFsStamp& other) const;
+  };
+
+
+  //! Watches registered on a JsonFsStore and the changes to deliver.
+  /*!
+   * Changes are recorded as the store cache is updated and delivered
+   * once the commits that include them are written.
+   * Changes made while other commits are in flight are coalesced:
+   * each key is delivered once, with its latest value, when the last
+   * pending commit completes.
+   *
+   * Nothing is recorded while there are no watches.
+   */
+  class JsonFsWatchList {
+   public:
+    //! Changes, by key, committed together.
+    typedef std::map<std::string, nlohmann::json> Changes;
+    typedef std::shared_ptr<Changes> ChangesRef;
+
+   protected:
+    struct Watch {
+      std::string key;
+      bool prefix;
+      JsonFsWatchCallback callback;
+    };
+
+    std::map<uint64_t, Watch> watches_;
+    uint64_t next_id_;
+    uint64_t revision_;
+    unsigned int commits_;
+
+    //! Changes not yet included in a commit.
+    Changes pending_;
+
+    //! Changes written to disk but not yet delivered.
+    Changes ready_;
+
+    //! Checks if a watch matches the key.
+    static bool Matches(const Watch& watch, const std::string& key);
+
+   public:
+    JsonFsWatchList();
+
+    //! Registers a callback for a key or, if prefix, all keys under it.
+    uint64_t add(std::string key, bool prefix, JsonFsWatchCallback callback);
+
+    //! Removes a watch, unknown ids are ignored.
+    void remove(uint64_t id);
+
+    //! Checks if commits are being written.
+    bool busy() const;
+
+    //! Checks if there are no watches.
+    bool empty() const;
+
+    //! Latest revision delivered to watches.
+    uint64_t revision() const;
+
+    //! Records a change, a null value for erased keys.
+    void record(const std::string& key, const nlohmann::json& value);
+
+    //! Takes the pending changes to include in a new commit.
+    ChangesRef begin();
+
+    //! Marks a commit started with begin() as written (or failed).
+    /*!
+     * Changes of failed commits are dropped: they are not on disk.
+     */
+    void end(ChangesRef changes, bool written);
+
+    //! Delivers the changes that are ready, if no commit is pending.
+    void deliver();
+  };
+
+
+  //! Notifies a JsonFsStore of changes made to its file by others.
+  /*!
+   * Uses inotify to watch the directory of the store, so files
+   * replaced with a rename are detected too, and is added to the
+   * event loop like any other source.
+   * When the store file is written the store is refreshed and
+   * watches are notified of keys that changed.
+   */
+  class JsonFsWatcher : public sf::core::model::EventSource {
+   protected:
+    int inotify_fd_;
+    std::string name_;
+    std::shared_ptr<JsonFsStore> store_;
+
+    //! Refreshes the store if its file changed.
+    sf::core::model::EventRef parse();
+
+   public:
+    JsonFsWatcher(std::string id, std::shared_ptr<JsonFsStore> store);
+    ~JsonFsWatcher();
+
+    int fd();
+  };
+  typedef std::shared_ptr<JsonFsWatcher> JsonFsWatcherRef;
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_JSONFS_WATCH_H_
@@ -0,0 +1,186 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/cached.h"
+
+#include <mutex>
+#include <string>
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::core::interface::MetaDataStoreRef;
+using sf::ext::metadata::CachedMetaDataStore;
+
+typedef CachedMetaDataStore::Clock Clock;
+
+
+Clock::time_point CachedMetaDataStore::now() const {
+  return Clock::now();
+}
+
+Clock::time_point CachedMetaDataStore::expiry(Clock::duration ttl) const {
+  if (ttl == Clock::duration::zero()) {
+    return Clock::time_point::max();
+  }
+  return this->now() + ttl;
+}
+
+void CachedMetaDataStore::drop(const std::string& key) {
+  auto entry = this->index_.find(key);
+  if (entry != this->index_.end()) {
+    this->entries_.erase(entry->second);
+    this->index_.erase(entry);
+  }
+}
+
+void CachedMetaDataStore::insert(
+    const std::string& key, const json& value, Clock::time_point expires
+) {
+  if (this->capacity_ == 0 || (value.is_null() && !this->negative_)) {
+    return;
+  }
+  this->drop(key);
+  this->entries_.push_front({key, value, expires});
+  this->index_[key] = this->entries_.begin();
+  if (this->entries_.size() > this->capacity_) {
+    this->index_.erase(this->entries_.back().key);
+    this->entries_.pop_back();
+  }
+}
+
+void CachedMetaDataStore::start(const std::string& key) {
+  // The key is invalidated while the write is in flight.
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->writes_ += 1;
+  this->writing_[key] += 1;
+  this->drop(key);
+}
+
+Promise CachedMetaDataStore::write(
+    const std::string& key, const json& value,
+    Clock::time_point expires, Promise written
+) {
+  // Counts the write as done, the lock must be held.
+  auto done = [this, key]() {
+    auto writing = this->writing_.find(key);
+    writing->second -= 1;
+    if (writing->second == 0) {
+      this->writing_.erase(writing);
+      return true;
+    }
+    return false;
+  };
+  return written.then([this, key, value, expires, done]() {
+    // Only the last of concurrent writes knows the final value.
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (done()) {
+      this->insert(key, value, expires);
+    }
+    return nullptr;
+  }, [this, done](std::exception_ptr error) {
+    {
+      std::lock_guard<std::mutex> guard(this->lock_);
+      done();
+    }
+    std::rethrow_exception(error);
+    return nullptr;
+  });
+}
+
+
+CachedMetaDataStore::CachedMetaDataStore(
+    MetaDataStoreRef store, size_t capacity, bool negative,
+    std::chrono::duration<int> max_age
+) {
+  this->store_ = store;
+  this->capacity_ = capacity;
+  this->negative_ = negative;
+  this->max_age_ = max_age;
+  this->writes_ = 0;
+  this->hits_ = 0;
+  this->misses_ = 0;
+}
+
+void CachedMetaDataStore::invalidate(const std::string& key) {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->drop(key);
+}
+
+void CachedMetaDataStore::clear() {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->entries_.clear();
+  this->index_.clear();
+}
+
+size_t CachedMetaDataStore::size() const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->entries_.size();
+}
+
+uint64_t CachedMetaDataStore::hits() const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->hits_;
+}
+
+uint64_t CachedMetaDataStore::misses() const {
+  std::lock_guard<std::mutex> guard(this->lock_);
+  return this->misses_;
+}
+
+
+Promise CachedMetaDataStore::erase(std::string key) {
+  this->start(key);
+  Promise erased = this->store_->erase(key);
+  return this->write(key, json(), this->expiry(this->max_age_), erased);
+}
+
+Promise CachedMetaDataStore::get(std::string key) {
+  uint64_t writes = 0;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    auto entry = this->index_.find(key);
+    if (entry != this->index_.end()) {
+      if (entry->second->expires > this->now()) {
+        this->hits_ += 1;
+        this->entries_.splice(
+            this->entries_.begin(), this->entries_, entry->second
+        );
+        json value = entry->second->value;
+        return Promise().settle(value);
+      }
+      this->drop(key);
+    }
+    this->misses_ += 1;
+    writes = this->writes_;
+  }
+
+  // Fetch the key and cache it unless it was written meanwhile.
+  Clock::time_point expires = this->expiry(this->max_age_);
+  return this->store_->get(key).then([this, key, writes, expires](
+      json value
+  ) {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    if (this->writes_ == writes) {
+      this->insert(key, value, expires);
+    }
+    return value;
+  });
+}
+
+Promise CachedMetaDataStore::set(std::string key, json value) {
+  this->start(key);
+  Promise written = this->store_->set(key, value);
+  return this->write(key, value, this->expiry(this->max_age_), written);
+}
+
+Promise CachedMetaDataStore::set(
+    std::string key, json value, std::chrono::duration<int> ttl
+) {
+  Clock::duration age = ttl;
+  if (this->max_age_ != Clock::duration::zero() && this->max_age_ < age) {
+    age = this->max_age_;
+  }
+  this->start(key);
+  Promise written = this->store_->set(key, value, ttl);
+  return this->write(key, value, this->expiry(age), written);
+}
@@ -0,0 +1,252 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/compress.h"
+
+#include <zstd.h>
+
+#include <algorithm>
+#include <streambuf>
+#include <string>
+#include <vector>
+
+#include "core/exceptions/base.h"
+#include "ext/metadata/store/jsonfs/exceptions.h"
+
+
+using sf::core::exception::ErrNoException;
+using sf::ext::exception::JsonFsCorruptStore;
+
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsInputFile;
+using sf::ext::metadata::JsonFsOutputFile;
+
+
+//! Compression level used for new files, the zstd default.
+static const int ZSTD_LEVEL = 3;
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Stream buffer that decompresses a zstd file as it is read.
+  class JsonFsZstdReader : public std::streambuf {
+   protected:
+    std::istream* source_;
+    std::string path_;
+    ZSTD_DCtx* context_;
+    std::vector<char> input_buffer_;
+    std::vector<char> output_buffer_;
+    ZSTD_inBuffer input_;
+
+    //! Set when the current frame is complete.
+    bool complete_;
+
+    int_type underflow() {
+      if (this->gptr() < this->egptr()) {
+        return traits_type::to_int_type(*this->gptr());
+      }
+
+      while (true) {
+        if (this->input_.pos == this->input_.size) {
+          this->source_->read(
+              this->input_buffer_.data(), this->input_buffer_.size()
+          );
+          size_t read = static_cast<size_t>(this->source_->gcount());
+          if (read == 0) {
+            if (!this->complete_) {
+              throw JsonFsCorruptStore(this->path_ + ": truncated zstd frame");
+            }
+            return traits_type::eof();
+          }
+          this->input_ = {this->input_buffer_.data(), read, 0};
+        }
+
+        ZSTD_outBuffer output = {
+          this->output_buffer_.data(), this->output_buffer_.size(), 0
+        };
+        size_t result = ZSTD_decompressStream(
+            this->context_, &output, &this->input_
+        );
+        if (ZSTD_isError(result)) {
+          throw JsonFsCorruptStore(
+              this->path_ + ": " + ZSTD_getErrorName(result)
+          );
+        }
+        this->complete_ = result == 0;
+        if (output.pos > 0) {
+          char* begin = this->output_buffer_.data();
+          this->setg(begin, begin, begin + output.pos);
+          return traits_type::to_int_type(*this->gptr());
+        }
+      }
+    }
+
+   public:
+    JsonFsZstdReader(std::istream* source, std::string path) {
+      this->source_ = source;
+      this->path_ = path;
+      this->context_ = ZSTD_createDCtx();
+      this->input_buffer_.resize(ZSTD_DStreamInSize());
+      this->output_buffer_.resize(ZSTD_DStreamOutSize());
+      this->input_ = {this->input_buffer_.data(), 0, 0};
+      this->complete_ = true;
+    }
+
+    ~JsonFsZstdReader() {
+      ZSTD_freeDCtx(this->context_);
+    }
+  };
+
+
+  //! Compresses data into a zstd frame written to a file.
+  class JsonFsZstdWriter {
+   protected:
+    std::ostream* sink_;
+    ZSTD_CCtx* context_;
+    std::vector<char> output_buffer_;
+
+    //! Compresses the input, flushing the frame at the end.
+    void compress(const char* data, size_t size, ZSTD_EndDirective mode) {
+      ZSTD_inBuffer input = {data, size, 0};
+      size_t remaining = 0;
+      do {
+        ZSTD_outBuffer output = {
+          this->output_buffer_.data(), this->output_buffer_.size(), 0
+        };
+        remaining = ZSTD_compressStream2(
+            this->context_, &output, &input, mode
+        );
+        if (ZSTD_isError(remaining)) {
+          throw ErrNoException(
+              std::string("Unable to compress JsonFS store: ") +
+              ZSTD_getErrorName(remaining)
+          );
+        }
+        this->sink_->write(this->output_buffer_.data(), output.pos);
+      } while (mode == ZSTD_e_end ? remaining != 0 : input.pos < input.size);
+    }
+
+   public:
+    explicit JsonFsZstdWriter(std::ostream* sink) {
+      this->sink_ = sink;
+      this->context_ = ZSTD_createCCtx();
+      this->output_buffer_.resize(ZSTD_CStreamOutSize());
+      ZSTD_CCtx_setParameter(
+          this->context_, ZSTD_c_compressionLevel, ZSTD_LEVEL
+      );
+    }
+
+    ~JsonFsZstdWriter() {
+      ZSTD_freeCCtx(this->context_);
+    }
+
+    void write(const char* data, size_t size) {
+      this->compress(data, size, ZSTD_e_continue);
+    }
+
+    void close() {
+      this->compress(nullptr, 0, ZSTD_e_end);
+    }
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+
+using sf::ext::metadata::JsonFsZstdReader;
+using sf::ext::metadata::JsonFsZstdWriter;
+
+
+const char JsonFsInputFile::ZSTD_MAGIC[4] = {
+  '\x28', '\xb5', '\x2f', '\xfd'
+};
+
+
+JsonFsInputFile::JsonFsInputFile(std::string path) {
+  this->size_ = 0;
+  this->compression_ = JsonFsCompression::NONE;
+  this->file_.open(path, std::ios::binary | std::ios::ate);
+  if (!this->file_) {
+    return;
+  }
+  this->size_ = static_cast<size_t>(this->file_.tellg());
+  this->file_.seekg(0);
+
+  // Look for the zstd magic and rewind.
+  char magic[4] = {0, 0, 0, 0};
+  this->file_.read(magic, sizeof(magic));
+  bool zstd = this->file_.gcount() == sizeof(magic) &&
+      std::equal(magic, magic + sizeof(magic), ZSTD_MAGIC);
+  this->file_.clear();
+  this->file_.seekg(0);
+  if (!zstd) {
+    return;
+  }
+
+  // Errors from the stream buffer must reach the parsers.
+  this->compression_ = JsonFsCompression::ZSTD;
+  this->zstd_.reset(new JsonFsZstdReader(&this->file_, path));
+  this->stream_.reset(new std::istream(this->zstd_.get()));
+  this->stream_->exceptions(std::ios::badbit);
+}
+
+JsonFsInputFile::~JsonFsInputFile() {
+  // Needed to destroy the forward declared readers.
+}
+
+JsonFsCompression JsonFsInputFile::compression() const {
+  return this->compression_;
+}
+
+size_t JsonFsInputFile::size() const {
+  return this->size_;
+}
+
+size_t JsonFsInputFile::position() {
+  std::streamoff position = this->file_.tellg();
+  return position < 0 ? this->size_ : static_cast<size_t>(position);
+}
+
+std::istream& JsonFsInputFile::stream() {
+  if (this->stream_) {
+    return *this->stream_;
+  }
+  return this->file_;
+}
+
+
+JsonFsOutputFile::JsonFsOutputFile(
+    std::string path, JsonFsCompression compression
+) {
+  this->path_ = path;
+  this->file_.open(path, std::ios::binary | std::ios::trunc);
+  if (!this->file_) {
+    throw ErrNoException("Unable to open JsonFS store " + path);
+  }
+  if (compression == JsonFsCompression::ZSTD) {
+    this->zstd_.reset(new JsonFsZstdWriter(&this->file_));
+  }
+}
+
+JsonFsOutputFile::~JsonFsOutputFile() {
+  // Needed to destroy the forward declared writers.
+}
+
+void JsonFsOutputFile::write(const char* data, size_t size) {
+  if (this->zstd_) {
+    this->zstd_->write(data, size);
+  } else {
+    this->file_.write(data, size);
+  }
+}
+
+void JsonFsOutputFile::close() {
+  if (this->zstd_) {
+    this->zstd_->close();
+  }
+  this->file_.close();
+  if (!this->file_) {
+    throw ErrNoException("Unable to write JsonFS store " + this->path_);
+  }
+}
@@ -1,6 +1,8 @@
 // Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
 #include "ext/metadata/store/jsonfs/config.h"
 
+#include <chrono>
+#include <memory>
 #include <string>
 #include <vector>
 
@@ -17,6 +19,10 @@
 #include "core/utility/lua.h"
 
 #include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/cached.h"
+#include "ext/metadata/store/jsonfs/io.h"
+#include "ext/metadata/store/jsonfs/sharded.h"
+#include "ext/metadata/store/jsonfs/watch.h"
 
 
 using sf::core::cluster::Cluster;
@@ -37,8 +43,18 @@ using sf::core::utility::Lua;
 using sf::core::utility::LuaArguments;
 using sf::core::utility::LuaTable;
 
+using sf::ext::metadata::CachedMetaDataStore;
+using sf::ext::metadata::JsonFsChange;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsIoThread;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsShardedStore;
 using sf::ext::metadata::JsonFsStore;
 using sf::ext::metadata::JsonFsStoreConfig;
+using sf::ext::metadata::JsonFsStoreOptions;
+using sf::ext::metadata::JsonFsWatcher;
 
 using sf::core::exception::ErrNoException;
 
@@ -46,13 +62,72 @@ using sf::core::exception::ErrNoException;
 class JsonFsStoreIntent : public NodeConfigIntent {
  protected:
   std::string path_;
+  JsonFsStoreOptions options_;
+
+  //! Wraps the store in a CachedMetaDataStore if requested.
+  MetaDataStoreRef cached(MetaDataStoreRef store) {
+    if (this->options_.cache == 0) {
+      return store;
+    }
+    return std::make_shared<CachedMetaDataStore>(
+        store, this->options_.cache, true,
+        std::chrono::seconds(this->options_.cache_age)
+    );
+  }
+
+  //! Creates the store described by the intent.
+  MetaDataStoreRef makeStore(ContextRef context) {
+    if (this->options_.shards > 1) {
+      return this->cached(std::make_shared<JsonFsShardedStore>(
+          this->path_, this->options_.shards, this->options_.format,
+          this->options_.shared, this->options_.compression
+      ));
+    }
+
+    // Register the I/O thread with the event loop.
+    JsonFsIoThreadRef io;
+    if (this->options_.async) {
+      io = std::make_shared<JsonFsIoThread>("jsonfs-io:" + this->provides());
+      context->loopManager()->add(io);
+    }
+    auto store = std::make_shared<JsonFsStore>(
+        this->path_, this->options_.format, io, this->options_.shared,
+        this->options_.compression
+    );
+    MetaDataStoreRef result = this->cached(store);
+
+    // Register the file watcher with the event loop.
+    if (this->options_.watch) {
+      context->loopManager()->add(std::make_shared<JsonFsWatcher>(
+          "jsonfs-watch:" + this->provides(), store
+      ));
+    }
+
+    // Drop cached keys when the file changes.
+    auto cache = std::dynamic_pointer_cast<CachedMetaDataStore>(result);
+    if (cache && this->options_.watch) {
+      std::weak_ptr<CachedMetaDataStore> weak = cache;
+      store->watchPrefix("", [weak](const JsonFsChange& change) {
+        auto cache = weak.lock();
+        if (cache) {
+          cache->invalidate(change.key);
+        }
+      });
+    }
+    return result;
+  }
 
  public:
-  explicit JsonFsStoreIntent(std::string path) : NodeConfigIntent("jsonfs") {
+  JsonFsStoreIntent(std::string path, JsonFsStoreOptions options)
+    : NodeConfigIntent("jsonfs") {
     this->path_ = path;
+    this->options_ = options;
   }
 
   virtual std::vector<std::string> depends() const {
+    if (this->options_.async || this->options_.watch) {
+      return std::vector<std::string>({"event.manager"});
+    }
     return std::vector<std::string>();
   }
 
@@ -61,7 +136,7 @@ class JsonFsStoreIntent : public NodeConfigIntent {
   }
 
   virtual void apply(ContextRef context) {
-    MetaDataStoreRef store = std::make_shared<JsonFsStore>(this->path_);
+    MetaDataStoreRef store = this->makeStore(context);
     context->initialise(store);
   }
 
@@ -95,8 +170,8 @@ class JsonFsStoreIntent : public NodeConfigIntent {
 // TODO(stefano): Remove this as soon as the config refactoring is done.
 class JsonFsClusterStoreIntent : public JsonFsStoreIntent {
  public:
-  explicit JsonFsClusterStoreIntent(std::string path)
-    : JsonFsStoreIntent(path) {
+  JsonFsClusterStoreIntent(std::string path, JsonFsStoreOptions options)
+    : JsonFsStoreIntent(path, options) {
     // NOOP
   }
   virtual std::string provides() const {
@@ -104,13 +179,89 @@ class JsonFsClusterStoreIntent : public JsonFsStoreIntent {
   }
 
   virtual void apply(ContextRef context) {
-    MetaDataStoreRef store = std::make_shared<JsonFsStore>(this->path_);
+    MetaDataStoreRef store = this->makeStore(context);
     Cluster cluster = std::make_shared<ClusterRaw>(store);
     Cluster::Instance(cluster);
   }
 };
 
 
+//! Checks if the options table (first argument) has a non-nil key.
+bool lua_jsonfs_has_option(lua_State* state, std::string key) {
+  lua_getfield(state, 1, key.c_str());
+  bool found = !lua_isnil(state, -1);
+  lua_pop(state, 1);
+  return found;
+}
+
+//! Returns the optional store settings, with defaults for missing keys.
+JsonFsStoreOptions lua_jsonfs_options(lua_State* state, LuaTable* table) {
+  JsonFsStoreOptions options;
+  if (lua_jsonfs_has_option(state, "format")) {
+    options.format = JsonFsCodec::FormatFromName(table->toString("format"));
+  }
+  if (lua_jsonfs_has_option(state, "compression")) {
+    options.compression = JsonFsCodec::CompressionFromName(
+        table->toString("compression")
+    );
+  }
+  if (lua_jsonfs_has_option(state, "shards")) {
+    int shards = table->toInt("shards");
+    if (shards < 1) {
+      throw InvalidConfiguration("JsonFS store needs at least one shard");
+    }
+    options.shards = shards;
+  }
+  if (lua_jsonfs_has_option(state, "async")) {
+    options.async = table->toBool("async");
+  }
+  if (lua_jsonfs_has_option(state, "watch")) {
+    options.watch = table->toBool("watch");
+  }
+  if (lua_jsonfs_has_option(state, "shared")) {
+    options.shared = table->toBool("shared");
+  }
+  if (lua_jsonfs_has_option(state, "cache")) {
+    int cache = table->toInt("cache");
+    if (cache < 0) {
+      throw InvalidConfiguration("JsonFS cache size can't be negative");
+    }
+    options.cache = cache;
+  }
+  if (lua_jsonfs_has_option(state, "cache_age")) {
+    int age = table->toInt("cache_age");
+    if (age < 0) {
+      throw InvalidConfiguration("JsonFS cache age can't be negative");
+    }
+    options.cache_age = age;
+  }
+
+  // Shard locks are only held while operations run synchronously.
+  if (options.async && options.shards > 1) {
+    throw InvalidConfiguration("Sharded JsonFS stores can't be async");
+  }
+  if (options.async && options.shared) {
+    throw InvalidConfiguration("Shared JsonFS stores can't be async");
+  }
+  if (options.format == JsonFsFormat::INDEXED &&
+      options.compression != JsonFsCompression::NONE) {
+    throw InvalidConfiguration("Indexed JsonFS stores can't be compressed");
+  }
+  if (options.watch && options.shards > 1) {
+    throw InvalidConfiguration("Sharded JsonFS stores can't be watched");
+  }
+
+  // Other processes can only invalidate cached keys through watches.
+  if (options.cache > 0 && options.shared && !options.watch &&
+      options.cache_age == 0) {
+    throw InvalidConfiguration(
+        "Cached shared JsonFS stores need watch or cache_age"
+    );
+  }
+  return options;
+}
+
+
 //! Returns a NodeConfigIntent to build a JsonFsStore.
 int lua_jsonfs_intent(lua_State* state) {
   NodeConfigIntentLuaProxy type;
@@ -120,9 +271,10 @@ int lua_jsonfs_intent(lua_State* state) {
   LuaArguments args(lua);
   LuaTable options = args.table(1);
   std::string path = options.toString("store");
+  JsonFsStoreOptions settings = lua_jsonfs_options(state, &options);
 
   // Create and return the intent.
-  auto intent = JsonFsStoreConfig::MakeIntent(path);
+  auto intent = JsonFsStoreConfig::MakeIntent(path, settings);
   type.wrap(*lua, intent);
   return 1;
 }
@@ -137,9 +289,10 @@ int lua_jsonfs_cluster_intent(lua_State* state) {
   LuaArguments args(lua);
   LuaTable options = args.table(1);
   std::string path = options.toString("store");
+  JsonFsStoreOptions settings = lua_jsonfs_options(state, &options);
 
   // Create and return the intent.
-  auto intent = std::make_shared<JsonFsClusterStoreIntent>(path);
+  auto intent = std::make_shared<JsonFsClusterStoreIntent>(path, settings);
   type.wrap(*lua, intent);
   return 1;
 }
@@ -156,6 +309,20 @@ void JsonFsStoreConfig::AttachLuaInit() {
   });
 }
 
-NodeConfigIntentRef JsonFsStoreConfig::MakeIntent(std::string path) {
-  return std::make_shared<JsonFsStoreIntent>(path);
+JsonFsStoreOptions::JsonFsStoreOptions() {
+  this->format = JsonFsFormat::JSON;
+  this->compression = JsonFsCompression::NONE;
+  this->shards = 1;
+  this->async = false;
+  this->watch = false;
+  this->shared = false;
+  this->cache = 0;
+  this->cache_age = 0;
+}
+
+
+NodeConfigIntentRef JsonFsStoreConfig::MakeIntent(
+    std::string path, JsonFsStoreOptions options
+) {
+  return std::make_shared<JsonFsStoreIntent>(path, options);
 }
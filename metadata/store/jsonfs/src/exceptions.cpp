@@ -0,0 +1,16 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/exceptions.h"
+
+#include <string>
+
+using sf::core::exception::SfException;
+using sf::ext::exception::JsonFsCorruptStore;
+
+
+JsonFsCorruptStore::JsonFsCorruptStore(std::string path) : SfException(
+  "Corrupt JsonFS store '" + path + "'"
+) { }
+
+int JsonFsCorruptStore::getCode() const {
+  return -4200;
+}
@@ -0,0 +1,189 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/format.h"
+
+#include <cctype>
+#include <fstream>
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include "core/exceptions/configuration.h"
+#include "ext/metadata/store/jsonfs/compress.h"
+#include "ext/metadata/store/jsonfs/exceptions.h"
+#include "ext/metadata/store/jsonfs/snapshot.h"
+
+
+using nlohmann::json;
+
+using sf::core::exception::InvalidConfiguration;
+using sf::ext::exception::JsonFsCorruptStore;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsInputFile;
+using sf::ext::metadata::JsonFsOutputFile;
+using sf::ext::metadata::JsonFsSnapshot;
+using sf::ext::metadata::JsonFsSnapshotWriter;
+
+
+JsonFsFormat JsonFsCodec::FormatFromName(std::string name) {
+  if (name == "json") {
+    return JsonFsFormat::JSON;
+  }
+  if (name == "cbor") {
+    return JsonFsFormat::CBOR;
+  }
+  if (name == "msgpack") {
+    return JsonFsFormat::MSGPACK;
+  }
+  if (name == "indexed") {
+    return JsonFsFormat::INDEXED;
+  }
+  throw InvalidConfiguration("Unsupported JsonFS store format '" + name + "'");
+}
+
+std::string JsonFsCodec::FormatName(JsonFsFormat format) {
+  switch (format) {
+    case JsonFsFormat::CBOR:    return "cbor";
+    case JsonFsFormat::MSGPACK: return "msgpack";
+    case JsonFsFormat::INDEXED: return "indexed";
+    default:                    return "json";
+  }
+}
+
+JsonFsCompression JsonFsCodec::CompressionFromName(std::string name) {
+  if (name == "none") {
+    return JsonFsCompression::NONE;
+  }
+  if (name == "zstd") {
+    return JsonFsCompression::ZSTD;
+  }
+  throw InvalidConfiguration(
+      "Unsupported JsonFS store compression '" + name + "'"
+  );
+}
+
+std::string JsonFsCodec::CompressionName(JsonFsCompression compression) {
+  switch (compression) {
+    case JsonFsCompression::ZSTD: return "zstd";
+    default:                      return "none";
+  }
+}
+
+JsonFsFormat JsonFsCodec::Detect(std::istream& source) {
+  // Stores are always objects so the first byte is enough:
+  //   * CBOR maps have major type 5 (0xa0 - 0xbf).
+  //   * MessagePack maps are fixmap (0x80 - 0x8f), map16 or map32.
+  //   * Indexed snapshots start with the JsonFsSnapshot magic.
+  //   * Anything else is left to the JSON parser.
+  int first = source.peek();
+  if (first == std::istream::traits_type::eof()) {
+    source.clear();
+    return JsonFsFormat::JSON;
+  }
+
+  if (first >= 0xa0 && first <= 0xbf) {
+    return JsonFsFormat::CBOR;
+  }
+  if ((first >= 0x80 && first <= 0x8f) || first == 0xde || first == 0xdf) {
+    return JsonFsFormat::MSGPACK;
+  }
+  if (first == JsonFsSnapshot::MAGIC[0]) {
+    return JsonFsFormat::INDEXED;
+  }
+  return JsonFsFormat::JSON;
+}
+
+json JsonFsCodec::Load(std::string path) {
+  JsonFsInputFile input(path);
+  std::istream& source = input.stream();
+  JsonFsFormat format = JsonFsCodec::Detect(source);
+
+  // Missing and empty files are empty stores.
+  if (source.peek() == std::ifstream::traits_type::eof()) {
+    return json::object();
+  }
+
+  if (format == JsonFsFormat::JSON) {
+    json data;
+    source >> data;
+    return data;
+  }
+  if (format == JsonFsFormat::INDEXED) {
+    if (input.compression() != JsonFsCompression::NONE) {
+      throw InvalidConfiguration(
+          "Indexed JsonFS store '" + path + "' can't be compressed"
+      );
+    }
+    return JsonFsSnapshot(path).toJson();
+  }
+
+  // Binary formats are decoded from a buffer.
+  std::vector<uint8_t> buffer(
+      (std::istreambuf_iterator<char>(source)),
+      std::istreambuf_iterator<char>()
+  );
+  if (format == JsonFsFormat::CBOR) {
+    return json::from_cbor(buffer);
+  }
+  return json::from_msgpack(buffer);
+}
+
+std::string JsonFsCodec::Encode(const json& data, JsonFsFormat format) {
+  if (format == JsonFsFormat::INDEXED) {
+    throw InvalidConfiguration("Indexed stores can't be encoded in memory");
+  }
+  if (format == JsonFsFormat::JSON) {
+    return data.dump();
+  }
+
+  std::vector<uint8_t> buffer;
+  if (format == JsonFsFormat::CBOR) {
+    buffer = json::to_cbor(data);
+  } else {
+    buffer = json::to_msgpack(data);
+  }
+  return std::string(buffer.begin(), buffer.end());
+}
+
+void JsonFsCodec::Write(
+    std::string path, const std::string& content,
+    JsonFsCompression compression
+) {
+  JsonFsOutputFile store(path, compression);
+  store.write(content.data(), content.size());
+  store.close();
+}
+
+void JsonFsCodec::Dump(
+    std::string path, const json& data, JsonFsFormat format,
+    JsonFsCompression compression
+) {
+  if (format == JsonFsFormat::INDEXED) {
+    if (compression != JsonFsCompression::NONE) {
+      throw InvalidConfiguration("Indexed JsonFS stores can't be compressed");
+    }
+    JsonFsSnapshotWriter writer;
+    for (auto it = data.begin(); it != data.end(); ++it) {
+      writer.add(it.key(), it.value());
+    }
+    writer.write(path);
+    return;
+  }
+  JsonFsCodec::Write(path, JsonFsCodec::Encode(data, format), compression);
+}
+
+void JsonFsCodec::Migrate(std::string path, JsonFsFormat format) {
+  JsonFsCompression compression = JsonFsCompression::NONE;
+  if (format != JsonFsFormat::INDEXED) {
+    compression = JsonFsInputFile(path).compression();
+  }
+  JsonFsCodec::Migrate(path, format, compression);
+}
+
+void JsonFsCodec::Migrate(
+    std::string path, JsonFsFormat format, JsonFsCompression compression
+) {
+  json data = JsonFsCodec::Load(path);
+  JsonFsCodec::Dump(path, data, format, compression);
+}
@@ -0,0 +1,177 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/io.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/context/context.h"
+#include "core/exceptions/base.h"
+#include "core/model/logger.h"
+
+
+using poolqueue::Promise;
+
+using sf::core::context::ProxyLogger;
+using sf::core::exception::ErrNoException;
+using sf::core::model::EventRef;
+using sf::core::model::EventSource;
+using sf::core::model::LogInfo;
+
+using sf::ext::metadata::JsonFsIoThread;
+
+
+static ProxyLogger logger("ext.metadata.store.jsonfs");
+
+
+//! Wakes up the event loop by bumping the eventfd counter.
+/*!
+ * Waits for the loop to drain the counter if it is full.
+ */
+static void wake_loop(int fd) {
+  uint64_t count = 1;
+  while (::write(fd, &count, sizeof(count)) < 0) {
+    if (errno == EAGAIN) {
+      std::this_thread::yield();
+    } else if (errno != EINTR) {
+      throw ErrNoException("Unable to wake up the JsonFS I/O event loop");
+    }
+  }
+}
+
+//! Resets the eventfd counter, it may already be drained.
+static void drain_loop(int fd) {
+  uint64_t count = 0;
+  while (::read(fd, &count, sizeof(count)) < 0) {
+    if (errno == EAGAIN) {
+      return;
+    }
+    if (errno != EINTR) {
+      throw ErrNoException("Unable to read the JsonFS I/O eventfd");
+    }
+  }
+}
+
+
+void JsonFsIoThread::run() {
+  std::unique_lock<std::mutex> guard(this->lock_);
+  while (true) {
+    this->wakeup_.wait(guard, [this]() {
+      return this->stopping_ || !this->queue_.empty();
+    });
+    if (this->queue_.empty()) {
+      return;
+    }
+
+    // Run the work without holding the lock.
+    Task task = std::move(this->queue_.front());
+    this->queue_.pop_front();
+    guard.unlock();
+    try {
+      task.work();
+    } catch (...) {
+      task.error = std::current_exception();
+    }
+    task.work = nullptr;
+    guard.lock();
+
+    // Queue the completion and wake up the event loop.
+    this->completed_.push_back(std::move(task));
+    try {
+      wake_loop(this->event_fd_);
+    } catch (ErrNoException& ex) {
+      LogInfo vars = {{"error", ex.what()}};
+      ERRORV(logger, "Unable to wake the JsonFS I/O loop: ${error}", vars);
+      this->abandon(std::current_exception(), &guard);
+    }
+  }
+}
+
+void JsonFsIoThread::abandon(
+    std::exception_ptr error, std::unique_lock<std::mutex>* guard
+) {
+  std::vector<Task> completed;
+  completed.swap(this->completed_);
+  guard->unlock();
+
+  // Callbacks are dropped as they must run on the loop thread.
+  for (auto& task : completed) {
+    if (!task.callback) {
+      task.result.settle(task.error ? task.error : error);
+    }
+  }
+  guard->lock();
+}
+
+EventRef JsonFsIoThread::parse() {
+  drain_loop(this->event_fd_);
+
+  std::vector<Task> completed;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    completed.swap(this->completed_);
+  }
+
+  // Settle the promises on the event loop thread.
+  for (auto& task : completed) {
+    if (task.callback) {
+      task.callback();
+    } else if (task.error) {
+      task.result.settle(task.error);
+    } else {
+      task.result.settle(nullptr);
+    }
+  }
+  return EventRef();
+}
+
+
+JsonFsIoThread::JsonFsIoThread(std::string id) : EventSource(id) {
+  this->stopping_ = false;
+  this->event_fd_ = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+  if (this->event_fd_ < 0) {
+    throw ErrNoException("Unable to create JsonFS I/O eventfd");
+  }
+  this->worker_ = std::thread(&JsonFsIoThread::run, this);
+}
+
+JsonFsIoThread::~JsonFsIoThread() {
+  // Pending work is completed before the thread stops.
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->stopping_ = true;
+  }
+  this->wakeup_.notify_one();
+  this->worker_.join();
+  ::close(this->event_fd_);
+}
+
+int JsonFsIoThread::fd() {
+  return this->event_fd_;
+}
+
+Promise JsonFsIoThread::submit(std::function<void()> work) {
+  Task task;
+  task.work = work;
+  Promise result = task.result;
+  {
+    std::lock_guard<std::mutex> guard(this->lock_);
+    this->queue_.push_back(std::move(task));
+  }
+  this->wakeup_.notify_one();
+  return result;
+}
+
+void JsonFsIoThread::post(std::function<void()> callback) {
+  Task task;
+  task.callback = callback;
+  std::lock_guard<std::mutex> guard(this->lock_);
+  this->completed_.push_back(std::move(task));
+  wake_loop(this->event_fd_);
+}
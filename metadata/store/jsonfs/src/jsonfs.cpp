@@ -1,10 +1,19 @@
 // Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
 #include "ext/metadata/store/jsonfs.h"
 
+#include <stdint.h>
+
+#include <algorithm>
+#include <exception>
 #include <fstream>
+#include <functional>
+#include <map>
+#include <memory>
 #include <string>
+#include <vector>
 
 #include "core/context/context.h"
+#include "core/exceptions/configuration.h"
 #include "core/model/logger.h"
 
 
@@ -12,67 +21,569 @@ using nlohmann::json;
 using poolqueue::Promise;
 
 using sf::core::context::ProxyLogger;
+using sf::core::exception::InvalidConfiguration;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsLoadCallback;
+using sf::ext::metadata::JsonFsLoadProgress;
+using sf::ext::metadata::JsonFsLoader;
+using sf::ext::metadata::JsonFsRevisionGuard;
+using sf::ext::metadata::JsonFsRevisionLock;
+using sf::ext::metadata::JsonFsScan;
+using sf::ext::metadata::JsonFsScanRef;
+using sf::ext::metadata::JsonFsSnapshot;
+using sf::ext::metadata::JsonFsSnapshotWriter;
+using sf::ext::metadata::JsonFsStamp;
 using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsTable;
+using sf::ext::metadata::JsonFsView;
+using sf::ext::metadata::JsonFsViewRef;
+using sf::ext::metadata::JsonFsWatchCallback;
+using sf::ext::metadata::JsonFsWatchList;
 
 
 static ProxyLogger logger("ext.metadata.store.jsonfs");
 
 
-JsonFsStore::JsonFsStore(std::string store) {
+//! Result of reading a store file, possibly on the I/O thread.
+struct JsonFsLoaded {
+  std::unique_ptr<JsonFsTable> cache;
+  std::shared_ptr<JsonFsSnapshot> snapshot;
+};
+
+//! Reads a store file without touching the store instance.
+/*!
+ * If a batch callback is given the keys are passed to it and
+ * are not added to the loaded table.
+ */
+static void read_store(
+    std::string path, JsonFsFormat format, JsonFsLoaded* loaded,
+    JsonFsLoader::BatchCallback batches = nullptr,
+    JsonFsLoadCallback progress = nullptr
+) {
+  std::ifstream source(path, std::ios::binary);
+  JsonFsFormat detected = JsonFsCodec::Detect(source);
+  source.close();
+
+  // Map indexed stores instead of parsing them.
+  if (format == JsonFsFormat::INDEXED && detected == JsonFsFormat::INDEXED) {
+    loaded->snapshot = std::make_shared<JsonFsSnapshot>(path);
+    loaded->cache.reset(new JsonFsTable());
+    return;
+  }
+
+  // Stream other files into the table, a key at a time.
+  loaded->cache.reset(new JsonFsTable());
+  JsonFsLoader loader(path);
+  if (batches) {
+    loader.load(batches);
+  } else {
+    loader.load(loaded->cache.get(), progress);
+  }
+}
+
+
+JsonFsStore::JsonFsStore(
+    std::string store, JsonFsFormat format, JsonFsIoThreadRef io, bool shared,
+    JsonFsCompression compression
+) {
+  if (shared && io) {
+    throw InvalidConfiguration("Shared JsonFS stores can't be async");
+  }
+  if (format == JsonFsFormat::INDEXED &&
+      compression != JsonFsCompression::NONE) {
+    throw InvalidConfiguration("Indexed JsonFS stores can't be compressed");
+  }
   this->store_ = store;
+  this->format_ = format;
+  this->compression_ = compression;
+  this->io_ = io;
+  this->loading_ = false;
+  this->commits_ = 0;
+  this->revision_ = 0;
+  if (shared) {
+    this->lock_ = std::make_shared<JsonFsRevisionLock>(store);
+  }
 }
 
 
+Promise JsonFsStore::io(std::function<void()> work) {
+  if (this->io_) {
+    return this->io_->submit(work);
+  }
+
+  // Without an I/O thread run the work now.
+  try {
+    work();
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
 Promise JsonFsStore::cache() {
-  // Create a promise to load the store file in cache.
-  Promise load_file([this]() {
-    this->cache_ = json::object();
-    std::ifstream source(this->store_);
+  if (this->lock_) {
+    try {
+      JsonFsRevisionGuard guard(this->lock_.get(), false);
+      this->sync();
+      return Promise().settle(nullptr);
+    } catch (...) {
+      return Promise().settle(std::current_exception());
+    }
+  }
+  if (this->cache_) {
+    return Promise().settle(nullptr);
+  }
+  if (this->loading_) {
+    return this->load_;
+  }
 
-    // If the store file is not empty load it.
-    if (source.peek() != std::ifstream::traits_type::eof()) {
-      source >> this->cache_;
+  // Read the file and install the result once loaded.
+  std::string path = this->store_;
+  JsonFsFormat format = this->format_;
+  JsonFsLoadCallback progress = this->progress_;
+  JsonFsLoader::BatchCallback batches;
+  auto loaded = std::make_shared<JsonFsLoaded>();
+  this->loading_ = true;
+
+  // With an I/O thread batches are passed to the loop as they
+  // are parsed so keys can be read before the load completes.
+  if (this->io_) {
+    JsonFsIoThreadRef io = this->io_;
+    progress = nullptr;
+    this->partial_.reset(new JsonFsTable());
+    batches = [this, io](
+        JsonFsLoader::Batch* batch, const JsonFsLoadProgress& progress
+    ) {
+      auto keys = std::make_shared<JsonFsLoader::Batch>(std::move(*batch));
+      io->post([this, keys, progress]() {
+        this->loadBatch(keys.get(), progress);
+      });
+    };
+  }
+
+  this->load_ = this->io([path, format, loaded, batches, progress]() {
+    read_store(path, format, loaded.get(), batches, progress);
+  }).then([this, loaded]() {
+    this->cache_ = std::move(loaded->cache);
+    if (this->partial_ && !loaded->snapshot) {
+      this->cache_ = std::move(this->partial_);
     }
-    return this->cache_;
+    this->partial_.reset();
+    this->snapshot_ = loaded->snapshot;
+    this->loading_ = false;
+    this->settleParked(nullptr);
+    return nullptr;
+  }, [this](const std::exception_ptr& error) {
+    this->partial_.reset();
+    this->loading_ = false;
+    this->settleParked(error);
+    std::rethrow_exception(error);
+    return nullptr;
   });
+  return this->load_;
+}
+
+void JsonFsStore::loadBatch(
+    JsonFsLoader::Batch* batch, const JsonFsLoadProgress& progress
+) {
+  for (auto& pair : *batch) {
+    this->partial_->set(pair.first, pair.second.data(), pair.second.size());
+  }
+
+  // Serve reads waiting for keys in this batch.
+  for (auto& pair : *batch) {
+    auto parked = this->parked_.equal_range(pair.first);
+    if (parked.first == parked.second) {
+      continue;
+    }
+    json value = this->partial_->get(pair.first);
+    for (auto it = parked.first; it != parked.second; ++it) {
+      it->second.settle(value);
+    }
+    this->parked_.erase(parked.first, parked.second);
+  }
+  if (this->progress_) {
+    this->progress_(progress);
+  }
+}
+
+void JsonFsStore::settleParked(std::exception_ptr error) {
+  std::multimap<std::string, Promise> parked;
+  parked.swap(this->parked_);
+  for (auto& pair : parked) {
+    if (error) {
+      pair.second.settle(error);
+    } else {
+      pair.second.settle(this->lookup(pair.first));
+    }
+  }
+}
+
+void JsonFsStore::sync() {
+  uint64_t revision = this->lock_->revision();
+  if (this->cache_ && revision == this->revision_) {
+    return;
+  }
+  JsonFsLoaded loaded;
+  read_store(this->store_, this->format_, &loaded);
+  this->replace(std::move(loaded.cache), loaded.snapshot);
+  this->revision_ = revision;
+}
 
-  // Return the cache if loaded or load from file.
-  return Promise().settle().then([this, load_file]() {
-    if (this->cache_.is_null()) {
-      return load_file.settle();
+void JsonFsStore::replace(
+    std::unique_ptr<JsonFsTable> cache, std::shared_ptr<JsonFsSnapshot> snapshot
+) {
+  // Differences are only needed if someone is watching or viewing.
+  bool views = this->pruneViews();
+  bool diff = this->cache_ && (!this->watches_.empty() || views);
+  size_t all = static_cast<size_t>(-1);
+  json before = diff ? this->collectRange("", true, "", all) : json();
+  this->cache_ = std::move(cache);
+  this->snapshot_ = snapshot;
+  this->erased_.clear();
+  this->stamp_ = JsonFsStamp::Of(this->store_);
+  if (!diff) {
+    return;
+  }
+
+  // Collect the differences, preserving old values for views.
+  json after = this->collectRange("", true, "", all);
+  json changes = json::object();
+  for (auto it = before.begin(); it != before.end(); ++it) {
+    if (after.find(it.key()) == after.end()) {
+      changes[it.key()] = nullptr;
+    }
+  }
+  for (auto it = after.begin(); it != after.end(); ++it) {
+    auto old = before.find(it.key());
+    if (old == before.end() || *old != it.value()) {
+      changes[it.key()] = it.value();
+    }
+  }
+  for (auto it = changes.begin(); it != changes.end() && views; ++it) {
+    auto old = before.find(it.key());
+    if (old == before.end()) {
+      this->preserveKey(it.key(), nullptr, 0);
+    } else {
+      std::vector<uint8_t> data = json::to_cbor(*old);
+      this->preserveKey(it.key(), data.data(), data.size());
     }
-    return Promise().settle(this->cache_);
+  }
+  if (this->watches_.empty()) {
+    return;
+  }
+
+  // Record differences as a commit that is already written.
+  JsonFsWatchList::ChangesRef recorded = this->watches_.begin();
+  for (auto it = changes.begin(); it != changes.end(); ++it) {
+    (*recorded)[it.key()] = it.value();
+  }
+  this->watches_.end(recorded, true);
+}
+
+Promise JsonFsStore::update(std::function<void()> change) {
+  if (!this->lock_) {
+    return this->cache().then([this, change]() {
+      change();
+      return this->commit();
+    });
+  }
+
+  // Shared stores settle commits before the lock is released.
+  try {
+    JsonFsRevisionGuard guard(this->lock_.get(), true);
+    this->sync();
+    change();
+    return this->commit();
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise JsonFsStore::commit() {
+  JsonFsWatchList::ChangesRef changes = this->watches_.begin();
+  return this->commitCache().then([this, changes]() {
+    if (this->lock_) {
+      this->revision_ += 1;
+      this->lock_->revision(this->revision_);
+    }
+    this->stamp_ = JsonFsStamp::Of(this->store_);
+    this->watches_.end(changes, true);
+    return nullptr;
+  }, [this, changes](const std::exception_ptr& error) {
+    this->watches_.end(changes, false);
+    std::rethrow_exception(error);
+    return nullptr;
+  });
+}
+
+Promise JsonFsStore::commitCache() {
+  if (this->format_ == JsonFsFormat::INDEXED) {
+    return this->commitSnapshot();
+  }
+
+  // Encode now so the I/O thread does not race with new changes.
+  // CBOR files are assembled from the encoded values in the table.
+  std::string path = this->store_;
+  auto content = std::make_shared<std::string>();
+  if (this->format_ == JsonFsFormat::CBOR) {
+    *content = this->cache_->toCbor();
+  } else {
+    *content = JsonFsCodec::Encode(this->cache_->toJson(), this->format_);
+  }
+  JsonFsCompression compression = this->compression_;
+  return this->io([path, content, compression]() {
+    JsonFsCodec::Write(path, *content, compression);
+  });
+}
+
+Promise JsonFsStore::commitSnapshot() {
+  auto writer = std::make_shared<JsonFsSnapshotWriter>();
+  size_t count = this->snapshot_ ? this->snapshot_->count() : 0;
+  size_t changes = this->cache_->count();
+  size_t index = 0;
+  size_t change = 0;
+
+  // Merge the snapshot and the changes, both sorted by key.
+  // Values are copied without decoding them.
+  if (this->snapshot_) {
+    writer->retain(this->snapshot_);
+  }
+  while (index < count || change < changes) {
+    std::string key;
+    std::string changed = change < changes ? this->cache_->key(change) : "";
+    bool from_snapshot = change == changes;
+    if (index < count) {
+      key = this->snapshot_->key(index);
+      from_snapshot = from_snapshot || key < changed;
+    }
+
+    if (from_snapshot) {
+      if (this->erased_.find(key) == this->erased_.end()) {
+        size_t size = 0;
+        const uint8_t* blob = this->snapshot_->blob(index, &size);
+        writer->add(key, blob, size);
+      }
+      index++;
+      continue;
+    }
+
+    // Changed values replace snapshot values with the same key.
+    // The table can change before the write so values are copied.
+    if (index < count && key == changed) {
+      index++;
+    }
+    size_t size = 0;
+    const uint8_t* blob = this->cache_->blob(change, &size);
+    writer->copy(changed, blob, size);
+    change++;
+  }
+
+  // Each commit includes all earlier changes so, once the last
+  // pending commit is written, every change is in the new file.
+  std::string path = this->store_;
+  this->commits_ += 1;
+  return this->io([writer, path]() {
+    writer->write(path);
+  }).then([this]() {
+    this->commits_ -= 1;
+    if (this->commits_ == 0) {
+      this->snapshot_ = std::make_shared<JsonFsSnapshot>(this->store_);
+      this->cache_.reset(new JsonFsTable());
+      this->erased_.clear();
+    }
+    return nullptr;
+  }, [this](const std::exception_ptr& error) {
+    this->commits_ -= 1;
+    std::rethrow_exception(error);
+    return nullptr;
   });
 }
 
-void JsonFsStore::commitCache() {
-  std::ofstream store(this->store_);
-  store << this->cache_;
-  store.close();
+json JsonFsStore::lookup(const std::string& key) const {
+  if (this->cache_->contains(key)) {
+    return this->cache_->get(key);
+  }
+  if (this->snapshot_ && this->erased_.find(key) == this->erased_.end()) {
+    return this->snapshot_->get(key);
+  }
+  return nullptr;
+}
+
+bool JsonFsStore::pruneViews() {
+  auto expired = [](const std::weak_ptr<JsonFsView>& view) {
+    return view.expired();
+  };
+  this->views_.erase(
+      std::remove_if(this->views_.begin(), this->views_.end(), expired),
+      this->views_.end()
+  );
+  return !this->views_.empty();
+}
+
+void JsonFsStore::preserveKey(
+    const std::string& key, const uint8_t* data, size_t size
+) {
+  for (auto& weak : this->views_) {
+    JsonFsViewRef view = weak.lock();
+    if (view) {
+      view->preserve(key, data, size);
+    }
+  }
+}
+
+void JsonFsStore::preserveCurrent(const std::string& key) {
+  if (!this->pruneViews()) {
+    return;
+  }
+  size_t size = 0;
+  const uint8_t* data = this->cache_->find(key, &size);
+  if (data == nullptr && this->snapshot_ &&
+      this->erased_.find(key) == this->erased_.end()) {
+    size_t index = this->snapshot_->find(key);
+    if (index < this->snapshot_->count()) {
+      data = this->snapshot_->blob(index, &size);
+    }
+  }
+  this->preserveKey(key, data, size);
+}
+
+void JsonFsStore::eraseKey(const std::string& key) {
+  this->preserveCurrent(key);
+  this->cache_->erase(key);
+  if (this->snapshot_) {
+    this->erased_.insert(key);
+  }
+  this->watches_.record(key, nullptr);
+}
+
+void JsonFsStore::setKey(const std::string& key, const json& value) {
+  this->preserveCurrent(key);
+  this->cache_->set(key, value);
+  this->erased_.erase(key);
+  this->watches_.record(key, value);
+}
+
+json JsonFsStore::collectRange(
+    const std::string& from, bool inclusive,
+    const std::string& end, size_t limit
+) const {
+  json result = json::object();
+  size_t changes = this->cache_->count();
+  size_t change = this->cache_->lowerBound(from);
+  if (!inclusive && change < changes && this->cache_->key(change) == from) {
+    change++;
+  }
+
+  // Position the snapshot at the same key.
+  size_t count = this->snapshot_ ? this->snapshot_->count() : 0;
+  size_t index = count;
+  if (this->snapshot_) {
+    index = this->snapshot_->lowerBound(from);
+    if (!inclusive && index < count && this->snapshot_->key(index) == from) {
+      index++;
+    }
+  }
+
+  // Merge the two ordered sequences until limit or end.
+  while (result.size() < limit && (index < count || change < changes)) {
+    std::string key;
+    std::string changed = change < changes ? this->cache_->key(change) : "";
+    bool from_snapshot = change == changes;
+    if (index < count) {
+      key = this->snapshot_->key(index);
+      from_snapshot = from_snapshot || key < changed;
+    }
+    if (!from_snapshot) {
+      key = changed;
+    }
+    if (!end.empty() && key >= end) {
+      break;
+    }
+
+    if (!from_snapshot) {
+      if (index < count && this->snapshot_->key(index) == key) {
+        index++;
+      }
+      result[key] = this->cache_->value(change);
+      change++;
+    } else {
+      if (this->erased_.find(key) == this->erased_.end()) {
+        result[key] = this->snapshot_->value(index);
+      }
+      index++;
+    }
+  }
+  return result;
 }
 
 
+std::string JsonFsStore::path() const {
+  return this->store_;
+}
+
+Promise JsonFsStore::load() {
+  return this->cache();
+}
+
+Promise JsonFsStore::refresh() {
+  if (this->lock_) {
+    return this->cache();
+  }
+
+  // Stores that are not loaded will read the new file when they are.
+  if (!this->cache_ || this->watches_.busy()) {
+    return Promise().settle(nullptr);
+  }
+  if (JsonFsStamp::Of(this->store_) == this->stamp_) {
+    return Promise().settle(nullptr);
+  }
+
+  std::string path = this->store_;
+  JsonFsFormat format = this->format_;
+  auto loaded = std::make_shared<JsonFsLoaded>();
+  return this->io([path, format, loaded]() {
+    read_store(path, format, loaded.get());
+  }).then([this, loaded]() {
+    // A local commit started in the meantime and replaces the file.
+    if (!this->watches_.busy()) {
+      this->replace(std::move(loaded->cache), loaded->snapshot);
+    }
+    return nullptr;
+  });
+}
+
 Promise JsonFsStore::erase(std::string key) {
-  return this->cache().then([this, key]() {
+  return this->update([this, key]() {
     // Remove the key from the cache.
-    this->cache_.erase(key);
-    this->commitCache();
-    return nullptr;
+    this->eraseKey(key);
   });
 }
 
 Promise JsonFsStore::get(std::string key) {
-  return this->cache().then([key](json store) {
-    return store[key];
+  Promise load = this->cache();
+
+  // Keys already parsed are served while the load continues.
+  if (this->loading_ && this->partial_) {
+    if (this->partial_->contains(key)) {
+      return Promise().settle(this->partial_->get(key));
+    }
+    Promise parked;
+    this->parked_.insert(std::make_pair(key, parked));
+    return parked;
+  }
+  return load.then([this, key]() {
+    return this->lookup(key);
   });
 }
 
 Promise JsonFsStore::set(std::string key, json value) {
-  return this->cache().then([this, key, value]() {
+  return this->update([this, key, value]() {
     // Add value to the store and write the cache back to disk.
-    this->cache_[key] = value;
-    this->commitCache();
-    return nullptr;
+    this->setKey(key, value);
   });
 }
 
@@ -84,3 +595,79 @@ Promise JsonFsStore::set(
   WARNING(logger, "JSONFS metadata store does not support TTL");
   return this->set(key, value);
 }
+
+
+Promise JsonFsStore::eraseMany(std::vector<std::string> keys) {
+  return this->update([this, keys]() {
+    for (auto& key : keys) {
+      this->eraseKey(key);
+    }
+  });
+}
+
+Promise JsonFsStore::getMany(std::vector<std::string> keys) {
+  return this->cache().then([this, keys]() {
+    json values = json::object();
+    for (auto& key : keys) {
+      values[key] = this->lookup(key);
+    }
+    return values;
+  });
+}
+
+Promise JsonFsStore::setMany(std::map<std::string, json> values) {
+  return this->update([this, values]() {
+    for (auto& pair : values) {
+      this->setKey(pair.first, pair.second);
+    }
+  });
+}
+
+JsonFsScanRef JsonFsStore::scan(std::string prefix, size_t batch) {
+  return this->scan(prefix, JsonFsScan::PrefixEnd(prefix), batch);
+}
+
+Promise JsonFsStore::range(
+    std::string from, bool inclusive, std::string end, size_t limit
+) {
+  return this->cache().then([this, from, inclusive, end, limit]() {
+    return this->collectRange(from, inclusive, end, limit);
+  });
+}
+
+JsonFsScanRef JsonFsStore::scan(
+    std::string begin, std::string end, size_t batch
+) {
+  JsonFsScan::Fetch fetch = [this](
+      const std::string& from, bool inclusive,
+      const std::string& end, size_t limit
+  ) {
+    return this->range(from, inclusive, end, limit);
+  };
+  return std::make_shared<JsonFsScan>(fetch, begin, end, batch);
+}
+
+JsonFsViewRef JsonFsStore::view() {
+  JsonFsViewRef view = std::make_shared<JsonFsView>(this);
+  this->pruneViews();
+  this->views_.push_back(view);
+  return view;
+}
+
+uint64_t JsonFsStore::watch(std::string key, JsonFsWatchCallback callback) {
+  return this->watches_.add(key, false, callback);
+}
+
+uint64_t JsonFsStore::watchPrefix(
+    std::string prefix, JsonFsWatchCallback callback
+) {
+  return this->watches_.add(prefix, true, callback);
+}
+
+void JsonFsStore::unwatch(uint64_t id) {
+  this->watches_.remove(id);
+}
+
+void JsonFsStore::loadProgress(JsonFsLoadCallback callback) {
+  this->progress_ = callback;
+}
@@ -0,0 +1,257 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/loader.h"
+
+#include <istream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "core/exceptions/configuration.h"
+#include "ext/metadata/store/jsonfs/compress.h"
+#include "ext/metadata/store/jsonfs/exceptions.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/snapshot.h"
+
+
+using nlohmann::json;
+
+using sf::core::exception::InvalidConfiguration;
+using sf::ext::exception::JsonFsCorruptStore;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsInputFile;
+using sf::ext::metadata::JsonFsLoadCallback;
+using sf::ext::metadata::JsonFsLoadProgress;
+using sf::ext::metadata::JsonFsLoader;
+using sf::ext::metadata::JsonFsSnapshot;
+using sf::ext::metadata::JsonFsTable;
+
+
+//! SAX handler that encodes top-level values as they complete.
+/*!
+ * Values nested in a top-level value are built as a JSON tree
+ * (with `stack_` pointing at the open containers) and released
+ * once the top-level value is encoded.
+ */
+class JsonFsSaxHandler : public json::json_sax_t {
+ protected:
+  std::string path_;
+  size_t depth_;
+  std::string key_;
+  std::string nested_key_;
+  json value_;
+  std::vector<json*> stack_;
+  std::function<void(std::string key, std::vector<uint8_t> value)> emit_;
+
+  //! Adds a scalar to the open container or emits it.
+  bool add(json value) {
+    if (this->depth_ == 0) {
+      throw JsonFsCorruptStore(this->path_ + ": not an object");
+    }
+    if (this->stack_.empty()) {
+      this->emit_(this->key_, json::to_cbor(value));
+      return true;
+    }
+    json* top = this->stack_.back();
+    if (top->is_object()) {
+      (*top)[this->nested_key_] = std::move(value);
+    } else {
+      top->push_back(std::move(value));
+    }
+    return true;
+  }
+
+  //! Opens a container in the value being built.
+  bool open(json container) {
+    if (this->depth_ == 0 && !container.is_object()) {
+      throw JsonFsCorruptStore(this->path_ + ": not an object");
+    }
+    this->depth_ += 1;
+    if (this->depth_ == 1) {
+      return true;
+    }
+    if (this->stack_.empty()) {
+      this->value_ = std::move(container);
+      this->stack_.push_back(&this->value_);
+      return true;
+    }
+
+    json* top = this->stack_.back();
+    if (top->is_object()) {
+      json& child = (*top)[this->nested_key_];
+      child = std::move(container);
+      this->stack_.push_back(&child);
+    } else {
+      top->push_back(std::move(container));
+      this->stack_.push_back(&top->back());
+    }
+    return true;
+  }
+
+  //! Closes a container, emitting completed top-level values.
+  bool close() {
+    this->depth_ -= 1;
+    if (this->stack_.empty()) {
+      return true;
+    }
+    this->stack_.pop_back();
+    if (this->stack_.empty()) {
+      this->emit_(this->key_, json::to_cbor(this->value_));
+      this->value_ = nullptr;
+    }
+    return true;
+  }
+
+ public:
+  JsonFsSaxHandler(
+      std::string path,
+      std::function<void(std::string, std::vector<uint8_t>)> emit
+  ) {
+    this->path_ = path;
+    this->depth_ = 0;
+    this->emit_ = emit;
+  }
+
+  bool null() {
+    return this->add(nullptr);
+  }
+
+  bool boolean(bool value) {
+    return this->add(value);
+  }
+
+  bool number_integer(number_integer_t value) {
+    return this->add(value);
+  }
+
+  bool number_unsigned(number_unsigned_t value) {
+    return this->add(value);
+  }
+
+  bool number_float(number_float_t value, const string_t&) {
+    return this->add(value);
+  }
+
+  bool string(string_t& value) {  // NOLINT(runtime/references)
+    return this->add(std::move(value));
+  }
+
+  bool binary(binary_t& value) {  // NOLINT(runtime/references)
+    return this->add(json::binary(std::move(value)));
+  }
+
+  bool start_object(std::size_t) {
+    return this->open(json::object());
+  }
+
+  bool key(string_t& value) {  // NOLINT(runtime/references)
+    if (this->depth_ == 1) {
+      this->key_ = std::move(value);
+    } else {
+      this->nested_key_ = std::move(value);
+    }
+    return true;
+  }
+
+  bool end_object() {
+    return this->close();
+  }
+
+  bool start_array(std::size_t) {
+    return this->open(json::array());
+  }
+
+  bool end_array() {
+    return this->close();
+  }
+
+  bool parse_error(
+      std::size_t, const std::string&,
+      const nlohmann::detail::exception& ex
+  ) {
+    throw JsonFsCorruptStore(this->path_ + ": " + ex.what());
+  }
+};
+
+
+JsonFsLoader::JsonFsLoader(std::string path, size_t batch_size) {
+  this->path_ = path;
+  this->batch_size_ = batch_size > 0 ? batch_size : 1;
+}
+
+void JsonFsLoader::load(BatchCallback callback) {
+  JsonFsInputFile file(this->path_);
+  std::istream& source = file.stream();
+  JsonFsLoadProgress progress = {0, 0, file.size()};
+  JsonFsFormat format = JsonFsCodec::Detect(source);
+
+  // Missing and empty files are empty stores.
+  if (source.peek() == std::istream::traits_type::eof()) {
+    return;
+  }
+
+  Batch batch;
+  batch.reserve(this->batch_size_);
+  auto flush = [&batch, &progress, &callback](size_t bytes) {
+    progress.keys += batch.size();
+    progress.bytes = bytes;
+    callback(&batch, progress);
+    batch.clear();
+  };
+
+  // Snapshots are already encoded.
+  if (format == JsonFsFormat::INDEXED) {
+    if (file.compression() != JsonFsCompression::NONE) {
+      throw InvalidConfiguration(
+          "Indexed JsonFS store '" + this->path_ + "' can't be compressed"
+      );
+    }
+    JsonFsSnapshot snapshot(this->path_);
+    for (size_t index = 0; index < snapshot.count(); index++) {
+      size_t size = 0;
+      const uint8_t* blob = snapshot.blob(index, &size);
+      batch.emplace_back(
+          snapshot.key(index), std::vector<uint8_t>(blob, blob + size)
+      );
+      if (batch.size() == this->batch_size_) {
+        flush(progress.total * (index + 1) / snapshot.count());
+      }
+    }
+    flush(progress.total);
+    return;
+  }
+
+  size_t batch_size = this->batch_size_;
+  JsonFsSaxHandler handler(this->path_, [&](
+      std::string key, std::vector<uint8_t> value
+  ) {
+    batch.emplace_back(std::move(key), std::move(value));
+    if (batch.size() == batch_size) {
+      flush(file.position());
+    }
+  });
+
+  json::input_format_t input = json::input_format_t::json;
+  if (format == JsonFsFormat::CBOR) {
+    input = json::input_format_t::cbor;
+  } else if (format == JsonFsFormat::MSGPACK) {
+    input = json::input_format_t::msgpack;
+  }
+  json::sax_parse(source, &handler, input);
+  flush(progress.total);
+}
+
+void JsonFsLoader::load(JsonFsTable* table, JsonFsLoadCallback progress) {
+  this->load([table, progress](
+      Batch* batch, const JsonFsLoadProgress& loaded
+  ) {
+    for (auto& pair : *batch) {
+      table->set(pair.first, pair.second.data(), pair.second.size());
+    }
+    if (progress) {
+      progress(loaded);
+    }
+  });
+}
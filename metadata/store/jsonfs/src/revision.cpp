@@ -0,0 +1,79 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/revision.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "core/exceptions/base.h"
+
+
+using sf::core::exception::ErrNoException;
+
+using sf::ext::metadata::JsonFsRevisionGuard;
+using sf::ext::metadata::JsonFsRevisionLock;
+
+
+std::string JsonFsRevisionLock::LockPath(std::string store) {
+  return store + ".lock";
+}
+
+JsonFsRevisionLock::JsonFsRevisionLock(std::string store) {
+  this->path_ = JsonFsRevisionLock::LockPath(store);
+  this->fd_ = ::open(this->path_.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+  if (this->fd_ < 0) {
+    throw ErrNoException("Unable to open JsonFS lock " + this->path_);
+  }
+}
+
+JsonFsRevisionLock::~JsonFsRevisionLock() {
+  ::close(this->fd_);
+}
+
+void JsonFsRevisionLock::lock(bool exclusive) {
+  int operation = exclusive ? LOCK_EX : LOCK_SH;
+  while (flock(this->fd_, operation) < 0) {
+    if (errno != EINTR) {
+      throw ErrNoException("Unable to lock " + this->path_);
+    }
+  }
+}
+
+void JsonFsRevisionLock::unlock() {
+  flock(this->fd_, LOCK_UN);
+}
+
+uint64_t JsonFsRevisionLock::revision() {
+  uint64_t revision = 0;
+  ssize_t size = ::pread(this->fd_, &revision, sizeof(revision), 0);
+  if (size < 0) {
+    throw ErrNoException("Unable to read revision from " + this->path_);
+  }
+  if (size != sizeof(revision)) {
+    return 0;
+  }
+  return revision;
+}
+
+void JsonFsRevisionLock::revision(uint64_t revision) {
+  ssize_t size = ::pwrite(this->fd_, &revision, sizeof(revision), 0);
+  if (size != sizeof(revision)) {
+    throw ErrNoException("Unable to write revision to " + this->path_);
+  }
+}
+
+
+JsonFsRevisionGuard::JsonFsRevisionGuard(
+    JsonFsRevisionLock* lock, bool exclusive
+) {
+  this->lock_ = lock;
+  this->lock_->lock(exclusive);
+}
+
+JsonFsRevisionGuard::~JsonFsRevisionGuard() {
+  this->lock_->unlock();
+}
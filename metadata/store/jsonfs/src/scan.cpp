@@ -0,0 +1,59 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/scan.h"
+
+#include <string>
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsScan;
+
+
+std::string JsonFsScan::PrefixEnd(std::string prefix) {
+  // Increment the last byte that can be incremented.
+  while (!prefix.empty()) {
+    unsigned char last = prefix.back();
+    prefix.pop_back();
+    if (last != 0xff) {
+      prefix.push_back(static_cast<char>(last + 1));
+      return prefix;
+    }
+  }
+  return "";
+}
+
+
+JsonFsScan::JsonFsScan(
+    Fetch fetch, std::string begin, std::string end, size_t batch
+) {
+  this->fetch_ = fetch;
+  this->from_ = begin;
+  this->inclusive_ = true;
+  this->end_ = end;
+  this->batch_ = batch > 0 ? batch : 1;
+  this->done_ = false;
+}
+
+bool JsonFsScan::done() const {
+  return this->done_;
+}
+
+Promise JsonFsScan::next() {
+  if (this->done_) {
+    return Promise().settle(json::object());
+  }
+
+  return this->fetch_(
+      this->from_, this->inclusive_, this->end_, this->batch_
+  ).then([this](json batch) {
+    // A short batch means the range is exhausted.
+    if (batch.size() < this->batch_) {
+      this->done_ = true;
+    } else {
+      this->from_ = (--batch.end()).key();
+      this->inclusive_ = false;
+    }
+    return batch;
+  });
+}
@@ -0,0 +1,192 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/sharded.h"
+
+#include <pthread.h>
+
+#include <exception>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsScan;
+using sf::ext::metadata::JsonFsScanRef;
+using sf::ext::metadata::JsonFsShardedStore;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsTable;
+
+
+JsonFsShardedStore::Shard* JsonFsShardedStore::shard(const std::string& key) {
+  uint64_t index = JsonFsShardedStore::Hash(key) % this->shards_.size();
+  return this->shards_[index].get();
+}
+
+Promise JsonFsShardedStore::readShard(
+    Shard* shard, std::function<Promise(JsonFsStore*)> operation
+) {
+  // Shared reads can replace the cache and unlock the flock
+  // of other readers (it belongs to the shard's one descriptor).
+  if (this->shared_) {
+    return this->writeShard(shard, operation);
+  }
+
+  // Files are loaded on first access so that needs an exclusive lock.
+  if (!shard->loaded) {
+    return this->writeShard(shard, [shard, operation](JsonFsStore* store) {
+      return store->load().then([shard, operation, store]() {
+        shard->loaded = true;
+        return operation(store);
+      });
+    });
+  }
+
+  pthread_rwlock_rdlock(&shard->lock);
+  try {
+    Promise result = operation(shard->store.get());
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+  } catch (...) {
+    pthread_rwlock_unlock(&shard->lock);
+    throw;
+  }
+}
+
+Promise JsonFsShardedStore::writeShard(
+    Shard* shard, std::function<Promise(JsonFsStore*)> operation
+) {
+  pthread_rwlock_wrlock(&shard->lock);
+  try {
+    Promise result = operation(shard->store.get());
+    pthread_rwlock_unlock(&shard->lock);
+    return result;
+  } catch (...) {
+    pthread_rwlock_unlock(&shard->lock);
+    throw;
+  }
+}
+
+Promise JsonFsShardedStore::read(
+    const std::string& key, std::function<Promise(JsonFsStore*)> operation
+) {
+  return this->readShard(this->shard(key), operation);
+}
+
+Promise JsonFsShardedStore::write(
+    const std::string& key, std::function<Promise(JsonFsStore*)> operation
+) {
+  return this->writeShard(this->shard(key), operation);
+}
+
+
+uint64_t JsonFsShardedStore::Hash(const std::string& key) {
+  // Keys must map to the same file forever.
+  return JsonFsTable::Hash(key);
+}
+
+std::string JsonFsShardedStore::ShardPath(std::string store, size_t index) {
+  return store + "." + std::to_string(index);
+}
+
+
+JsonFsShardedStore::JsonFsShardedStore(
+    std::string store, size_t shards, JsonFsFormat format, bool shared,
+    JsonFsCompression compression
+) {
+  this->shared_ = shared;
+  for (size_t index = 0; index < shards; index++) {
+    std::unique_ptr<Shard> shard(new Shard());
+    shard->store = std::make_shared<JsonFsStore>(
+        JsonFsShardedStore::ShardPath(store, index), format,
+        JsonFsIoThreadRef(), shared, compression
+    );
+    shard->loaded = false;
+    pthread_rwlock_init(&shard->lock, nullptr);
+    this->shards_.push_back(std::move(shard));
+  }
+}
+
+JsonFsShardedStore::~JsonFsShardedStore() {
+  for (auto& shard : this->shards_) {
+    pthread_rwlock_destroy(&shard->lock);
+  }
+}
+
+
+Promise JsonFsShardedStore::erase(std::string key) {
+  return this->write(key, [key](JsonFsStore* store) {
+    return store->erase(key);
+  });
+}
+
+Promise JsonFsShardedStore::get(std::string key) {
+  return this->read(key, [key](JsonFsStore* store) {
+    return store->get(key);
+  });
+}
+
+Promise JsonFsShardedStore::set(std::string key, json value) {
+  return this->write(key, [key, value](JsonFsStore* store) {
+    return store->set(key, value);
+  });
+}
+
+Promise JsonFsShardedStore::set(
+    std::string key, json value,
+    std::chrono::duration<int> ttl
+) {
+  return this->write(key, [key, value, ttl](JsonFsStore* store) {
+    return store->set(key, value, ttl);
+  });
+}
+
+JsonFsScanRef JsonFsShardedStore::scan(std::string prefix, size_t batch) {
+  return this->scan(prefix, JsonFsScan::PrefixEnd(prefix), batch);
+}
+
+JsonFsScanRef JsonFsShardedStore::scan(
+    std::string begin, std::string end, size_t batch
+) {
+  JsonFsScan::Fetch fetch = [this](
+      const std::string& from, bool inclusive,
+      const std::string& end, size_t limit
+  ) {
+    // Shards settle synchronously so results can be merged in place.
+    std::shared_ptr<json> merged = std::make_shared<json>(json::object());
+    std::shared_ptr<std::exception_ptr> error =
+        std::make_shared<std::exception_ptr>();
+    for (auto& shard : this->shards_) {
+      this->readShard(shard.get(), [=](JsonFsStore* store) {
+        return store->range(from, inclusive, end, limit).then(
+            [merged](json keys) {
+              merged->update(keys);
+            }
+        ).except([error](const std::exception_ptr& ex) {
+          *error = ex;
+        });
+      });
+    }
+    if (*error) {
+      return Promise().settle(*error);
+    }
+
+    // Keep the first limit keys: the rest are in the next batch.
+    json result = json::object();
+    for (auto it = merged->begin(); it != merged->end(); ++it) {
+      if (result.size() == limit) {
+        break;
+      }
+      result[it.key()] = it.value();
+    }
+    return Promise().settle(result);
+  };
+  return std::make_shared<JsonFsScan>(fetch, begin, end, batch);
+}
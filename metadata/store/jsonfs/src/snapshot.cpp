@@ -0,0 +1,266 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/snapshot.h"
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "core/exceptions/base.h"
+#include "ext/metadata/store/jsonfs/exceptions.h"
+
+
+using nlohmann::json;
+
+using sf::core::exception::ErrNoException;
+using sf::ext::exception::JsonFsCorruptStore;
+
+using sf::ext::metadata::JsonFsSnapshot;
+using sf::ext::metadata::JsonFsSnapshotWriter;
+
+
+static const size_t HEADER_SIZE = 16;
+
+
+const char JsonFsSnapshot::MAGIC[4] = {'S', 'F', 'J', 'I'};
+const uint32_t JsonFsSnapshot::VERSION = 1;
+
+
+const JsonFsSnapshot::Entry* JsonFsSnapshot::entry(size_t index) const {
+  const Entry* entry = this->directory_ + index;
+  if (entry->key_offset + entry->key_size > this->size_ ||
+      entry->value_offset + entry->value_size > this->size_) {
+    throw JsonFsCorruptStore(this->path_);
+  }
+  return entry;
+}
+
+int JsonFsSnapshot::compare(size_t index, const std::string& key) const {
+  const Entry* entry = this->entry(index);
+  size_t common = std::min(static_cast<size_t>(entry->key_size), key.size());
+  int result = memcmp(this->data_ + entry->key_offset, key.data(), common);
+  if (result != 0) {
+    return result;
+  }
+  if (entry->key_size == key.size()) {
+    return 0;
+  }
+  return entry->key_size < key.size() ? -1 : 1;
+}
+
+
+JsonFsSnapshot::JsonFsSnapshot(std::string path) {
+  this->path_ = path;
+  this->data_ = nullptr;
+  this->size_ = 0;
+  this->count_ = 0;
+  this->directory_ = nullptr;
+
+  int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    throw ErrNoException("Unable to open JsonFS snapshot");
+  }
+
+  struct stat stats;
+  if (fstat(fd, &stats) < 0) {
+    ::close(fd);
+    throw ErrNoException("Unable to stat JsonFS snapshot");
+  }
+
+  // Empty files are empty snapshots.
+  this->size_ = stats.st_size;
+  if (this->size_ == 0) {
+    ::close(fd);
+    return;
+  }
+
+  void* data = mmap(nullptr, this->size_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    this->size_ = 0;
+    throw ErrNoException("Unable to map JsonFS snapshot");
+  }
+  this->data_ = static_cast<const uint8_t*>(data);
+
+  // Validate the header and the size of the directory.
+  uint32_t version = 0;
+  if (this->size_ >= HEADER_SIZE) {
+    memcpy(&version, this->data_ + 4, sizeof(version));
+    memcpy(&this->count_, this->data_ + 8, sizeof(this->count_));
+  }
+  if (this->size_ < HEADER_SIZE ||
+      memcmp(this->data_, JsonFsSnapshot::MAGIC, 4) != 0 ||
+      version != JsonFsSnapshot::VERSION ||
+      this->count_ > (this->size_ - HEADER_SIZE) / sizeof(Entry)) {
+    munmap(const_cast<uint8_t*>(this->data_), this->size_);
+    throw JsonFsCorruptStore(path);
+  }
+  this->directory_ = reinterpret_cast<const Entry*>(
+      this->data_ + HEADER_SIZE
+  );
+}
+
+JsonFsSnapshot::~JsonFsSnapshot() {
+  if (this->data_) {
+    munmap(const_cast<uint8_t*>(this->data_), this->size_);
+  }
+}
+
+
+size_t JsonFsSnapshot::count() const {
+  return this->count_;
+}
+
+size_t JsonFsSnapshot::find(const std::string& key) const {
+  size_t index = this->lowerBound(key);
+  if (index < this->count_ && this->compare(index, key) == 0) {
+    return index;
+  }
+  return this->count_;
+}
+
+size_t JsonFsSnapshot::lowerBound(const std::string& key) const {
+  size_t first = 0;
+  size_t last = this->count_;
+  while (first < last) {
+    size_t middle = first + (last - first) / 2;
+    if (this->compare(middle, key) < 0) {
+      first = middle + 1;
+    } else {
+      last = middle;
+    }
+  }
+  return first;
+}
+
+std::string JsonFsSnapshot::key(size_t index) const {
+  const Entry* entry = this->entry(index);
+  return std::string(
+      reinterpret_cast<const char*>(this->data_ + entry->key_offset),
+      entry->key_size
+  );
+}
+
+const uint8_t* JsonFsSnapshot::blob(size_t index, size_t* size) const {
+  const Entry* entry = this->entry(index);
+  *size = entry->value_size;
+  return this->data_ + entry->value_offset;
+}
+
+json JsonFsSnapshot::value(size_t index) const {
+  size_t size = 0;
+  const uint8_t* data = this->blob(index, &size);
+  return json::from_cbor(std::vector<uint8_t>(data, data + size));
+}
+
+json JsonFsSnapshot::get(const std::string& key) const {
+  size_t index = this->find(key);
+  if (index == this->count_) {
+    return nullptr;
+  }
+  return this->value(index);
+}
+
+json JsonFsSnapshot::toJson() const {
+  json data = json::object();
+  for (size_t index = 0; index < this->count_; index++) {
+    data[this->key(index)] = this->value(index);
+  }
+  return data;
+}
+
+
+void JsonFsSnapshotWriter::retain(std::shared_ptr<JsonFsSnapshot> snapshot) {
+  this->sources_.push_back(snapshot);
+}
+
+void JsonFsSnapshotWriter::add(
+    std::string key, const uint8_t* data, size_t size
+) {
+  Entry entry;
+  entry.key = key;
+  entry.data = data;
+  entry.size = size;
+  this->entries_.push_back(std::move(entry));
+}
+
+void JsonFsSnapshotWriter::copy(
+    std::string key, const uint8_t* data, size_t size
+) {
+  Entry entry;
+  entry.key = key;
+  entry.owned.assign(data, data + size);
+  entry.data = entry.owned.data();
+  entry.size = entry.owned.size();
+  this->entries_.push_back(std::move(entry));
+}
+
+void JsonFsSnapshotWriter::add(std::string key, const json& value) {
+  Entry entry;
+  entry.key = key;
+  entry.owned = json::to_cbor(value);
+  entry.data = entry.owned.data();
+  entry.size = entry.owned.size();
+  this->entries_.push_back(std::move(entry));
+}
+
+void JsonFsSnapshotWriter::write(std::string path) {
+  uint64_t count = this->entries_.size();
+  uint64_t keys_offset = HEADER_SIZE + count * sizeof(JsonFsSnapshot::Entry);
+  uint64_t values_offset = keys_offset;
+  for (auto& entry : this->entries_) {
+    values_offset += entry.key.size();
+  }
+
+  // Build the directory.
+  std::vector<JsonFsSnapshot::Entry> directory;
+  directory.reserve(count);
+  uint64_t key_offset = keys_offset;
+  uint64_t value_offset = values_offset;
+  for (auto& entry : this->entries_) {
+    JsonFsSnapshot::Entry item;
+    item.key_offset = key_offset;
+    item.key_size = entry.key.size();
+    item.value_size = entry.size;
+    item.value_offset = value_offset;
+    directory.push_back(item);
+    key_offset += entry.key.size();
+    value_offset += entry.size;
+  }
+
+  // Write everything to a temporary file.
+  std::string temp = path + ".tmp";
+  std::ofstream file(temp, std::ios::binary | std::ios::trunc);
+  file.write(JsonFsSnapshot::MAGIC, 4);
+  file.write(
+      reinterpret_cast<const char*>(&JsonFsSnapshot::VERSION),
+      sizeof(JsonFsSnapshot::VERSION)
+  );
+  file.write(reinterpret_cast<const char*>(&count), sizeof(count));
+  file.write(
+      reinterpret_cast<const char*>(directory.data()),
+      directory.size() * sizeof(JsonFsSnapshot::Entry)
+  );
+  for (auto& entry : this->entries_) {
+    file.write(entry.key.data(), entry.key.size());
+  }
+  for (auto& entry : this->entries_) {
+    file.write(reinterpret_cast<const char*>(entry.data), entry.size);
+  }
+  file.close();
+  if (!file) {
+    throw ErrNoException("Unable to write JsonFS snapshot");
+  }
+
+  // Replace the old snapshot.
+  if (rename(temp.c_str(), path.c_str()) < 0) {
+    throw ErrNoException("Unable to replace JsonFS snapshot");
+  }
+}
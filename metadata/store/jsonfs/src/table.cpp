@@ -0,0 +1,368 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/table.h"
+
+#include <string.h>
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+using nlohmann::json;
+
+using sf::ext::metadata::JsonFsTable;
+
+
+//! Maximum load of the hash index, in tenths.
+static const size_t MAX_LOAD = 7;
+
+//! Arenas smaller than this are never compacted.
+static const size_t MIN_COMPACT = 4096;
+
+
+//! Appends a CBOR head (major type and argument) to the buffer.
+static void cbor_head(std::string* buffer, uint8_t major, uint64_t value) {
+  major = major << 5;
+  if (value < 24) {
+    buffer->push_back(static_cast<char>(major | value));
+    return;
+  }
+
+  int bytes = 8;
+  uint8_t info = 27;
+  if (value <= 0xff) {
+    bytes = 1;
+    info = 24;
+  } else if (value <= 0xffff) {
+    bytes = 2;
+    info = 25;
+  } else if (value <= 0xffffffff) {
+    bytes = 4;
+    info = 26;
+  }
+  buffer->push_back(static_cast<char>(major | info));
+  for (int shift = (bytes - 1) * 8; shift >= 0; shift -= 8) {
+    buffer->push_back(static_cast<char>((value >> shift) & 0xff));
+  }
+}
+
+
+const uint32_t JsonFsTable::EMPTY = 0;
+const uint32_t JsonFsTable::TOMBSTONE = UINT32_MAX;
+
+
+int JsonFsTable::compare(
+    uint32_t id, const uint8_t* key, size_t size
+) const {
+  const Entry& entry = this->entries_[id];
+  size_t common = std::min(static_cast<size_t>(entry.key_size), size);
+  int result = memcmp(this->arena_.data() + entry.key_offset, key, common);
+  if (result != 0) {
+    return result;
+  }
+  if (entry.key_size == size) {
+    return 0;
+  }
+  return entry.key_size < size ? -1 : 1;
+}
+
+int JsonFsTable::compare(uint32_t id, const std::string& key) const {
+  return this->compare(
+      id, reinterpret_cast<const uint8_t*>(key.data()), key.size()
+  );
+}
+
+void JsonFsTable::sort() const {
+  if (this->sorted_ == this->order_.size()) {
+    return;
+  }
+  std::lock_guard<std::mutex> guard(this->sort_lock_);
+  size_t sorted = this->sorted_;
+  if (sorted == this->order_.size()) {
+    return;
+  }
+
+  // Sort the new keys and merge them with the sorted ones.
+  auto less = [this](uint32_t left, uint32_t right) {
+    const Entry& entry = this->entries_[right];
+    return this->compare(
+        left, this->arena_.data() + entry.key_offset, entry.key_size
+    ) < 0;
+  };
+  auto middle = this->order_.begin() + sorted;
+  std::sort(middle, this->order_.end(), less);
+  std::inplace_merge(this->order_.begin(), middle, this->order_.end(), less);
+  this->sorted_ = this->order_.size();
+}
+
+size_t JsonFsTable::lookup(const std::string& key) const {
+  size_t mask = this->slots_.size() - 1;
+  size_t index = JsonFsTable::Hash(key) & mask;
+  while (true) {
+    uint32_t slot = this->slots_[index];
+    if (slot == JsonFsTable::EMPTY) {
+      return this->slots_.size();
+    }
+    if (slot != JsonFsTable::TOMBSTONE && this->compare(slot - 1, key) == 0) {
+      return index;
+    }
+    index = (index + 1) & mask;
+  }
+}
+
+size_t JsonFsTable::position(const std::string& key) const {
+  this->sort();
+  auto found = std::lower_bound(
+      this->order_.begin(), this->order_.end(), key,
+      [this](uint32_t id, const std::string& key) {
+        return this->compare(id, key) < 0;
+      }
+  );
+  return found - this->order_.begin();
+}
+
+uint64_t JsonFsTable::append(const uint8_t* data, size_t size) {
+  uint64_t offset = this->arena_.size();
+  this->arena_.insert(this->arena_.end(), data, data + size);
+  return offset;
+}
+
+void JsonFsTable::rehash(size_t count) {
+  size_t capacity = 16;
+  while (capacity * MAX_LOAD < count * 10 * 2) {
+    capacity *= 2;
+  }
+
+  // Re-inserting live entries also drops all tombstones.
+  this->slots_.assign(capacity, JsonFsTable::EMPTY);
+  size_t mask = capacity - 1;
+  for (uint32_t id : this->order_) {
+    const Entry& entry = this->entries_[id];
+    std::string key(
+        reinterpret_cast<const char*>(this->arena_.data() + entry.key_offset),
+        entry.key_size
+    );
+    size_t index = JsonFsTable::Hash(key) & mask;
+    while (this->slots_[index] != JsonFsTable::EMPTY) {
+      index = (index + 1) & mask;
+    }
+    this->slots_[index] = id + 1;
+  }
+  this->used_slots_ = this->order_.size();
+}
+
+void JsonFsTable::compact() {
+  std::vector<uint8_t> arena;
+  arena.reserve(this->arena_.size() - this->garbage_);
+  for (uint32_t id : this->order_) {
+    Entry& entry = this->entries_[id];
+    const uint8_t* key = this->arena_.data() + entry.key_offset;
+    const uint8_t* value = this->arena_.data() + entry.value_offset;
+    entry.key_offset = arena.size();
+    arena.insert(arena.end(), key, key + entry.key_size);
+    entry.value_offset = arena.size();
+    arena.insert(arena.end(), value, value + entry.value_size);
+  }
+  this->arena_.swap(arena);
+  this->garbage_ = 0;
+}
+
+
+uint64_t JsonFsTable::Hash(const std::string& key) {
+  uint64_t hash = 14695981039346656037ULL;
+  for (unsigned char byte : key) {
+    hash ^= byte;
+    hash *= 1099511628211ULL;
+  }
+  return hash;
+}
+
+
+JsonFsTable::JsonFsTable() {
+  this->sorted_ = 0;
+  this->used_slots_ = 0;
+  this->garbage_ = 0;
+  this->slots_.assign(16, JsonFsTable::EMPTY);
+}
+
+JsonFsTable::JsonFsTable(const json& object) : JsonFsTable() {
+  this->entries_.reserve(object.size());
+  this->order_.reserve(object.size());
+  this->rehash(object.size());
+
+  // Objects iterate in key order so order_ never needs sorting.
+  for (auto it = object.begin(); it != object.end(); ++it) {
+    this->set(it.key(), it.value());
+  }
+}
+
+size_t JsonFsTable::count() const {
+  return this->order_.size();
+}
+
+size_t JsonFsTable::memory() const {
+  return sizeof(JsonFsTable) + this->arena_.capacity() +
+    this->entries_.capacity() * sizeof(Entry) +
+    this->free_.capacity() * sizeof(uint32_t) +
+    this->order_.capacity() * sizeof(uint32_t) +
+    this->slots_.capacity() * sizeof(uint32_t);
+}
+
+bool JsonFsTable::contains(const std::string& key) const {
+  return this->lookup(key) != this->slots_.size();
+}
+
+const uint8_t* JsonFsTable::find(const std::string& key, size_t* size) const {
+  size_t index = this->lookup(key);
+  if (index == this->slots_.size()) {
+    return nullptr;
+  }
+  const Entry& entry = this->entries_[this->slots_[index] - 1];
+  *size = entry.value_size;
+  return this->arena_.data() + entry.value_offset;
+}
+
+json JsonFsTable::get(const std::string& key) const {
+  size_t size = 0;
+  const uint8_t* data = this->find(key, &size);
+  if (data == nullptr) {
+    return nullptr;
+  }
+  return json::from_cbor(std::vector<uint8_t>(data, data + size));
+}
+
+void JsonFsTable::set(const std::string& key, const json& value) {
+  std::vector<uint8_t> encoded = json::to_cbor(value);
+  this->set(key, encoded.data(), encoded.size());
+}
+
+void JsonFsTable::set(
+    const std::string& key, const uint8_t* data, size_t size
+) {
+  // Replace the value of existing keys.
+  size_t index = this->lookup(key);
+  if (index != this->slots_.size()) {
+    Entry& entry = this->entries_[this->slots_[index] - 1];
+    this->garbage_ += entry.value_size;
+    entry.value_offset = this->append(data, size);
+    entry.value_size = size;
+    return;
+  }
+
+  // Grow the index before looking for a free slot.
+  if ((this->used_slots_ + 1) * 10 > this->slots_.size() * MAX_LOAD) {
+    this->rehash(this->order_.size() + 1);
+  }
+  size_t mask = this->slots_.size() - 1;
+  index = JsonFsTable::Hash(key) & mask;
+  while (this->slots_[index] != JsonFsTable::EMPTY &&
+         this->slots_[index] != JsonFsTable::TOMBSTONE) {
+    index = (index + 1) & mask;
+  }
+  if (this->slots_[index] == JsonFsTable::EMPTY) {
+    this->used_slots_ += 1;
+  }
+
+  // Store the new entry.
+  uint32_t id = this->entries_.size();
+  if (!this->free_.empty()) {
+    id = this->free_.back();
+    this->free_.pop_back();
+  } else {
+    this->entries_.push_back(Entry());
+  }
+  // Keys appended in order keep order_ sorted.
+  bool sorted = this->sorted_ == this->order_.size() && (
+      this->order_.empty() || this->compare(this->order_.back(), key) < 0
+  );
+  Entry& entry = this->entries_[id];
+  entry.key_offset = this->append(
+      reinterpret_cast<const uint8_t*>(key.data()), key.size()
+  );
+  entry.key_size = key.size();
+  entry.value_offset = this->append(data, size);
+  entry.value_size = size;
+  this->slots_[index] = id + 1;
+  this->order_.push_back(id);
+  if (sorted) {
+    this->sorted_ += 1;
+  }
+}
+
+bool JsonFsTable::erase(const std::string& key) {
+  size_t index = this->lookup(key);
+  if (index == this->slots_.size()) {
+    return false;
+  }
+
+  uint32_t id = this->slots_[index] - 1;
+  const Entry& entry = this->entries_[id];
+  this->order_.erase(this->order_.begin() + this->position(key));
+  this->sorted_ = this->order_.size();
+  this->slots_[index] = JsonFsTable::TOMBSTONE;
+  this->free_.push_back(id);
+  this->garbage_ += entry.key_size + entry.value_size;
+
+  if (this->arena_.size() > MIN_COMPACT &&
+      this->garbage_ * 2 > this->arena_.size()) {
+    this->compact();
+  }
+  return true;
+}
+
+size_t JsonFsTable::lowerBound(const std::string& key) const {
+  return this->position(key);
+}
+
+std::string JsonFsTable::key(size_t index) const {
+  this->sort();
+  const Entry& entry = this->entries_[this->order_[index]];
+  return std::string(
+      reinterpret_cast<const char*>(this->arena_.data() + entry.key_offset),
+      entry.key_size
+  );
+}
+
+const uint8_t* JsonFsTable::blob(size_t index, size_t* size) const {
+  this->sort();
+  const Entry& entry = this->entries_[this->order_[index]];
+  *size = entry.value_size;
+  return this->arena_.data() + entry.value_offset;
+}
+
+json JsonFsTable::value(size_t index) const {
+  size_t size = 0;
+  const uint8_t* data = this->blob(index, &size);
+  return json::from_cbor(std::vector<uint8_t>(data, data + size));
+}
+
+json JsonFsTable::toJson() const {
+  json data = json::object();
+  for (size_t index = 0; index < this->order_.size(); index++) {
+    data[this->key(index)] = this->value(index);
+  }
+  return data;
+}
+
+std::string JsonFsTable::toCbor() const {
+  this->sort();
+  std::string buffer;
+  buffer.reserve(this->arena_.size() - this->garbage_ + 16);
+  cbor_head(&buffer, 5, this->order_.size());
+  for (uint32_t id : this->order_) {
+    const Entry& entry = this->entries_[id];
+    cbor_head(&buffer, 3, entry.key_size);
+    buffer.append(
+        reinterpret_cast<const char*>(this->arena_.data() + entry.key_offset),
+        entry.key_size
+    );
+    buffer.append(
+        reinterpret_cast<const char*>(
+          this->arena_.data() + entry.value_offset
+        ),
+        entry.value_size
+    );
+  }
+  return buffer;
+}
@@ -0,0 +1,281 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/view.h"
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/exceptions/base.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/snapshot.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::core::exception::ErrNoException;
+
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsScan;
+using sf::ext::metadata::JsonFsScanRef;
+using sf::ext::metadata::JsonFsSnapshotWriter;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsView;
+
+
+//! Keys written by each step of a dump.
+static const size_t DUMP_BATCH = 1024;
+
+
+//! Writes a store file incrementally, in any JsonFsFormat.
+/*!
+ * CBOR and MessagePack maps start with a fixed size count that
+ * is patched when the file is closed.
+ * Indexed snapshots need all keys up front so values are
+ * collected, encoded, until the file is closed.
+ */
+class JsonFsDumpWriter {
+ protected:
+  std::string path_;
+  std::string tmp_;
+  JsonFsFormat format_;
+  std::ofstream out_;
+  uint64_t count_;
+  JsonFsSnapshotWriter snapshot_;
+
+  void bytes(const std::vector<uint8_t>& data) {
+    this->out_.write(reinterpret_cast<const char*>(data.data()), data.size());
+  }
+
+  //! Writes an unsigned integer of the given size, big-endian.
+  void number(uint64_t value, int size) {
+    for (int shift = (size - 1) * 8; shift >= 0; shift -= 8) {
+      this->out_.put(static_cast<char>((value >> shift) & 0xff));
+    }
+  }
+
+ public:
+  JsonFsDumpWriter(std::string path, JsonFsFormat format) {
+    this->path_ = path;
+    this->tmp_ = path + ".tmp";
+    this->format_ = format;
+    this->count_ = 0;
+    if (format == JsonFsFormat::INDEXED) {
+      return;
+    }
+
+    this->out_.open(this->tmp_, std::ios::binary | std::ios::trunc);
+    if (format == JsonFsFormat::JSON) {
+      this->out_.put('{');
+    } else if (format == JsonFsFormat::CBOR) {
+      this->out_.put(static_cast<char>(0xbb));
+      this->number(0, 8);
+    } else {
+      this->out_.put(static_cast<char>(0xdf));
+      this->number(0, 4);
+    }
+  }
+
+  void write(const json& batch) {
+    for (auto it = batch.begin(); it != batch.end(); ++it) {
+      if (this->format_ == JsonFsFormat::INDEXED) {
+        this->snapshot_.add(it.key(), it.value());
+      } else if (this->format_ == JsonFsFormat::JSON) {
+        if (this->count_ > 0) {
+          this->out_.put(',');
+        }
+        this->out_ << json(it.key()).dump() << ':' << it.value().dump();
+      } else if (this->format_ == JsonFsFormat::CBOR) {
+        this->bytes(json::to_cbor(json(it.key())));
+        this->bytes(json::to_cbor(it.value()));
+      } else {
+        this->bytes(json::to_msgpack(json(it.key())));
+        this->bytes(json::to_msgpack(it.value()));
+      }
+      this->count_ += 1;
+    }
+    if (this->format_ != JsonFsFormat::INDEXED && !this->out_) {
+      throw ErrNoException("Unable to write JsonFS dump " + this->tmp_);
+    }
+  }
+
+  void close() {
+    if (this->format_ == JsonFsFormat::INDEXED) {
+      this->snapshot_.write(this->path_);
+      return;
+    }
+
+    // Finish the document and patch the number of keys.
+    if (this->format_ == JsonFsFormat::JSON) {
+      this->out_.put('}');
+    } else if (this->format_ == JsonFsFormat::CBOR) {
+      this->out_.seekp(1);
+      this->number(this->count_, 8);
+    } else {
+      this->out_.seekp(1);
+      this->number(this->count_, 4);
+    }
+    this->out_.close();
+    if (!this->out_) {
+      throw ErrNoException("Unable to write JsonFS dump " + this->tmp_);
+    }
+    if (rename(this->tmp_.c_str(), this->path_.c_str()) != 0) {
+      throw ErrNoException("Unable to rename JsonFS dump " + this->tmp_);
+    }
+  }
+};
+
+
+json JsonFsView::collectRange(
+    const std::string& from, bool inclusive,
+    const std::string& end, size_t limit
+) const {
+  json result = json::object();
+  auto preserved = inclusive ? this->preserved_.lower_bound(from) :
+      this->preserved_.upper_bound(from);
+  auto in_range = [&end](const std::string& key) {
+    return end.empty() || key < end;
+  };
+  auto emit = [&result](
+      const std::string& key, const std::vector<uint8_t>* value
+  ) {
+    if (value != nullptr) {
+      result[key] = json::from_cbor(*value);
+    }
+  };
+
+  // Merge the store, in batches, with the preserved values.
+  std::string cursor = from;
+  bool include = inclusive;
+  while (result.size() < limit) {
+    json current = this->store_->collectRange(cursor, include, end, limit);
+    for (auto it = current.begin(); it != current.end(); ++it) {
+      while (preserved != this->preserved_.end() &&
+             preserved->first < it.key() && result.size() < limit) {
+        emit(preserved->first, preserved->second.get());
+        ++preserved;
+      }
+      if (result.size() == limit) {
+        return result;
+      }
+      if (preserved != this->preserved_.end() &&
+          preserved->first == it.key()) {
+        emit(preserved->first, preserved->second.get());
+        ++preserved;
+      } else {
+        result[it.key()] = it.value();
+      }
+    }
+
+    // Once the store is exhausted only preserved keys are left.
+    if (current.size() < limit) {
+      while (preserved != this->preserved_.end() &&
+             in_range(preserved->first) && result.size() < limit) {
+        emit(preserved->first, preserved->second.get());
+        ++preserved;
+      }
+      return result;
+    }
+    cursor = (--current.end()).key();
+    include = false;
+  }
+  return result;
+}
+
+Promise JsonFsView::dumpNext(
+    JsonFsScanRef scan,
+    std::function<void(const json&)> write, std::function<void()> close
+) {
+  return scan->next().then([this, scan, write, close](json batch) {
+    auto keys = std::make_shared<json>(std::move(batch));
+    bool done = scan->done();
+    return this->store_->io([write, close, keys, done]() {
+      write(*keys);
+      if (done) {
+        close();
+      }
+    }).then([this, scan, write, close, done]() {
+      if (done) {
+        return Promise().settle(nullptr);
+      }
+      return this->dumpNext(scan, write, close);
+    });
+  });
+}
+
+
+JsonFsView::JsonFsView(JsonFsStore* store) {
+  this->store_ = store;
+}
+
+void JsonFsView::preserve(
+    const std::string& key, const uint8_t* data, size_t size
+) {
+  if (this->preserved_.find(key) != this->preserved_.end()) {
+    return;
+  }
+  std::unique_ptr<std::vector<uint8_t>> value;
+  if (data != nullptr) {
+    value.reset(new std::vector<uint8_t>(data, data + size));
+  }
+  this->preserved_[key] = std::move(value);
+}
+
+size_t JsonFsView::preserved() const {
+  return this->preserved_.size();
+}
+
+Promise JsonFsView::get(std::string key) {
+  return this->store_->cache().then([this, key]() {
+    auto preserved = this->preserved_.find(key);
+    if (preserved == this->preserved_.end()) {
+      return this->store_->lookup(key);
+    }
+    if (!preserved->second) {
+      return json();
+    }
+    return json::from_cbor(*preserved->second);
+  });
+}
+
+Promise JsonFsView::range(
+    std::string from, bool inclusive, std::string end, size_t limit
+) {
+  return this->store_->cache().then([this, from, inclusive, end, limit]() {
+    return this->collectRange(from, inclusive, end, limit);
+  });
+}
+
+JsonFsScanRef JsonFsView::scan(std::string prefix, size_t batch) {
+  return this->scan(prefix, JsonFsScan::PrefixEnd(prefix), batch);
+}
+
+JsonFsScanRef JsonFsView::scan(
+    std::string begin, std::string end, size_t batch
+) {
+  JsonFsScan::Fetch fetch = [this](
+      const std::string& from, bool inclusive,
+      const std::string& end, size_t limit
+  ) {
+    return this->range(from, inclusive, end, limit);
+  };
+  return std::make_shared<JsonFsScan>(fetch, begin, end, batch);
+}
+
+Promise JsonFsView::dump(std::string path, JsonFsFormat format) {
+  std::shared_ptr<JsonFsDumpWriter> writer;
+  try {
+    writer = std::make_shared<JsonFsDumpWriter>(path, format);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+  return this->dumpNext(
+      this->scan("", "", DUMP_BATCH),
+      [writer](const json& batch) { writer->write(batch); },
+      [writer]() { writer->close(); }
+  );
+}
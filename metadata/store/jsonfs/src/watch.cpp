@@ -0,0 +1,223 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/jsonfs/watch.h"
+
+#include <libgen.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "core/context/context.h"
+#include "core/exceptions/base.h"
+#include "core/model/logger.h"
+
+#include "ext/metadata/store/jsonfs.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::core::context::ProxyLogger;
+using sf::core::exception::ErrNoException;
+using sf::core::model::EventRef;
+using sf::core::model::EventSource;
+using sf::core::model::LogInfo;
+
+using sf::ext::metadata::JsonFsChange;
+using sf::ext::metadata::JsonFsStamp;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsWatchCallback;
+using sf::ext::metadata::JsonFsWatchList;
+using sf::ext::metadata::JsonFsWatcher;
+
+
+static ProxyLogger logger("ext.metadata.store.jsonfs");
+
+
+JsonFsStamp::JsonFsStamp() {
+  this->inode = 0;
+  this->size = 0;
+  this->mtime.tv_sec = 0;
+  this->mtime.tv_nsec = 0;
+}
+
+JsonFsStamp JsonFsStamp::Of(const std::string& path) {
+  JsonFsStamp stamp;
+  struct stat info;
+  if (::stat(path.c_str(), &info) == 0) {
+    stamp.inode = info.st_ino;
+    stamp.size = info.st_size;
+    stamp.mtime = info.st_mtim;
+  }
+  return stamp;
+}
+
+bool JsonFsStamp::operator==(const JsonFsStamp& other) const {
+  return this->inode == other.inode && this->size == other.size &&
+    this->mtime.tv_sec == other.mtime.tv_sec &&
+    this->mtime.tv_nsec == other.mtime.tv_nsec;
+}
+
+
+bool JsonFsWatchList::Matches(const Watch& watch, const std::string& key) {
+  if (watch.prefix) {
+    return key.compare(0, watch.key.size(), watch.key) == 0;
+  }
+  return key == watch.key;
+}
+
+JsonFsWatchList::JsonFsWatchList() {
+  this->next_id_ = 1;
+  this->revision_ = 0;
+  this->commits_ = 0;
+}
+
+uint64_t JsonFsWatchList::add(
+    std::string key, bool prefix, JsonFsWatchCallback callback
+) {
+  uint64_t id = this->next_id_++;
+  Watch watch = {key, prefix, callback};
+  this->watches_[id] = watch;
+  return id;
+}
+
+void JsonFsWatchList::remove(uint64_t id) {
+  this->watches_.erase(id);
+}
+
+bool JsonFsWatchList::busy() const {
+  return this->commits_ > 0;
+}
+
+bool JsonFsWatchList::empty() const {
+  return this->watches_.empty();
+}
+
+uint64_t JsonFsWatchList::revision() const {
+  return this->revision_;
+}
+
+void JsonFsWatchList::record(const std::string& key, const json& value) {
+  if (this->watches_.empty()) {
+    return;
+  }
+  this->pending_[key] = value;
+}
+
+JsonFsWatchList::ChangesRef JsonFsWatchList::begin() {
+  ChangesRef changes = std::make_shared<Changes>();
+  changes->swap(this->pending_);
+  this->commits_ += 1;
+  return changes;
+}
+
+void JsonFsWatchList::end(ChangesRef changes, bool written) {
+  this->commits_ -= 1;
+  if (written) {
+    for (auto& change : *changes) {
+      this->ready_[change.first] = change.second;
+    }
+  }
+  this->deliver();
+}
+
+void JsonFsWatchList::deliver() {
+  if (this->busy() || this->ready_.empty()) {
+    return;
+  }
+
+  // Callbacks can add or remove watches so work on copies.
+  Changes ready;
+  ready.swap(this->ready_);
+  std::map<uint64_t, Watch> watches = this->watches_;
+  this->revision_ += 1;
+
+  for (auto& pair : ready) {
+    JsonFsChange change = {pair.first, pair.second, this->revision_};
+    for (auto& watch : watches) {
+      if (!JsonFsWatchList::Matches(watch.second, change.key)) {
+        continue;
+      }
+      try {
+        watch.second.callback(change);
+      } catch (std::exception& ex) {
+        LogInfo vars = {{"key", change.key}, {"error", ex.what()}};
+        WARNINGV(logger, "JsonFS watch for ${key} failed: ${error}", vars);
+      }
+    }
+  }
+}
+
+
+EventRef JsonFsWatcher::parse() {
+  // Drain all queued events, they are aligned to inotify_event.
+  char buffer[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  bool changed = false;
+  ssize_t size = 0;
+  while ((size = ::read(this->inotify_fd_, buffer, sizeof(buffer))) > 0) {
+    ssize_t offset = 0;
+    while (offset < size) {
+      struct inotify_event* event =
+        reinterpret_cast<struct inotify_event*>(buffer + offset);
+      if (event->len > 0 && this->name_ == event->name) {
+        changed = true;
+      }
+      offset += sizeof(struct inotify_event) + event->len;
+    }
+  }
+
+  // Bursts of writes only trigger one refresh.
+  if (changed) {
+    this->store_->refresh().except([](const std::exception_ptr& error) {
+      try {
+        std::rethrow_exception(error);
+      } catch (std::exception& ex) {
+        LogInfo vars = {{"error", ex.what()}};
+        WARNINGV(logger, "Unable to refresh JsonFS store: ${error}", vars);
+      }
+    });
+  }
+  return EventRef();
+}
+
+
+JsonFsWatcher::JsonFsWatcher(
+    std::string id, std::shared_ptr<JsonFsStore> store
+) : EventSource(id) {
+  this->store_ = store;
+  this->inotify_fd_ = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (this->inotify_fd_ < 0) {
+    throw ErrNoException("Unable to create JsonFS inotify instance");
+  }
+
+  // Watch the directory: stores can be replaced by renames.
+  char* file = strdup(store->path().c_str());
+  char* dir = strdup(store->path().c_str());
+  this->name_ = std::string(basename(file));
+  std::string directory(dirname(dir));
+  free(file);
+  free(dir);
+
+  int watch = inotify_add_watch(
+      this->inotify_fd_, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO
+  );
+  if (watch < 0) {
+    ::close(this->inotify_fd_);
+    throw ErrNoException("Unable to watch JsonFS store directory");
+  }
+}
+
+JsonFsWatcher::~JsonFsWatcher() {
+  ::close(this->inotify_fd_);
+}
+
+int JsonFsWatcher::fd() {
+  return this->inotify_fd_;
+}
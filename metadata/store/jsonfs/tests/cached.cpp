@@ -0,0 +1,247 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <chrono>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs/cached.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::core::interface::MetaDataStore;
+using sf::ext::metadata::CachedMetaDataStore;
+
+
+//! In memory store that counts calls and can delay them.
+class FakeStore : public MetaDataStore {
+ public:
+  std::map<std::string, json> data;
+  std::vector<std::string> calls;
+  std::vector<Promise> delayed;
+  bool delay = false;
+  std::mutex mutex;
+
+  Promise reply(json value) {
+    Promise promise;
+    if (this->delay) {
+      this->delayed.push_back(promise);
+      return promise;
+    }
+    return promise.settle(value);
+  }
+
+  Promise erase(std::string key) {
+    std::unique_lock<std::mutex> guard(this->mutex);
+    this->calls.push_back("erase " + key);
+    this->data.erase(key);
+    guard.unlock();
+    return this->reply(nullptr);
+  }
+
+  Promise get(std::string key) {
+    std::unique_lock<std::mutex> guard(this->mutex);
+    this->calls.push_back("get " + key);
+    auto value = this->data.find(key);
+    json result = value == this->data.end() ? json() : value->second;
+    guard.unlock();
+    return this->reply(result);
+  }
+
+  Promise set(std::string key, json value) {
+    std::unique_lock<std::mutex> guard(this->mutex);
+    this->calls.push_back("set " + key);
+    this->data[key] = value;
+    guard.unlock();
+    return this->reply(nullptr);
+  }
+
+  Promise set(std::string key, json value, std::chrono::duration<int> ttl) {
+    return this->set(key, value);
+  }
+};
+
+
+//! Cache with a clock moved by the tests.
+class TestCache : public CachedMetaDataStore {
+ protected:
+  Clock::time_point now() const {
+    return this->clock;
+  }
+
+ public:
+  Clock::time_point clock;
+
+  TestCache(
+      std::shared_ptr<FakeStore> store, size_t capacity, bool negative = true,
+      std::chrono::duration<int> age = std::chrono::duration<int>(0)
+  ) : CachedMetaDataStore(store, capacity, negative, age) {
+    this->clock = Clock::now();
+  }
+};
+
+
+class CachedMetaDataStoreTest : public ::testing::Test {
+ protected:
+  std::shared_ptr<FakeStore> store;
+
+ public:
+  CachedMetaDataStoreTest() {
+    this->store = std::make_shared<FakeStore>();
+    this->store->data = {{"a", 1}, {"b", 2}, {"c", 3}};
+  }
+
+  //! Returns the value of the key in the cache.
+  json get(CachedMetaDataStore* cache, std::string key) {
+    json result;
+    Promise promise = cache->get(key).then([&result](json value) {
+      result = value;
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(promise);
+    EXPECT_TRUE(promise.settled());
+    return result;
+  }
+
+  //! Number of gets that reached the wrapped store.
+  size_t gets() {
+    size_t count = 0;
+    for (auto& call : this->store->calls) {
+      count += call.compare(0, 4, "get ") == 0 ? 1 : 0;
+    }
+    return count;
+  }
+};
+
+
+TEST_F(CachedMetaDataStoreTest, GetsAreCached) {
+  TestCache cache(this->store, 10);
+  ASSERT_EQ(json(1), this->get(&cache, "a"));
+  ASSERT_EQ(json(1), this->get(&cache, "a"));
+  ASSERT_EQ(1, this->gets());
+  ASSERT_EQ(1, cache.hits());
+  ASSERT_EQ(1, cache.misses());
+}
+
+TEST_F(CachedMetaDataStoreTest, MissingKeysAreCached) {
+  TestCache cache(this->store, 10);
+  ASSERT_TRUE(this->get(&cache, "z").is_null());
+  ASSERT_TRUE(this->get(&cache, "z").is_null());
+  ASSERT_EQ(1, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, NegativeCachingCanBeDisabled) {
+  TestCache cache(this->store, 10, false);
+  ASSERT_TRUE(this->get(&cache, "z").is_null());
+  ASSERT_TRUE(this->get(&cache, "z").is_null());
+  ASSERT_EQ(2, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, LeastRecentlyUsedIsEvicted) {
+  TestCache cache(this->store, 2);
+  this->get(&cache, "a");
+  this->get(&cache, "b");
+  this->get(&cache, "a");
+  this->get(&cache, "c");
+  ASSERT_EQ(2, cache.size());
+  ASSERT_EQ(3, this->gets());
+  this->get(&cache, "a");
+  ASSERT_EQ(3, this->gets());
+  this->get(&cache, "b");
+  ASSERT_EQ(4, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, WritesUpdateTheCache) {
+  TestCache cache(this->store, 10);
+  this->get(&cache, "a");
+  EXPECT_PROMISE_NO_THROW(cache.set("a", 10));
+  ASSERT_EQ(json(10), this->get(&cache, "a"));
+  EXPECT_PROMISE_NO_THROW(cache.erase("a"));
+  ASSERT_TRUE(this->get(&cache, "a").is_null());
+  ASSERT_EQ(1, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, FailedWritesInvalidate) {
+  TestCache cache(this->store, 10);
+  this->get(&cache, "a");
+  this->store->delay = true;
+  Promise set = cache.set("a", 10);
+  this->store->delayed[0].settle(
+      std::make_exception_ptr(std::runtime_error("failed"))
+  );
+  ASSERT_TRUE(set.rejected());
+  ASSERT_EQ(0, cache.size());
+}
+
+TEST_F(CachedMetaDataStoreTest, GetsRacingWritesAreNotCached) {
+  TestCache cache(this->store, 10);
+  this->store->delay = true;
+  Promise get = cache.get("a");
+  Promise set = cache.set("a", 10);
+  this->store->delayed[0].settle(json(1));
+  ASSERT_TRUE(get.resolved());
+  ASSERT_EQ(0, cache.size());
+  this->store->delayed[1].settle(nullptr);
+  ASSERT_TRUE(set.resolved());
+  this->store->delay = false;
+  ASSERT_EQ(json(10), this->get(&cache, "a"));
+  ASSERT_EQ(1, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, TtlExpiresKeys) {
+  TestCache cache(this->store, 10);
+  EXPECT_PROMISE_NO_THROW(cache.set("a", 10, std::chrono::seconds(5)));
+  ASSERT_EQ(json(10), this->get(&cache, "a"));
+  ASSERT_EQ(0, this->gets());
+  cache.clock += std::chrono::seconds(6);
+  ASSERT_EQ(json(10), this->get(&cache, "a"));
+  ASSERT_EQ(1, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, MaxAgeExpiresKeys) {
+  TestCache cache(this->store, 10, true, std::chrono::seconds(5));
+  this->get(&cache, "a");
+  cache.clock += std::chrono::seconds(4);
+  this->get(&cache, "a");
+  ASSERT_EQ(1, this->gets());
+  cache.clock += std::chrono::seconds(2);
+  this->get(&cache, "a");
+  ASSERT_EQ(2, this->gets());
+}
+
+TEST_F(CachedMetaDataStoreTest, Invalidate) {
+  TestCache cache(this->store, 10);
+  this->get(&cache, "a");
+  this->store->data["a"] = 10;
+  cache.invalidate("a");
+  ASSERT_EQ(json(10), this->get(&cache, "a"));
+}
+
+TEST_F(CachedMetaDataStoreTest, ConcurrentAccess) {
+  TestCache cache(this->store, 4);
+  std::vector<std::thread> threads;
+  for (int thread = 0; thread < 4; thread++) {
+    threads.emplace_back([&cache, thread]() {
+      for (int round = 0; round < 1000; round++) {
+        std::string key = std::to_string((thread + round) % 8);
+        if (round % 3 == 0) {
+          cache.set(key, round);
+        } else {
+          cache.get(key);
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  ASSERT_GE(4, cache.size());
+  ASSERT_EQ(4 * 666, cache.hits() + cache.misses());
+}
@@ -0,0 +1,184 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <iterator>
+#include <string>
+
+#include "ext/metadata/store/jsonfs/compress.h"
+#include "ext/metadata/store/jsonfs/exceptions.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/loader.h"
+
+
+using nlohmann::json;
+
+using sf::ext::exception::JsonFsCorruptStore;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsInputFile;
+using sf::ext::metadata::JsonFsLoadProgress;
+using sf::ext::metadata::JsonFsLoader;
+using sf::ext::metadata::JsonFsOutputFile;
+
+
+class JsonFsCompressTest : public ::testing::Test {
+ protected:
+  int tmp_fd_;
+  std::string tmp_path_;
+
+ public:
+  JsonFsCompressTest() {
+    char* path = strdup("tmp.sf-jsonfs.compress.XXXXXX");
+    this->tmp_fd_ = mkstemp(path);
+    this->tmp_path_ = std::string(path);
+    free(path);
+  }
+
+  ~JsonFsCompressTest() {
+    close(this->tmp_fd_);
+    unlink(this->tmp_path_.c_str());
+  }
+
+  //! Returns a store with many similar keys.
+  json records(size_t count) {
+    json data = json::object();
+    for (size_t index = 0; index < count; index++) {
+      data["node-" + std::to_string(index)] = {
+        {"address", "10.0.0.1"}, {"tags", {"metadata", "jsonfs"}}
+      };
+    }
+    return data;
+  }
+
+  //! Reads the decompressed content of the file.
+  std::string read() {
+    JsonFsInputFile input(this->tmp_path_);
+    return std::string(
+        (std::istreambuf_iterator<char>(input.stream())),
+        std::istreambuf_iterator<char>()
+    );
+  }
+};
+
+
+TEST_F(JsonFsCompressTest, CompressionFromName) {
+  ASSERT_EQ(JsonFsCompression::NONE, JsonFsCodec::CompressionFromName("none"));
+  ASSERT_EQ(JsonFsCompression::ZSTD, JsonFsCodec::CompressionFromName("zstd"));
+  ASSERT_EQ("zstd", JsonFsCodec::CompressionName(JsonFsCompression::ZSTD));
+}
+
+TEST_F(JsonFsCompressTest, DetectCompression) {
+  JsonFsCodec::Write(this->tmp_path_, "{}", JsonFsCompression::ZSTD);
+  JsonFsInputFile compressed(this->tmp_path_);
+  ASSERT_EQ(JsonFsCompression::ZSTD, compressed.compression());
+
+  JsonFsCodec::Write(this->tmp_path_, "{}");
+  JsonFsInputFile plain(this->tmp_path_);
+  ASSERT_EQ(JsonFsCompression::NONE, plain.compression());
+}
+
+TEST_F(JsonFsCompressTest, MigrateKeepsCompression) {
+  json data = this->records(100);
+  JsonFsCodec::Dump(
+      this->tmp_path_, data, JsonFsFormat::JSON, JsonFsCompression::ZSTD
+  );
+  JsonFsCodec::Migrate(this->tmp_path_, JsonFsFormat::CBOR);
+
+  JsonFsInputFile input(this->tmp_path_);
+  ASSERT_EQ(JsonFsCompression::ZSTD, input.compression());
+  ASSERT_EQ(JsonFsFormat::CBOR, JsonFsCodec::Detect(input.stream()));
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsCompressTest, MigrateToIndexedDecompresses) {
+  json data = this->records(100);
+  JsonFsCodec::Dump(
+      this->tmp_path_, data, JsonFsFormat::JSON, JsonFsCompression::ZSTD
+  );
+  JsonFsCodec::Migrate(this->tmp_path_, JsonFsFormat::INDEXED);
+  JsonFsInputFile input(this->tmp_path_);
+  ASSERT_EQ(JsonFsCompression::NONE, input.compression());
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsCompressTest, MissingFile) {
+  JsonFsInputFile input("/not/a/real/path");
+  ASSERT_EQ(0, input.size());
+  ASSERT_EQ(JsonFsCompression::NONE, input.compression());
+}
+
+TEST_F(JsonFsCompressTest, StreamInChunks) {
+  std::string content;
+  JsonFsOutputFile output(this->tmp_path_, JsonFsCompression::ZSTD);
+  for (size_t index = 0; index < 100000; index++) {
+    std::string chunk = std::to_string(index) + ",";
+    output.write(chunk.data(), chunk.size());
+    content += chunk;
+  }
+  output.close();
+  ASSERT_EQ(content, this->read());
+}
+
+TEST_F(JsonFsCompressTest, RoundTripFormats) {
+  json data = this->records(100);
+  for (JsonFsFormat format : {
+      JsonFsFormat::JSON, JsonFsFormat::CBOR, JsonFsFormat::MSGPACK
+  }) {
+    JsonFsCodec::Dump(this->tmp_path_, data, format, JsonFsCompression::ZSTD);
+    JsonFsInputFile input(this->tmp_path_);
+    ASSERT_EQ(format, JsonFsCodec::Detect(input.stream()));
+    ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+  }
+}
+
+TEST_F(JsonFsCompressTest, CompressesRepetitiveStores) {
+  json data = this->records(1000);
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  size_t plain = JsonFsInputFile(this->tmp_path_).size();
+  JsonFsCodec::Dump(
+      this->tmp_path_, data, JsonFsFormat::JSON, JsonFsCompression::ZSTD
+  );
+  size_t compressed = JsonFsInputFile(this->tmp_path_).size();
+  ASSERT_LT(compressed * 5, plain);
+}
+
+TEST_F(JsonFsCompressTest, IndexedCantBeCompressed) {
+  ASSERT_ANY_THROW(JsonFsCodec::Dump(
+      this->tmp_path_, json::object(), JsonFsFormat::INDEXED,
+      JsonFsCompression::ZSTD
+  ));
+}
+
+TEST_F(JsonFsCompressTest, LoaderStreamsCompressedFiles) {
+  json data = this->records(100);
+  JsonFsCodec::Dump(
+      this->tmp_path_, data, JsonFsFormat::CBOR, JsonFsCompression::ZSTD
+  );
+  size_t keys = 0;
+  JsonFsLoadProgress last = {0, 0, 0};
+  JsonFsLoader loader(this->tmp_path_, 10);
+  loader.load([&keys, &last](
+      JsonFsLoader::Batch* batch, const JsonFsLoadProgress& progress
+  ) {
+    keys += batch->size();
+    last = progress;
+  });
+  ASSERT_EQ(100, keys);
+  ASSERT_EQ(last.total, last.bytes);
+  ASSERT_EQ(JsonFsInputFile(this->tmp_path_).size(), last.total);
+}
+
+TEST_F(JsonFsCompressTest, TruncatedFile) {
+  JsonFsCodec::Dump(
+      this->tmp_path_, this->records(100), JsonFsFormat::JSON,
+      JsonFsCompression::ZSTD
+  );
+  size_t size = JsonFsInputFile(this->tmp_path_).size();
+  ASSERT_EQ(0, truncate(this->tmp_path_.c_str(), size / 2));
+  ASSERT_THROW(JsonFsCodec::Load(this->tmp_path_), JsonFsCorruptStore);
+}
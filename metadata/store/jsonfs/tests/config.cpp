@@ -32,6 +32,7 @@ using sf::core::interface::Posix;
 using sf::core::utility::Lua;
 
 using sf::ext::metadata::JsonFsStoreConfig;
+using sf::ext::metadata::JsonFsStoreOptions;
 
 using sf::core::testing::HookTest;
 
@@ -90,6 +91,149 @@ TEST_F(ConfigExtensionTest, FactoryRequiresArg) {
   );
 }
 
+TEST_F(ConfigExtensionTest, FactoryRejectsUnknownFormat) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with an invalid format.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs {store = '/some/path', format = 'xml'}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsCompressedIndexed) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with incompatible options.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs "
+          "{store = '/some/path', format = 'indexed', compression = 'zstd'}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsUnknownCompression) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with an invalid compression.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs {store = '/some/path', compression = 'rar'}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryReturnsIntentWithFormat) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory and check return type.
+  this->lua.doString(
+      "return metastores.jsonfs {store = '/some/path', format = 'cbor'}"
+  );
+  ASSERT_TRUE(this->type.typeOf(-1));
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsAsyncShards) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with incompatible options.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs "
+          "{store = '/some/path', shards = 2, async = true}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsAsyncShared) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with incompatible options.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs "
+          "{store = '/some/path', shared = true, async = true}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsCachedShared) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with a cache that can't see other processes.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs "
+          "{store = '/some/path', shared = true, cache = 1024}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsNegativeCache) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with an invalid cache size.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs {store = '/some/path', cache = -1}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsNoShards) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with an invalid number of shards.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs {store = '/some/path', shards = 0}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsWatchedShards) {
+  // Attach and trigger LuaInit handler.
+  JsonFsStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with incompatible options.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.jsonfs "
+          "{store = '/some/path', shards = 2, watch = true}"
+      ),
+      InvalidConfiguration
+  );
+}
+
 TEST_F(ConfigExtensionTest, FactoryRequiresStorePath) {
   // Attach and trigger LuaInit handler.
   JsonFsStoreConfig::AttachLuaInit();
@@ -122,6 +266,24 @@ TEST_F(JsonFsStoreIntentTest, UpdatesTheContext) {
   ASSERT_NO_THROW(context->metadata());
 }
 
+TEST_F(JsonFsStoreIntentTest, UpdatesTheContextWhenSharded) {
+  JsonFsStoreOptions options;
+  options.shards = 4;
+  auto intent = JsonFsStoreConfig::MakeIntent("", options);
+  ContextRef context(new Context());
+  intent->apply(context);
+  ASSERT_NO_THROW(context->metadata());
+}
+
+TEST_F(JsonFsStoreIntentTest, UpdatesTheContextWhenCached) {
+  JsonFsStoreOptions options;
+  options.cache = 1024;
+  auto intent = JsonFsStoreConfig::MakeIntent("", options);
+  ContextRef context(new Context());
+  intent->apply(context);
+  ASSERT_NO_THROW(context->metadata());
+}
+
 TEST_F(JsonFsStoreIntentTest, VaildatePathIsDir) {
   auto intent = JsonFsStoreConfig::MakeIntent("/");
   ContextRef context(new Context());
@@ -0,0 +1,121 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <sstream>
+#include <string>
+
+#include "core/exceptions/configuration.h"
+#include "ext/metadata/store/jsonfs/format.h"
+
+
+using nlohmann::json;
+
+using sf::core::exception::InvalidConfiguration;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+
+
+class JsonFsCodecTest : public ::testing::Test {
+ protected:
+  int tmp_fd_;
+  std::string tmp_path_;
+
+ public:
+  JsonFsCodecTest() {
+    char* path = strdup("tmp.sf-jsonfs.format.XXXXXX");
+    this->tmp_fd_ = mkstemp(path);
+    this->tmp_path_ = std::string(path);
+    free(path);
+  }
+
+  ~JsonFsCodecTest() {
+    close(this->tmp_fd_);
+    unlink(this->tmp_path_.c_str());
+  }
+
+  JsonFsFormat detectFile() {
+    std::ifstream file(this->tmp_path_, std::ios::binary);
+    return JsonFsCodec::Detect(file);
+  }
+};
+
+
+TEST_F(JsonFsCodecTest, DetectEmpty) {
+  std::stringstream data;
+  ASSERT_EQ(JsonFsFormat::JSON, JsonFsCodec::Detect(data));
+}
+
+TEST_F(JsonFsCodecTest, DetectCbor) {
+  json data = {{"key", "value"}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::CBOR);
+  ASSERT_EQ(JsonFsFormat::CBOR, this->detectFile());
+}
+
+TEST_F(JsonFsCodecTest, DetectIndexed) {
+  json data = {{"key", "value"}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::INDEXED);
+  ASSERT_EQ(JsonFsFormat::INDEXED, this->detectFile());
+}
+
+TEST_F(JsonFsCodecTest, DetectJson) {
+  json data = {{"key", "value"}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  ASSERT_EQ(JsonFsFormat::JSON, this->detectFile());
+}
+
+TEST_F(JsonFsCodecTest, DetectMsgPack) {
+  json data = {{"key", "value"}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::MSGPACK);
+  ASSERT_EQ(JsonFsFormat::MSGPACK, this->detectFile());
+}
+
+TEST_F(JsonFsCodecTest, FormatFromName) {
+  ASSERT_EQ(JsonFsFormat::JSON, JsonFsCodec::FormatFromName("json"));
+  ASSERT_EQ(JsonFsFormat::CBOR, JsonFsCodec::FormatFromName("cbor"));
+  ASSERT_EQ(JsonFsFormat::MSGPACK, JsonFsCodec::FormatFromName("msgpack"));
+  ASSERT_EQ(JsonFsFormat::INDEXED, JsonFsCodec::FormatFromName("indexed"));
+  ASSERT_THROW(JsonFsCodec::FormatFromName("xml"), InvalidConfiguration);
+}
+
+TEST_F(JsonFsCodecTest, LoadEmptyFile) {
+  json data = JsonFsCodec::Load(this->tmp_path_);
+  ASSERT_TRUE(data.is_object());
+  ASSERT_EQ(0, data.size());
+}
+
+TEST_F(JsonFsCodecTest, LoadMissingFile) {
+  json data = JsonFsCodec::Load("/not/a/real/path");
+  ASSERT_TRUE(data.is_object());
+  ASSERT_EQ(0, data.size());
+}
+
+TEST_F(JsonFsCodecTest, MigrateJsonToCbor) {
+  json data = {{"key", "value"}, {"answer", 42}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  JsonFsCodec::Migrate(this->tmp_path_, JsonFsFormat::CBOR);
+
+  ASSERT_EQ(JsonFsFormat::CBOR, this->detectFile());
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsCodecTest, RoundTripCbor) {
+  json data = {{"key", "value"}, {"nested", {{"list", {1, 2, 3}}}}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::CBOR);
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsCodecTest, RoundTripIndexed) {
+  json data = {{"key", "value"}, {"nested", {{"list", {1, 2, 3}}}}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::INDEXED);
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsCodecTest, RoundTripMsgPack) {
+  json data = {{"key", "value"}, {"nested", {{"list", {1, 2, 3}}}}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::MSGPACK);
+  ASSERT_EQ(data, JsonFsCodec::Load(this->tmp_path_));
+}
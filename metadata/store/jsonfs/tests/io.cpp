@@ -0,0 +1,118 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <fcntl.h>
+#include <gtest/gtest.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs/io.h"
+
+
+using poolqueue::Promise;
+using sf::ext::metadata::JsonFsIoThread;
+
+
+//! I/O thread whose eventfd can be made to fail.
+class BrokenIoThread : public JsonFsIoThread {
+ public:
+  explicit BrokenIoThread(std::string id) : JsonFsIoThread(id) {
+    // NOOP.
+  }
+
+  //! Replaces the eventfd with a descriptor that can't be written.
+  void breakEventFd() {
+    int fd = ::open("/dev/null", O_RDONLY);
+    ::dup2(fd, this->event_fd_);
+    ::close(fd);
+  }
+};
+
+
+class JsonFsIoThreadTest : public ::testing::Test {
+ protected:
+  JsonFsIoThread io;
+
+ public:
+  JsonFsIoThreadTest() : io("test-jsonfs-io") {
+    // NOOP.
+  }
+
+  //! Waits for the I/O thread to signal and settles promises.
+  void wait() {
+    struct pollfd event = {this->io.fd(), POLLIN, 0};
+    ASSERT_EQ(1, poll(&event, 1, 1000));
+    this->io.fetch();
+  }
+};
+
+
+TEST_F(JsonFsIoThreadTest, RejectsOnError) {
+  Promise result = this->io.submit([]() {
+    throw std::runtime_error("failed");
+  });
+  this->wait();
+  ASSERT_TRUE(result.rejected());
+}
+
+TEST_F(JsonFsIoThreadTest, RunsOffThread) {
+  std::thread::id caller = std::this_thread::get_id();
+  std::thread::id worker;
+  Promise result = this->io.submit([&worker]() {
+    worker = std::this_thread::get_id();
+  });
+  this->wait();
+  ASSERT_TRUE(result.resolved());
+  ASSERT_NE(caller, worker);
+}
+
+TEST_F(JsonFsIoThreadTest, SettlesOnFetch) {
+  bool done = false;
+  Promise result = this->io.submit([&done]() {
+    done = true;
+  });
+
+  // Work completes on the I/O thread but is not settled yet.
+  struct pollfd event = {this->io.fd(), POLLIN, 0};
+  ASSERT_EQ(1, poll(&event, 1, 1000));
+  ASSERT_TRUE(done);
+  ASSERT_FALSE(result.settled());
+
+  this->io.fetch();
+  ASSERT_TRUE(result.settled());
+}
+
+TEST_F(JsonFsIoThreadTest, PostedCallbacksRunBeforeCompletion) {
+  std::vector<std::string> calls;
+  JsonFsIoThread* io = &this->io;
+  Promise result = this->io.submit([io, &calls]() {
+    io->post([&calls]() {
+      calls.push_back("posted");
+    });
+  }).then([&calls]() {
+    calls.push_back("settled");
+    return nullptr;
+  });
+  while (!result.settled()) {
+    this->wait();
+  }
+  ASSERT_TRUE(result.resolved());
+  ASSERT_EQ(std::vector<std::string>({"posted", "settled"}), calls);
+}
+
+TEST(JsonFsIoThread, RejectsIfTheLoopCantBeWoken) {
+  BrokenIoThread io("test-jsonfs-io");
+  io.breakEventFd();
+  Promise result = io.submit([]() {
+    // NOOP.
+  });
+  for (int wait = 0; wait < 100 && !result.settled(); wait++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+  ASSERT_TRUE(result.rejected());
+}
@@ -1,17 +1,29 @@
 // Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
 #include <gtest/gtest.h>
 
+#include <poll.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <fstream>
+#include <string>
+#include <vector>
 
 #include "core/testing/promise.h"
 #include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/compress.h"
 
 
 using nlohmann::json;
 using poolqueue::Promise;
 
 using sf::core::interface::MetaDataStoreRef;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsCompression;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsInputFile;
+using sf::ext::metadata::JsonFsIoThread;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsLoadProgress;
 using sf::ext::metadata::JsonFsStore;
 
 
@@ -32,6 +44,16 @@ class JsonFsStoreTest : public ::testing::Test {
   ~JsonFsStoreTest() {
     this->store.reset();
     close(this->tmp_fd_);
+    unlink(this->tmp_path_.c_str());
+  }
+
+  //! Runs the I/O event loop until the promise is settled.
+  void runLoop(JsonFsIoThreadRef io, Promise promise) {
+    while (!promise.settled()) {
+      struct pollfd event = {io->fd(), POLLIN, 0};
+      ASSERT_EQ(1, poll(&event, 1, 1000));
+      io->fetch();
+    }
   }
 
   json loadStore() {
@@ -43,6 +65,121 @@ class JsonFsStoreTest : public ::testing::Test {
 };
 
 
+TEST_F(JsonFsStoreTest, AsyncStoreThenGet) {
+  JsonFsIoThreadRef io = std::make_shared<JsonFsIoThread>("test-io");
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::JSON, io
+  );
+
+  // Nothing settles until the loop fetches from the I/O thread.
+  auto save = this->store->set("test", "42"_json);
+  ASSERT_FALSE(save.settled());
+  this->runLoop(io, save);
+  EXPECT_PROMISE_NO_THROW(save);
+
+  auto load = this->store->get("test").then([](json v) {
+    int value = v;
+    EXPECT_EQ(42, value);
+    return nullptr;
+  });
+  this->runLoop(io, load);
+  EXPECT_PROMISE_NO_THROW(load);
+  ASSERT_EQ(42, this->loadStore()["test"].get<int>());
+}
+
+TEST_F(JsonFsStoreTest, AsyncGetsAreServedWhileLoading) {
+  json data = json::object();
+  for (int index = 0; index < 5000; index++) {
+    data["key-" + std::to_string(index)] = index;
+  }
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  JsonFsIoThreadRef io = std::make_shared<JsonFsIoThread>("test-io");
+  auto store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::JSON, io
+  );
+  std::vector<size_t> progress;
+  store->loadProgress([&progress](const JsonFsLoadProgress& loaded) {
+    progress.push_back(loaded.keys);
+  });
+
+  // Gets issued before any key is loaded are parked.
+  auto found = store->get("key-42").then([](json value) {
+    EXPECT_EQ(42, value.get<int>());
+    return nullptr;
+  });
+  auto missing = store->get("missing").then([](json value) {
+    EXPECT_TRUE(value.is_null());
+    return nullptr;
+  });
+  ASSERT_FALSE(found.settled());
+  this->runLoop(io, missing);
+  EXPECT_PROMISE_NO_THROW(found);
+  EXPECT_PROMISE_NO_THROW(missing);
+  ASSERT_EQ(5000u, progress.back());
+}
+
+TEST_F(JsonFsStoreTest, AsyncIndexedStoreKeepsQueuedChanges) {
+  JsonFsIoThreadRef io = std::make_shared<JsonFsIoThread>("test-io");
+  auto store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::INDEXED, io
+  );
+  this->store = store;
+
+  // Queue several commits before any of them completes.
+  auto load = store->load();
+  this->runLoop(io, load);
+  auto first = this->store->set("a", "1"_json);
+  auto second = this->store->set("b", "2"_json);
+  auto third = this->store->erase("a");
+  this->runLoop(io, third);
+  ASSERT_TRUE(first.settled());
+  ASSERT_TRUE(second.settled());
+
+  json expected = {{"b", 2}};
+  ASSERT_EQ(expected, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsStoreTest, BatchEraseKeys) {
+  json data = {{"a", 1}, {"b", 2}, {"c", 3}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  auto store = std::make_shared<JsonFsStore>(this->tmp_path_);
+
+  auto erase = store->eraseMany({"a", "c", "missing"});
+  EXPECT_PROMISE_NO_THROW(erase);
+  ASSERT_TRUE(erase.settled());
+
+  json expected = {{"b", 2}};
+  ASSERT_EQ(expected, this->loadStore());
+}
+
+TEST_F(JsonFsStoreTest, BatchGetKeys) {
+  json data = {{"a", 1}, {"b", 2}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::JSON);
+  auto store = std::make_shared<JsonFsStore>(this->tmp_path_);
+
+  auto load = store->getMany({"a", "missing"}).then([](json values) {
+    json expected = {{"a", 1}, {"missing", nullptr}};
+    EXPECT_EQ(expected, values);
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(load);
+  ASSERT_TRUE(load.settled());
+}
+
+TEST_F(JsonFsStoreTest, BatchSetKeys) {
+  auto store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::INDEXED
+  );
+  std::map<std::string, json> values = {{"a", 1}, {"b", "two"}};
+
+  auto save = store->setMany(values);
+  EXPECT_PROMISE_NO_THROW(save);
+  ASSERT_TRUE(save.settled());
+
+  json expected = {{"a", 1}, {"b", "two"}};
+  ASSERT_EQ(expected, JsonFsCodec::Load(this->tmp_path_));
+}
+
 TEST_F(JsonFsStoreTest, EraseExistingKeyUpdatesFile) {
   // Store some data in our file.
   std::ofstream file(this->tmp_path_);
@@ -91,6 +228,141 @@ TEST_F(JsonFsStoreTest, StoreJson) {
   ASSERT_EQ("value", value);
 }
 
+TEST_F(JsonFsStoreTest, StoreInBinaryFormat) {
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::CBOR
+  );
+  auto save = this->store->set("key", "\"value\""_json);
+  EXPECT_PROMISE_NO_THROW(save);
+  ASSERT_TRUE(save.settled());
+
+  // Read the file back and check it was encoded.
+  std::ifstream file(this->tmp_path_, std::ios::binary);
+  ASSERT_EQ(JsonFsFormat::CBOR, JsonFsCodec::Detect(file));
+  json data = JsonFsCodec::Load(this->tmp_path_);
+  std::string value = data["key"];
+  ASSERT_EQ("value", value);
+}
+
+TEST_F(JsonFsStoreTest, StoreCompressed) {
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::JSON, JsonFsIoThreadRef(), false,
+      JsonFsCompression::ZSTD
+  );
+  auto save = this->store->set("key", "\"value\""_json);
+  EXPECT_PROMISE_NO_THROW(save);
+  ASSERT_TRUE(save.settled());
+
+  // Plain stores load compressed files.
+  JsonFsInputFile input(this->tmp_path_);
+  ASSERT_EQ(JsonFsCompression::ZSTD, input.compression());
+  JsonFsStore plain(this->tmp_path_);
+  auto get = plain.get("key").then([](json value) {
+    std::string result = value;
+    EXPECT_EQ("value", result);
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(get);
+  ASSERT_TRUE(get.resolved());
+}
+
+TEST_F(JsonFsStoreTest, StoreMigratesFormat) {
+  std::ofstream file(this->tmp_path_);
+  json data = {
+    {"key", "value"}
+  };
+  file << data;
+  file.close();
+
+  // Store a value with a binary store.
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::MSGPACK
+  );
+  auto save = this->store->set("other", "42"_json);
+  EXPECT_PROMISE_NO_THROW(save);
+  ASSERT_TRUE(save.settled());
+
+  // The existing keys are kept in the new format.
+  json store = JsonFsCodec::Load(this->tmp_path_);
+  std::string value = store["key"];
+  ASSERT_EQ("value", value);
+  ASSERT_EQ(42, store["other"].get<int>());
+}
+
+TEST_F(JsonFsStoreTest, IndexedStoreLoadsLazily) {
+  json data = {{"key", "value"}, {"other", 42}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::INDEXED);
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::INDEXED
+  );
+
+  auto load = this->store->get("other").then([](json v) {
+    int value = v;
+    EXPECT_EQ(42, value);
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(load);
+  ASSERT_TRUE(load.settled());
+}
+
+TEST_F(JsonFsStoreTest, IndexedStoreMergesChanges) {
+  json data = {{"a", 1}, {"b", 2}, {"c", 3}};
+  JsonFsCodec::Dump(this->tmp_path_, data, JsonFsFormat::INDEXED);
+  this->store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::INDEXED
+  );
+
+  auto change = this->store->erase("b").then([this]() {
+    return this->store->set("c", "33"_json);
+  }).then([this]() {
+    return this->store->set("d", "4"_json);
+  });
+  EXPECT_PROMISE_NO_THROW(change);
+  ASSERT_TRUE(change.settled());
+
+  json expected = {{"a", 1}, {"c", 33}, {"d", 4}};
+  ASSERT_EQ(expected, JsonFsCodec::Load(this->tmp_path_));
+}
+
+TEST_F(JsonFsStoreTest, ScanPrefix) {
+  auto store = std::make_shared<JsonFsStore>(this->tmp_path_);
+  auto scan = store->setMany({
+    {"node.a", 1}, {"node.b", 2}, {"nodes", 3}, {"other", 4}
+  }).then([store]() {
+    return store->scan("node.", 10)->next();
+  }).then([](json keys) {
+    EXPECT_EQ(json({{"node.a", 1}, {"node.b", 2}}), keys);
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(scan);
+}
+
+TEST_F(JsonFsStoreTest, ScanRangeOfIndexedStore) {
+  JsonFsCodec::Dump(this->tmp_path_, {{"a", 1}, {"b", 2}, {"c", 3}},
+      JsonFsFormat::JSON);
+  JsonFsCodec::Migrate(this->tmp_path_, JsonFsFormat::INDEXED);
+  auto store = std::make_shared<JsonFsStore>(
+      this->tmp_path_, JsonFsFormat::INDEXED
+  );
+
+  // Queued changes are merged with the mapped snapshot.
+  std::shared_ptr<json> found = std::make_shared<json>(json::object());
+  auto scan = store->erase("b").then([store]() {
+    return store->set("bb", 4);
+  }).then([store, found]() {
+    auto range = store->scan("a", "d", 2);
+    return range->next().then([range, found](json keys) {
+      found->update(keys);
+      return range->next();
+    }).then([found](json keys) {
+      found->update(keys);
+      return nullptr;
+    });
+  });
+  EXPECT_PROMISE_NO_THROW(scan);
+  ASSERT_EQ(json({{"a", 1}, {"bb", 4}, {"c", 3}}), *found);
+}
+
 TEST_F(JsonFsStoreTest, StoreThenGet) {
   auto save = this->store->set("test", "42"_json);
   EXPECT_PROMISE_NO_THROW(save);
@@ -0,0 +1,114 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include "ext/metadata/store/jsonfs/exceptions.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/loader.h"
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+using nlohmann::json;
+
+using sf::ext::exception::JsonFsCorruptStore;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsLoadProgress;
+using sf::ext::metadata::JsonFsLoader;
+using sf::ext::metadata::JsonFsTable;
+
+
+class JsonFsLoaderTest : public ::testing::Test {
+ protected:
+  int tmp_fd_;
+  std::string tmp_path_;
+  json data;
+
+ public:
+  JsonFsLoaderTest() {
+    char* path = strdup("tmp.sf-jsonfs.loader.XXXXXX");
+    this->tmp_fd_ = mkstemp(path);
+    this->tmp_path_ = std::string(path);
+    free(path);
+    this->data = {
+      {"a", 1},
+      {"b", {{"nested", {1, 2, {{"deep", true}}}}, {"empty", json::object()}}},
+      {"c", json::array()},
+      {"d", "text"},
+      {"e", 4.5}
+    };
+  }
+
+  ~JsonFsLoaderTest() {
+    close(this->tmp_fd_);
+    unlink(this->tmp_path_.c_str());
+  }
+
+  void write(std::string content) {
+    std::ofstream file(this->tmp_path_, std::ios::binary | std::ios::trunc);
+    file << content;
+  }
+
+  json load() {
+    JsonFsTable table;
+    JsonFsLoader(this->tmp_path_).load(&table);
+    return table.toJson();
+  }
+};
+
+
+TEST_F(JsonFsLoaderTest, LoadEmptyFile) {
+  ASSERT_EQ(json::object(), this->load());
+}
+
+TEST_F(JsonFsLoaderTest, LoadJson) {
+  JsonFsCodec::Dump(this->tmp_path_, this->data, JsonFsFormat::JSON);
+  ASSERT_EQ(this->data, this->load());
+}
+
+TEST_F(JsonFsLoaderTest, LoadCbor) {
+  JsonFsCodec::Dump(this->tmp_path_, this->data, JsonFsFormat::CBOR);
+  ASSERT_EQ(this->data, this->load());
+}
+
+TEST_F(JsonFsLoaderTest, LoadMsgPack) {
+  JsonFsCodec::Dump(this->tmp_path_, this->data, JsonFsFormat::MSGPACK);
+  ASSERT_EQ(this->data, this->load());
+}
+
+TEST_F(JsonFsLoaderTest, LoadIndexed) {
+  JsonFsCodec::Dump(this->tmp_path_, this->data, JsonFsFormat::INDEXED);
+  ASSERT_EQ(this->data, this->load());
+}
+
+TEST_F(JsonFsLoaderTest, LoadInBatches) {
+  JsonFsCodec::Dump(this->tmp_path_, this->data, JsonFsFormat::JSON);
+  std::vector<size_t> sizes;
+  JsonFsLoadProgress last = {0, 0, 0};
+  JsonFsLoader(this->tmp_path_, 2).load([&](
+      JsonFsLoader::Batch* batch, const JsonFsLoadProgress& progress
+  ) {
+    sizes.push_back(batch->size());
+    last = progress;
+  });
+  ASSERT_EQ(std::vector<size_t>({2, 2, 1}), sizes);
+  ASSERT_EQ(5u, last.keys);
+  ASSERT_EQ(last.total, last.bytes);
+  ASSERT_EQ(this->data.dump().size(), last.total);
+}
+
+TEST_F(JsonFsLoaderTest, RejectNonObjects) {
+  this->write("[1, 2, 3]");
+  ASSERT_THROW(this->load(), JsonFsCorruptStore);
+}
+
+TEST_F(JsonFsLoaderTest, RejectInvalidJson) {
+  this->write("{\"a\": 1,");
+  ASSERT_THROW(this->load(), JsonFsCorruptStore);
+}
@@ -0,0 +1,120 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/revision.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsIoThreadRef;
+using sf::ext::metadata::JsonFsRevisionLock;
+using sf::ext::metadata::JsonFsStore;
+
+
+class JsonFsRevisionTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+  std::string store_path_;
+
+ public:
+  JsonFsRevisionTest() {
+    char* path = strdup("tmp.sf-jsonfs.revision.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    this->store_path_ = this->tmp_dir_ + "/store";
+    free(path);
+  }
+
+  ~JsonFsRevisionTest() {
+    unlink(this->store_path_.c_str());
+    unlink(JsonFsRevisionLock::LockPath(this->store_path_).c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  std::shared_ptr<JsonFsStore> makeStore(
+      JsonFsFormat format = JsonFsFormat::JSON
+  ) {
+    return std::make_shared<JsonFsStore>(
+        this->store_path_, format, JsonFsIoThreadRef(), true
+    );
+  }
+
+  json get(std::shared_ptr<JsonFsStore> store, std::string key) {
+    json result;
+    auto get = store->get(key).then([&result](json value) {
+      result = value;
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(get);
+    return result;
+  }
+};
+
+
+TEST_F(JsonFsRevisionTest, NewLockIsAtRevisionZero) {
+  JsonFsRevisionLock lock(this->store_path_);
+  lock.lock(false);
+  ASSERT_EQ(0u, lock.revision());
+  lock.unlock();
+}
+
+TEST_F(JsonFsRevisionTest, RevisionIsSharedBetweenLocks) {
+  JsonFsRevisionLock writer(this->store_path_);
+  JsonFsRevisionLock reader(this->store_path_);
+  writer.lock(true);
+  writer.revision(42);
+  writer.unlock();
+  reader.lock(false);
+  ASSERT_EQ(42u, reader.revision());
+  reader.unlock();
+}
+
+TEST_F(JsonFsRevisionTest, WritesIncrementTheRevision) {
+  auto store = this->makeStore();
+  EXPECT_PROMISE_NO_THROW(store->set("a", 1));
+  EXPECT_PROMISE_NO_THROW(store->set("b", 2));
+  JsonFsRevisionLock lock(this->store_path_);
+  ASSERT_EQ(2u, lock.revision());
+}
+
+TEST_F(JsonFsRevisionTest, StoresSeeEachOtherWrites) {
+  auto first = this->makeStore();
+  auto second = this->makeStore();
+  EXPECT_PROMISE_NO_THROW(first->set("a", 1));
+  ASSERT_EQ(1, this->get(second, "a").get<int>());
+
+  EXPECT_PROMISE_NO_THROW(second->set("b", 2));
+  ASSERT_EQ(2, this->get(first, "b").get<int>());
+}
+
+TEST_F(JsonFsRevisionTest, WritesMergeOntoLatestRevision) {
+  auto first = this->makeStore(JsonFsFormat::INDEXED);
+  auto second = this->makeStore(JsonFsFormat::INDEXED);
+  ASSERT_TRUE(this->get(first, "a").is_null());
+  ASSERT_TRUE(this->get(second, "a").is_null());
+
+  // Both stores have a stale view when they write.
+  EXPECT_PROMISE_NO_THROW(first->set("a", 1));
+  EXPECT_PROMISE_NO_THROW(second->set("b", 2));
+  json data = JsonFsCodec::Load(this->store_path_);
+  ASSERT_EQ(json({{"a", 1}, {"b", 2}}), data);
+}
+
+TEST_F(JsonFsRevisionTest, ReadsSkipReloadAtSameRevision) {
+  auto store = this->makeStore();
+  EXPECT_PROMISE_NO_THROW(store->set("a", 1));
+
+  // Edits that do not move the revision are not seen.
+  JsonFsCodec::Dump(this->store_path_, {{"a", 2}}, JsonFsFormat::JSON);
+  ASSERT_EQ(1, this->get(store, "a").get<int>());
+}
@@ -0,0 +1,93 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs/scan.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsScan;
+
+
+class JsonFsScanTest : public ::testing::Test {
+ protected:
+  json data;
+  std::vector<size_t> limits;
+
+ public:
+  JsonFsScanTest() {
+    this->data = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}};
+  }
+
+  //! Returns a Fetch that reads from the test data.
+  JsonFsScan::Fetch fetch() {
+    return [this](
+        const std::string& from, bool inclusive,
+        const std::string& end, size_t limit
+    ) {
+      this->limits.push_back(limit);
+      json result = json::object();
+      for (auto it = this->data.begin(); it != this->data.end(); ++it) {
+        bool after = inclusive ? it.key() >= from : it.key() > from;
+        bool before = end.empty() || it.key() < end;
+        if (after && before && result.size() < limit) {
+          result[it.key()] = it.value();
+        }
+      }
+      return Promise().settle(result);
+    };
+  }
+
+  //! Returns the keys in the next batch of the scan.
+  std::vector<std::string> next(JsonFsScan* scan) {
+    std::vector<std::string> keys;
+    auto batch = scan->next().then([&keys](json values) {
+      for (auto it = values.begin(); it != values.end(); ++it) {
+        keys.push_back(it.key());
+      }
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(batch);
+    return keys;
+  }
+};
+
+
+TEST_F(JsonFsScanTest, PrefixEnd) {
+  ASSERT_EQ("", JsonFsScan::PrefixEnd(""));
+  ASSERT_EQ("b", JsonFsScan::PrefixEnd("a"));
+  ASSERT_EQ("ab", JsonFsScan::PrefixEnd("aa"));
+  ASSERT_EQ("b", JsonFsScan::PrefixEnd("a\xff"));
+  ASSERT_EQ("", JsonFsScan::PrefixEnd("\xff\xff"));
+}
+
+TEST_F(JsonFsScanTest, ScanInBatches) {
+  JsonFsScan scan(this->fetch(), "", "", 2);
+  ASSERT_EQ(std::vector<std::string>({"a", "b"}), this->next(&scan));
+  ASSERT_FALSE(scan.done());
+  ASSERT_EQ(std::vector<std::string>({"c", "d"}), this->next(&scan));
+  ASSERT_FALSE(scan.done());
+  ASSERT_EQ(std::vector<std::string>({"e"}), this->next(&scan));
+  ASSERT_TRUE(scan.done());
+  ASSERT_EQ(std::vector<std::string>(), this->next(&scan));
+  ASSERT_EQ(std::vector<size_t>({2, 2, 2}), this->limits);
+}
+
+TEST_F(JsonFsScanTest, ScanStopsAtEnd) {
+  JsonFsScan scan(this->fetch(), "b", "d", 10);
+  ASSERT_EQ(std::vector<std::string>({"b", "c"}), this->next(&scan));
+  ASSERT_TRUE(scan.done());
+}
+
+TEST_F(JsonFsScanTest, ScanEndsWithEmptyBatch) {
+  JsonFsScan scan(this->fetch(), "a", "c", 2);
+  ASSERT_EQ(std::vector<std::string>({"a", "b"}), this->next(&scan));
+  ASSERT_FALSE(scan.done());
+  ASSERT_EQ(std::vector<std::string>(), this->next(&scan));
+  ASSERT_TRUE(scan.done());
+}
@@ -0,0 +1,203 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs/format.h"
+#include "ext/metadata/store/jsonfs/revision.h"
+#include "ext/metadata/store/jsonfs/sharded.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsRevisionLock;
+using sf::ext::metadata::JsonFsShardedStore;
+
+
+const size_t SHARDS = 4;
+
+
+class JsonFsShardedStoreTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+  std::string store_path_;
+  std::shared_ptr<JsonFsShardedStore> store;
+
+ public:
+  JsonFsShardedStoreTest() {
+    char* path = strdup("tmp.sf-jsonfs.sharded.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    this->store_path_ = this->tmp_dir_ + "/store";
+    free(path);
+    this->store = std::make_shared<JsonFsShardedStore>(
+        this->store_path_, SHARDS
+    );
+  }
+
+  ~JsonFsShardedStoreTest() {
+    this->store.reset();
+    for (size_t index = 0; index < SHARDS; index++) {
+      std::string shard = JsonFsShardedStore::ShardPath(
+          this->store_path_, index
+      );
+      unlink(shard.c_str());
+      unlink(JsonFsRevisionLock::LockPath(shard).c_str());
+    }
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  json loadShard(std::string key) {
+    size_t index = JsonFsShardedStore::Hash(key) % SHARDS;
+    return JsonFsCodec::Load(
+        JsonFsShardedStore::ShardPath(this->store_path_, index)
+    );
+  }
+};
+
+
+TEST_F(JsonFsShardedStoreTest, ConcurrentWriters) {
+  std::vector<std::thread> writers;
+  for (int writer = 0; writer < 4; writer++) {
+    writers.push_back(std::thread([this, writer]() {
+      for (int index = 0; index < 25; index++) {
+        std::string key = std::to_string(writer) + "." + std::to_string(index);
+        auto save = this->store->set(key, json(index));
+        EXPECT_PROMISE_NO_THROW(save);
+      }
+    }));
+  }
+  for (auto& writer : writers) {
+    writer.join();
+  }
+
+  // All keys are in the shard that owns them.
+  for (int writer = 0; writer < 4; writer++) {
+    for (int index = 0; index < 25; index++) {
+      std::string key = std::to_string(writer) + "." + std::to_string(index);
+      ASSERT_EQ(index, this->loadShard(key)[key].get<int>());
+    }
+  }
+}
+
+TEST_F(JsonFsShardedStoreTest, ConcurrentSharedReads) {
+  auto writer = std::make_shared<JsonFsShardedStore>(
+      this->store_path_, SHARDS, JsonFsFormat::JSON, true
+  );
+  auto reader = std::make_shared<JsonFsShardedStore>(
+      this->store_path_, SHARDS, JsonFsFormat::JSON, true
+  );
+  for (int index = 0; index < 8; index++) {
+    auto save = writer->set("key." + std::to_string(index), json(0));
+    EXPECT_PROMISE_NO_THROW(save);
+  }
+
+  // Every write forces the readers to resync the shard.
+  std::vector<std::thread> threads;
+  threads.push_back(std::thread([writer]() {
+    for (int round = 1; round <= 25; round++) {
+      for (int index = 0; index < 8; index++) {
+        auto save = writer->set("key." + std::to_string(index), json(round));
+        EXPECT_PROMISE_NO_THROW(save);
+      }
+    }
+  }));
+  for (int thread = 0; thread < 4; thread++) {
+    threads.push_back(std::thread([reader]() {
+      for (int round = 0; round < 50; round++) {
+        std::string key = "key." + std::to_string(round % 8);
+        auto get = reader->get(key).then([](json value) {
+          EXPECT_TRUE(value.is_number_integer());
+          return nullptr;
+        });
+        EXPECT_PROMISE_NO_THROW(get);
+      }
+    }));
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  auto get = reader->get("key.7").then([](json value) {
+    EXPECT_EQ(25, value.get<int>());
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(get);
+}
+
+TEST_F(JsonFsShardedStoreTest, HashIsStable) {
+  ASSERT_EQ(0xcbf29ce484222325ULL, JsonFsShardedStore::Hash(""));
+  ASSERT_EQ(0xaf63dc4c8601ec8cULL, JsonFsShardedStore::Hash("a"));
+}
+
+TEST_F(JsonFsShardedStoreTest, ScanMergesShards) {
+  std::vector<std::string> keys;
+  for (int index = 0; index < 10; index++) {
+    this->store->set("key." + std::to_string(index), index);
+  }
+  this->store->set("other", 42);
+
+  auto scan = this->store->scan("key.", 3);
+  while (!scan->done()) {
+    auto batch = scan->next().then([&keys](json values) {
+      for (auto it = values.begin(); it != values.end(); ++it) {
+        keys.push_back(it.key());
+      }
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(batch);
+  }
+
+  ASSERT_EQ(10u, keys.size());
+  for (int index = 0; index < 10; index++) {
+    ASSERT_EQ("key." + std::to_string(index), keys[index]);
+  }
+}
+
+TEST_F(JsonFsShardedStoreTest, StoreOnlyWritesOwnerShard) {
+  auto save = this->store->set("key", "\"value\""_json);
+  EXPECT_PROMISE_NO_THROW(save);
+  ASSERT_TRUE(save.settled());
+
+  size_t owner = JsonFsShardedStore::Hash("key") % SHARDS;
+  for (size_t index = 0; index < SHARDS; index++) {
+    std::string shard = JsonFsShardedStore::ShardPath(
+        this->store_path_, index
+    );
+    ASSERT_EQ(index == owner, access(shard.c_str(), F_OK) == 0);
+  }
+  ASSERT_EQ("value", this->loadShard("key")["key"].get<std::string>());
+}
+
+TEST_F(JsonFsShardedStoreTest, StoreThenErase) {
+  auto change = this->store->set("key", "42"_json).then([this]() {
+    return this->store->erase("key");
+  }).then([this]() {
+    return this->store->get("key");
+  }).then([](json value) {
+    EXPECT_TRUE(value.is_null());
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(change);
+  ASSERT_TRUE(change.settled());
+}
+
+TEST_F(JsonFsShardedStoreTest, StoreThenGet) {
+  auto load = this->store->set("test", "42"_json).then([this]() {
+    return this->store->get("test");
+  }).then([](json v) {
+    int value = v;
+    EXPECT_EQ(42, value);
+    return nullptr;
+  });
+  EXPECT_PROMISE_NO_THROW(load);
+  ASSERT_TRUE(load.settled());
+}
@@ -0,0 +1,111 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <string>
+
+#include "ext/metadata/store/jsonfs/exceptions.h"
+#include "ext/metadata/store/jsonfs/snapshot.h"
+
+
+using nlohmann::json;
+
+using sf::ext::exception::JsonFsCorruptStore;
+using sf::ext::metadata::JsonFsSnapshot;
+using sf::ext::metadata::JsonFsSnapshotWriter;
+
+
+class JsonFsSnapshotTest : public ::testing::Test {
+ protected:
+  int tmp_fd_;
+  std::string tmp_path_;
+
+ public:
+  JsonFsSnapshotTest() {
+    char* path = strdup("tmp.sf-jsonfs.snapshot.XXXXXX");
+    this->tmp_fd_ = mkstemp(path);
+    this->tmp_path_ = std::string(path);
+    free(path);
+  }
+
+  ~JsonFsSnapshotTest() {
+    close(this->tmp_fd_);
+    unlink(this->tmp_path_.c_str());
+  }
+
+  void writeSample() {
+    JsonFsSnapshotWriter writer;
+    writer.add("a", "1"_json);
+    writer.add("b", "{\"nested\": [1, 2]}"_json);
+    writer.add("bb", "\"value\""_json);
+    writer.add("c", "null"_json);
+    writer.write(this->tmp_path_);
+  }
+};
+
+
+TEST_F(JsonFsSnapshotTest, CorruptHeader) {
+  std::ofstream file(this->tmp_path_);
+  file << "SFJI but not really";
+  file.close();
+  ASSERT_THROW(JsonFsSnapshot snapshot(this->tmp_path_), JsonFsCorruptStore);
+}
+
+TEST_F(JsonFsSnapshotTest, EmptyFile) {
+  JsonFsSnapshot snapshot(this->tmp_path_);
+  ASSERT_EQ(0, snapshot.count());
+  ASSERT_TRUE(snapshot.get("a").is_null());
+}
+
+TEST_F(JsonFsSnapshotTest, FindKeys) {
+  this->writeSample();
+  JsonFsSnapshot snapshot(this->tmp_path_);
+  ASSERT_EQ(4, snapshot.count());
+  ASSERT_EQ(0, snapshot.find("a"));
+  ASSERT_EQ(2, snapshot.find("bb"));
+  ASSERT_EQ(4, snapshot.find("ba"));
+  ASSERT_EQ(2, snapshot.lowerBound("ba"));
+  ASSERT_EQ(4, snapshot.lowerBound("d"));
+}
+
+TEST_F(JsonFsSnapshotTest, GetValues) {
+  this->writeSample();
+  JsonFsSnapshot snapshot(this->tmp_path_);
+  ASSERT_EQ(1, snapshot.get("a").get<int>());
+  ASSERT_EQ("value", snapshot.get("bb").get<std::string>());
+  ASSERT_EQ(2, snapshot.get("b")["nested"][1].get<int>());
+  ASSERT_TRUE(snapshot.get("missing").is_null());
+}
+
+TEST_F(JsonFsSnapshotTest, ToJson) {
+  this->writeSample();
+  JsonFsSnapshot snapshot(this->tmp_path_);
+  json expected = {
+    {"a", 1},
+    {"b", {{"nested", {1, 2}}}},
+    {"bb", "value"},
+    {"c", nullptr}
+  };
+  ASSERT_EQ(expected, snapshot.toJson());
+}
+
+TEST_F(JsonFsSnapshotTest, WriteBlobs) {
+  this->writeSample();
+  JsonFsSnapshot source(this->tmp_path_);
+
+  // Copy the raw blobs to a new snapshot.
+  JsonFsSnapshotWriter writer;
+  for (size_t index = 0; index < source.count(); index++) {
+    size_t size = 0;
+    const uint8_t* blob = source.blob(index, &size);
+    writer.add(source.key(index), blob, size);
+  }
+  writer.write(this->tmp_path_ + ".copy");
+
+  JsonFsSnapshot copy(this->tmp_path_ + ".copy");
+  unlink((this->tmp_path_ + ".copy").c_str());
+  ASSERT_EQ(source.toJson(), copy.toJson());
+}
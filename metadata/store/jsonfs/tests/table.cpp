@@ -0,0 +1,114 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "ext/metadata/store/jsonfs/table.h"
+
+
+using nlohmann::json;
+
+using sf::ext::metadata::JsonFsTable;
+
+
+TEST(JsonFsTableTest, EmptyTable) {
+  JsonFsTable table;
+  ASSERT_EQ(0u, table.count());
+  ASSERT_FALSE(table.contains("key"));
+  ASSERT_TRUE(table.get("key").is_null());
+  ASSERT_EQ(0u, table.lowerBound("key"));
+  ASSERT_EQ(json::object(), table.toJson());
+}
+
+TEST(JsonFsTableTest, FromJson) {
+  json data = {{"b", {1, 2}}, {"a", "value"}, {"c", nullptr}};
+  JsonFsTable table(data);
+  ASSERT_EQ(3u, table.count());
+  ASSERT_EQ("value", table.get("a").get<std::string>());
+  ASSERT_TRUE(table.contains("c"));
+  ASSERT_EQ(data, table.toJson());
+}
+
+TEST(JsonFsTableTest, SetReplacesValues) {
+  JsonFsTable table;
+  table.set("key", 1);
+  table.set("key", "two");
+  ASSERT_EQ(1u, table.count());
+  ASSERT_EQ("two", table.get("key").get<std::string>());
+}
+
+TEST(JsonFsTableTest, EraseKeys) {
+  JsonFsTable table;
+  table.set("a", 1);
+  table.set("b", 2);
+  ASSERT_TRUE(table.erase("a"));
+  ASSERT_FALSE(table.erase("a"));
+  ASSERT_FALSE(table.contains("a"));
+  ASSERT_EQ(json({{"b", 2}}), table.toJson());
+
+  // Erased slots can be reused.
+  table.set("a", 3);
+  ASSERT_EQ(json({{"a", 3}, {"b", 2}}), table.toJson());
+}
+
+TEST(JsonFsTableTest, KeysAreOrdered) {
+  JsonFsTable table;
+  table.set("c", 3);
+  table.set("a", 1);
+  table.set("b", 2);
+  ASSERT_EQ("a", table.key(0));
+  ASSERT_EQ("b", table.key(1));
+  ASSERT_EQ("c", table.key(2));
+  ASSERT_EQ(1u, table.lowerBound("b"));
+  ASSERT_EQ(2u, table.lowerBound("bb"));
+  ASSERT_EQ(2, table.value(1).get<int>());
+}
+
+TEST(JsonFsTableTest, KeysAddedAfterOrderedAccessAreMerged) {
+  JsonFsTable table;
+  table.set("d", 4);
+  table.set("b", 2);
+  ASSERT_EQ("b", table.key(0));
+  table.set("c", 3);
+  table.set("a", 1);
+  table.erase("d");
+  table.set("e", 5);
+  ASSERT_EQ(4u, table.count());
+  ASSERT_EQ("a", table.key(0));
+  ASSERT_EQ("b", table.key(1));
+  ASSERT_EQ("c", table.key(2));
+  ASSERT_EQ("e", table.key(3));
+}
+
+TEST(JsonFsTableTest, ManyKeysSurviveGrowthAndCompaction) {
+  JsonFsTable table;
+  for (int index = 0; index < 10000; index++) {
+    table.set("key-" + std::to_string(index), index);
+  }
+  for (int index = 0; index < 10000; index += 2) {
+    ASSERT_TRUE(table.erase("key-" + std::to_string(index)));
+  }
+  ASSERT_EQ(5000u, table.count());
+  for (int index = 0; index < 10000; index++) {
+    json value = table.get("key-" + std::to_string(index));
+    if (index % 2 == 0) {
+      ASSERT_TRUE(value.is_null());
+    } else {
+      ASSERT_EQ(index, value.get<int>());
+    }
+  }
+}
+
+TEST(JsonFsTableTest, ToCborMatchesEncoder) {
+  json data = {{"a", 1}, {"key", {{"nested", true}}}};
+  JsonFsTable table(data);
+  std::vector<uint8_t> expected = json::to_cbor(data);
+  std::string encoded = table.toCbor();
+  ASSERT_EQ(std::string(expected.begin(), expected.end()), encoded);
+}
+
+TEST(JsonFsTableTest, HashIsStable) {
+  ASSERT_EQ(0xcbf29ce484222325ULL, JsonFsTable::Hash(""));
+  ASSERT_EQ(0xaf63dc4c8601ec8cULL, JsonFsTable::Hash("a"));
+}
@@ -0,0 +1,179 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/view.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsScanRef;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsViewRef;
+
+
+class JsonFsViewTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+  std::string store_path_;
+  std::string dump_path_;
+
+ public:
+  JsonFsViewTest() {
+    char* path = strdup("tmp.sf-jsonfs.view.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    this->store_path_ = this->tmp_dir_ + "/store";
+    this->dump_path_ = this->tmp_dir_ + "/dump";
+    free(path);
+  }
+
+  ~JsonFsViewTest() {
+    unlink(this->store_path_.c_str());
+    unlink(this->dump_path_.c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  //! Creates a store with the keys a to e.
+  std::shared_ptr<JsonFsStore> make(JsonFsFormat format = JsonFsFormat::JSON) {
+    auto store = std::make_shared<JsonFsStore>(this->store_path_, format);
+    this->wait(store->setMany({
+        {"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}
+    }));
+    return store;
+  }
+
+  //! Returns the value of a key in the view.
+  json get(JsonFsViewRef view, std::string key) {
+    json result;
+    this->wait(view->get(key).then([&result](json value) {
+      result = value;
+      return nullptr;
+    }));
+    return result;
+  }
+
+  //! Returns all the keys and values read by the scan.
+  json read(JsonFsScanRef scan) {
+    json result = json::object();
+    while (!scan->done()) {
+      this->wait(scan->next().then([&result](json batch) {
+        for (auto it = batch.begin(); it != batch.end(); ++it) {
+          result[it.key()] = it.value();
+        }
+        return nullptr;
+      }));
+    }
+    return result;
+  }
+
+  //! Runs the promise to completion and checks it did not throw.
+  void wait(Promise promise) {
+    EXPECT_PROMISE_NO_THROW(promise);
+    ASSERT_TRUE(promise.settled());
+  }
+};
+
+
+TEST_F(JsonFsViewTest, GetIgnoresLaterChanges) {
+  auto store = this->make();
+  auto view = store->view();
+  this->wait(store->set("a", 10));
+  this->wait(store->erase("b"));
+  this->wait(store->set("f", 6));
+  ASSERT_EQ(json(1), this->get(view, "a"));
+  ASSERT_EQ(json(2), this->get(view, "b"));
+  ASSERT_EQ(json(3), this->get(view, "c"));
+  ASSERT_TRUE(this->get(view, "f").is_null());
+}
+
+TEST_F(JsonFsViewTest, OnlyChangedKeysArePreserved) {
+  auto store = this->make();
+  auto view = store->view();
+  ASSERT_EQ(0, view->preserved());
+  this->wait(store->set("a", 10));
+  this->wait(store->set("a", 11));
+  this->wait(store->set("f", 6));
+  ASSERT_EQ(2, view->preserved());
+  ASSERT_EQ(json(1), this->get(view, "a"));
+}
+
+TEST_F(JsonFsViewTest, ScanSeesKeysAtViewTime) {
+  auto store = this->make();
+  auto view = store->view();
+  this->wait(store->erase("b"));
+  this->wait(store->erase("c"));
+  this->wait(store->set("bb", 0));
+  this->wait(store->set("d", 40));
+  this->wait(store->set("z", 0));
+  json expected = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}};
+  ASSERT_EQ(expected, this->read(view->scan("", "", 2)));
+  ASSERT_EQ(json({{"b", 2}, {"c", 3}}), this->read(view->scan("b", "d", 1)));
+}
+
+TEST_F(JsonFsViewTest, ViewsAreIndependent) {
+  auto store = this->make();
+  auto first = store->view();
+  this->wait(store->set("a", 10));
+  auto second = store->view();
+  this->wait(store->set("a", 20));
+  ASSERT_EQ(json(1), this->get(first, "a"));
+  ASSERT_EQ(json(10), this->get(second, "a"));
+}
+
+TEST_F(JsonFsViewTest, IndexedStoresPreserveSnapshotValues) {
+  this->make(JsonFsFormat::INDEXED);
+  auto store = std::make_shared<JsonFsStore>(
+      this->store_path_, JsonFsFormat::INDEXED
+  );
+  auto view = store->view();
+  this->wait(store->erase("a"));
+  this->wait(store->set("b", 20));
+  json expected = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}};
+  ASSERT_EQ(expected, this->read(view->scan("")));
+}
+
+TEST_F(JsonFsViewTest, RefreshPreservesChangedKeys) {
+  auto store = this->make();
+  auto view = store->view();
+  {
+    std::ofstream file(this->store_path_);
+    file << R"({"a": 10, "f": 6})";
+  }
+  this->wait(store->refresh());
+  json expected = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}};
+  ASSERT_EQ(expected, this->read(view->scan("")));
+}
+
+TEST_F(JsonFsViewTest, DumpInAllFormats) {
+  auto store = this->make();
+  auto view = store->view();
+  this->wait(store->set("a", 10));
+  json expected = {{"a", 1}, {"b", 2}, {"c", 3}, {"d", 4}, {"e", 5}};
+  std::vector<JsonFsFormat> formats = {
+    JsonFsFormat::JSON, JsonFsFormat::CBOR,
+    JsonFsFormat::MSGPACK, JsonFsFormat::INDEXED
+  };
+  for (JsonFsFormat format : formats) {
+    this->wait(view->dump(this->dump_path_, format));
+    ASSERT_EQ(expected, JsonFsCodec::Load(this->dump_path_));
+  }
+}
+
+TEST_F(JsonFsViewTest, DumpEmptyView) {
+  auto store = std::make_shared<JsonFsStore>(this->store_path_);
+  auto view = store->view();
+  this->wait(view->dump(this->dump_path_, JsonFsFormat::CBOR));
+  ASSERT_EQ(json::object(), JsonFsCodec::Load(this->dump_path_));
+}
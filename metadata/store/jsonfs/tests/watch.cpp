@@ -0,0 +1,147 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/jsonfs/watch.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::metadata::JsonFsChange;
+using sf::ext::metadata::JsonFsCodec;
+using sf::ext::metadata::JsonFsFormat;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::JsonFsWatchList;
+using sf::ext::metadata::JsonFsWatcher;
+
+
+class JsonFsWatchTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+  std::string store_path_;
+  std::shared_ptr<JsonFsStore> store;
+  std::vector<JsonFsChange> changes;
+
+ public:
+  JsonFsWatchTest() {
+    char* path = strdup("tmp.sf-jsonfs.watch.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    this->store_path_ = this->tmp_dir_ + "/store.json";
+    free(path);
+    this->store = std::make_shared<JsonFsStore>(this->store_path_);
+  }
+
+  ~JsonFsWatchTest() {
+    this->store.reset();
+    unlink(this->store_path_.c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  //! Returns a callback that collects changes.
+  std::function<void(const JsonFsChange&)> collect() {
+    return [this](const JsonFsChange& change) {
+      this->changes.push_back(change);
+    };
+  }
+
+  //! Runs the promise to completion and checks it did not throw.
+  void wait(Promise promise) {
+    EXPECT_PROMISE_NO_THROW(promise);
+    ASSERT_TRUE(promise.settled());
+  }
+};
+
+
+TEST_F(JsonFsWatchTest, ChangesAreCoalesced) {
+  JsonFsWatchList watches;
+  watches.add("a", false, this->collect());
+  watches.record("a", 1);
+  auto first = watches.begin();
+  watches.record("a", 2);
+  auto second = watches.begin();
+
+  // Nothing is delivered until the last commit is written.
+  watches.end(first, true);
+  ASSERT_EQ(0u, this->changes.size());
+  watches.end(second, true);
+  ASSERT_EQ(1u, this->changes.size());
+  ASSERT_EQ(2, this->changes[0].value.get<int>());
+  ASSERT_EQ(1u, this->changes[0].revision);
+}
+
+TEST_F(JsonFsWatchTest, FailedCommitsAreNotDelivered) {
+  JsonFsWatchList watches;
+  watches.add("a", false, this->collect());
+  watches.record("a", 1);
+  watches.end(watches.begin(), false);
+  ASSERT_EQ(0u, this->changes.size());
+  ASSERT_EQ(0u, watches.revision());
+}
+
+TEST_F(JsonFsWatchTest, WatchKey) {
+  this->store->watch("key", this->collect());
+  this->wait(this->store->set("key", 1));
+  this->wait(this->store->set("key.child", 2));
+  this->wait(this->store->erase("key"));
+
+  ASSERT_EQ(2u, this->changes.size());
+  ASSERT_EQ(1, this->changes[0].value.get<int>());
+  ASSERT_TRUE(this->changes[1].value.is_null());
+  ASSERT_LT(this->changes[0].revision, this->changes[1].revision);
+}
+
+TEST_F(JsonFsWatchTest, WatchPrefix) {
+  this->store->watchPrefix("node.", this->collect());
+  this->wait(this->store->setMany({{"node.a", 1}, {"node.b", 2}, {"x", 3}}));
+
+  ASSERT_EQ(2u, this->changes.size());
+  ASSERT_EQ("node.a", this->changes[0].key);
+  ASSERT_EQ("node.b", this->changes[1].key);
+  ASSERT_EQ(this->changes[0].revision, this->changes[1].revision);
+}
+
+TEST_F(JsonFsWatchTest, Unwatch) {
+  uint64_t id = this->store->watch("key", this->collect());
+  this->store->unwatch(id);
+  this->wait(this->store->set("key", 1));
+  ASSERT_EQ(0u, this->changes.size());
+}
+
+TEST_F(JsonFsWatchTest, RefreshIgnoresOwnWrites) {
+  this->store->watchPrefix("", this->collect());
+  this->wait(this->store->set("key", 1));
+  this->changes.clear();
+  this->wait(this->store->refresh());
+  ASSERT_EQ(0u, this->changes.size());
+}
+
+TEST_F(JsonFsWatchTest, WatcherDetectsExternalEdits) {
+  auto watcher = std::make_shared<JsonFsWatcher>("test-watch", this->store);
+  this->store->watchPrefix("", this->collect());
+  this->wait(this->store->setMany({{"a", 1}, {"b", 2}}));
+  this->changes.clear();
+
+  // Replace the file as another process would.
+  JsonFsCodec::Dump(
+      this->store_path_, {{"a", 1}, {"c", 3}}, JsonFsFormat::CBOR
+  );
+  struct pollfd event = {watcher->fd(), POLLIN, 0};
+  ASSERT_EQ(1, poll(&event, 1, 1000));
+  watcher->fetch();
+
+  ASSERT_EQ(2u, this->changes.size());
+  ASSERT_EQ("b", this->changes[0].key);
+  ASSERT_TRUE(this->changes[0].value.is_null());
+  ASSERT_EQ("c", this->changes[1].key);
+  ASSERT_EQ(3, this->changes[1].value.get<int>());
+}
@@ -0,0 +1,130 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_LMDB_H_
+#define EXT_METADATA_STORE_LMDB_H_
+
+#include <lmdb.h>
+#include <stdint.h>
+
+#include <chrono>
+#include <functional>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "core/interface/metadata/store.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Metadata store backed by an LMDB database file.
+  /*!
+   * Keys are stored in an LMDB B-tree so writes only touch the
+   * pages along the path to the key and their cost does not grow
+   * with the size of the store.
+   * Readers use LMDB's MVCC snapshots and never block the writer.
+   *
+   * Values are stored as:
+   *
+   *    expiry (u64, big-endian seconds since epoch, 0 = never) | CBOR
+   *
+   * Keys with a TTL are also added to an expiry index, keyed by
+   * expiry time and then key, so expired keys can be found without
+   * scanning the whole store.
+   * Expired keys are never returned and are purged a few at a time
+   * by every write, or all at once with expire().
+   *
+   * All operations run on the calling thread and the returned
+   * promises are already settled.
+   *
+   * LMDB limits the size of keys (511 bytes by default) and the
+   * expiry index prefixes them with 8 bytes, so keys must be
+   * between 1 and maxKeySize() bytes long.
+   * Operations on other keys are rejected with LmdbInvalidKey.
+   */
+  class LmdbStore : public sf::core::interface::MetaDataStore {
+   public:
+    //! Default maximum size of the database, in bytes.
+    static const size_t DEFAULT_MAP_SIZE;
+
+    //! Maximum number of expired keys purged by each write.
+    static const size_t EXPIRE_BATCH;
+
+   protected:
+    std::string path_;
+    MDB_env* env_;
+    MDB_dbi data_;
+    MDB_dbi expiry_;
+    size_t max_key_size_;
+
+    //! Returns the current time in seconds since the epoch.
+    virtual uint64_t now() const;
+
+    //! Runs a read only transaction.
+    nlohmann::json read(std::function<nlohmann::json(MDB_txn*)> work);
+
+    //! Runs a write transaction, purging some expired keys first.
+    void write(std::function<void(MDB_txn*)> work);
+
+    //! Throws LmdbInvalidKey if the key can't be stored.
+    void checkKey(const std::string& key) const;
+
+    //! Returns the value of the key or null if missing or expired.
+    nlohmann::json lookup(MDB_txn* txn, const std::string& key);
+
+    //! Removes a key and its expiry, if any.
+    void eraseKey(MDB_txn* txn, const std::string& key);
+
+    //! Sets a key, expires is 0 for keys that never expire.
+    void setKey(
+        MDB_txn* txn, const std::string& key, const nlohmann::json& value,
+        uint64_t expires
+    );
+
+    //! Removes up to limit expired keys, returns the number removed.
+    size_t purge(MDB_txn* txn, size_t limit);
+
+   public:
+    explicit LmdbStore(std::string path, size_t map_size = DEFAULT_MAP_SIZE);
+    ~LmdbStore();
+
+    LmdbStore(const LmdbStore&) = delete;
+    LmdbStore& operator=(const LmdbStore&) = delete;
+
+    //! Returns the path of the database file.
+    std::string path() const;
+
+    //! Returns the maximum size of keys, in bytes.
+    size_t maxKeySize() const;
+
+    //! Removes all expired keys, returns the number removed.
+    size_t expire();
+
+    poolqueue::Promise erase(std::string key);
+    poolqueue::Promise get(std::string key);
+    poolqueue::Promise set(std::string key, nlohmann::json value);
+    poolqueue::Promise set(
+        std::string key, nlohmann::json value,
+        std::chrono::duration<int> ttl
+    );
+
+    //! Erases all the keys in a single transaction.
+    poolqueue::Promise eraseMany(std::vector<std::string> keys);
+
+    //! Resolves to an object with the value of each key.
+    /*!
+     * Missing keys are included with a null value.
+     * All keys are read from the same snapshot.
+     */
+    poolqueue::Promise getMany(std::vector<std::string> keys);
+
+    //! Sets all the key/value pairs in a single transaction.
+    poolqueue::Promise setMany(std::map<std::string, nlohmann::json> values);
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_LMDB_H_
@@ -0,0 +1,36 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_LMDB_CONFIG_H_
+#define EXT_METADATA_STORE_LMDB_CONFIG_H_
+
+#include <string>
+
+#include "core/interface/config/node.h"
+
+
+namespace sf {
+namespace ext {
+namespace metadata {
+
+  //! Optional settings of LmdbStore intents.
+  struct LmdbStoreOptions {
+    //! Maximum size of the database, in bytes.
+    size_t map_size;
+
+    LmdbStoreOptions();
+  };
+
+
+  //! Configuration options for LmdbStore.
+  class LmdbStoreConfig {
+   public:
+    static void AttachLuaInit();
+    static sf::core::interface::NodeConfigIntentRef MakeIntent(
+        std::string path, LmdbStoreOptions options = LmdbStoreOptions()
+    );
+  };
+
+}  // namespace metadata
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_LMDB_CONFIG_H_
@@ -0,0 +1,41 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_METADATA_STORE_LMDB_EXCEPTIONS_H_
+#define EXT_METADATA_STORE_LMDB_EXCEPTIONS_H_
+
+#include <string>
+
+#include "core/exceptions/base.h"
+
+
+namespace sf {
+namespace ext {
+namespace exception {
+
+  //! Wrapper exception for LMDB errors.
+  class LmdbException : public sf::core::exception::SfException {
+   protected:
+    int lmdb_code;
+
+   public:
+    LmdbException(int code, std::string action);
+    int getCode() const;
+
+    //! Returns the LMDB (or errno) error code.
+    int lmdbCode() const;
+
+   public:
+    //! Throws an LmdbException if the code is an error.
+    static void checkLmdbError(int code, std::string action);
+  };
+
+  //! Thrown when a value in an LMDB store cannot be decoded.
+  MSG_EXCEPTION(sf::core::exception::SfException, LmdbCorruptStore);
+
+  //! Thrown when a key is empty or too long for an LMDB store.
+  MSG_EXCEPTION(sf::core::exception::SfException, LmdbInvalidKey);
+
+}  // namespace exception
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_METADATA_STORE_LMDB_EXCEPTIONS_H_
@@ -0,0 +1,196 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/lmdb/config.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/cluster/cluster.h"
+#include "core/context/context.h"
+#include "core/context/static.h"
+#include "core/exceptions/configuration.h"
+
+#include "core/interface/config/node.h"
+#include "core/interface/config/node/hooks.h"
+#include "core/interface/metadata/store.h"
+#include "core/interface/posix.h"
+
+#include "core/utility/lua.h"
+
+#include "ext/metadata/store/lmdb.h"
+
+
+using sf::core::cluster::Cluster;
+using sf::core::cluster::ClusterRaw;
+
+using sf::core::context::Static;
+using sf::core::context::ContextRef;
+using sf::core::exception::InvalidConfiguration;
+using sf::core::hook::NodeConfig;
+
+using sf::core::interface::MetaDataStoreRef;
+using sf::core::interface::NodeConfigIntent;
+using sf::core::interface::NodeConfigIntentRef;
+using sf::core::interface::NodeConfigIntentLuaProxy;
+using sf::core::interface::Posix;
+
+using sf::core::utility::Lua;
+using sf::core::utility::LuaArguments;
+using sf::core::utility::LuaTable;
+
+using sf::ext::metadata::LmdbStore;
+using sf::ext::metadata::LmdbStoreConfig;
+using sf::ext::metadata::LmdbStoreOptions;
+
+
+//! Verify and configure LmdbStore.
+class LmdbStoreIntent : public NodeConfigIntent {
+ protected:
+  std::string path_;
+  LmdbStoreOptions options_;
+
+  //! Creates the store described by the intent.
+  MetaDataStoreRef makeStore() {
+    return std::make_shared<LmdbStore>(this->path_, this->options_.map_size);
+  }
+
+ public:
+  LmdbStoreIntent(std::string path, LmdbStoreOptions options)
+    : NodeConfigIntent("lmdb") {
+    this->path_ = path;
+    this->options_ = options;
+  }
+
+  virtual std::vector<std::string> depends() const {
+    return std::vector<std::string>();
+  }
+
+  virtual std::string provides() const {
+    return "core.metadata";
+  }
+
+  virtual void apply(ContextRef context) {
+    context->initialise(this->makeStore());
+  }
+
+  virtual void verify(ContextRef context) {
+    struct stat file_stats;
+    auto posix = Static::posix();
+    int file_exists = 0;
+
+    // Test path is not a directory or does not exit.
+    file_exists = posix->stat(this->path_.c_str(), &file_stats);
+    if (file_exists == 0 && S_ISDIR(file_stats.st_mode)) {
+      throw InvalidConfiguration(
+          "LMDB store should be a file, got a directory"
+      );
+    }
+
+    // Test path exists (at least directory).
+    char* path = strdup(this->path_.c_str());
+    char* dir  = posix->dirname(path);
+    file_exists = posix->stat(dir, &file_stats);
+    free(path);
+    if (file_exists < 0 || !S_ISDIR(file_stats.st_mode)) {
+      throw InvalidConfiguration(
+          "LMDB store dirname does not exist or is not a directory"
+      );
+    }
+  }
+};
+
+
+// TODO(stefano): Remove this as soon as the config refactoring is done.
+class LmdbClusterStoreIntent : public LmdbStoreIntent {
+ public:
+  LmdbClusterStoreIntent(std::string path, LmdbStoreOptions options)
+    : LmdbStoreIntent(path, options) {
+    // NOOP
+  }
+  virtual std::string provides() const {
+    return "cluster.metadata";
+  }
+
+  virtual void apply(ContextRef context) {
+    Cluster cluster = std::make_shared<ClusterRaw>(this->makeStore());
+    Cluster::Instance(cluster);
+  }
+};
+
+
+//! Returns the optional store settings, with defaults for missing keys.
+LmdbStoreOptions lua_lmdb_options(lua_State* state, LuaTable* table) {
+  LmdbStoreOptions options;
+  lua_getfield(state, 1, "map_size");
+  bool has_map_size = !lua_isnil(state, -1);
+  lua_pop(state, 1);
+
+  // The map size is given in MiB to keep configs readable.
+  if (has_map_size) {
+    int map_size = table->toInt("map_size");
+    if (map_size < 1) {
+      throw InvalidConfiguration("LMDB map_size must be at least 1 MiB");
+    }
+    options.map_size = static_cast<size_t>(map_size) * 1024 * 1024;
+  }
+  return options;
+}
+
+
+//! Returns a NodeConfigIntent to build an LmdbStore.
+int lua_lmdb_intent(lua_State* state) {
+  NodeConfigIntentLuaProxy type;
+  Lua* lua = Lua::fetchFrom(state);
+
+  // Process argument.
+  LuaArguments args(lua);
+  LuaTable options = args.table(1);
+  std::string path = options.toString("store");
+  LmdbStoreOptions settings = lua_lmdb_options(state, &options);
+
+  // Create and return the intent.
+  auto intent = LmdbStoreConfig::MakeIntent(path, settings);
+  type.wrap(*lua, intent);
+  return 1;
+}
+
+//! Returns a NodeConfigIntent to build an LmdbStore for cluster metadata.
+// TODO(stefano): Remove this as soon as the config refactoring is done.
+int lua_lmdb_cluster_intent(lua_State* state) {
+  NodeConfigIntentLuaProxy type;
+  Lua* lua = Lua::fetchFrom(state);
+
+  // Process argument.
+  LuaArguments args(lua);
+  LuaTable options = args.table(1);
+  std::string path = options.toString("store");
+  LmdbStoreOptions settings = lua_lmdb_options(state, &options);
+
+  // Create and return the intent.
+  auto intent = std::make_shared<LmdbClusterStoreIntent>(path, settings);
+  type.wrap(*lua, intent);
+  return 1;
+}
+
+
+void LmdbStoreConfig::AttachLuaInit() {
+  NodeConfig::LuaInit.attach([](Lua lua) {
+    auto globals = lua.globals();
+    auto metastores = globals->toTable("metastores");
+    metastores.set("lmdb", lua_lmdb_intent);
+
+    // TODO(stefano): Remove this as soon as the config refactoring is done.
+    metastores.set("lmdb_cluster", lua_lmdb_cluster_intent);
+  });
+}
+
+LmdbStoreOptions::LmdbStoreOptions() {
+  this->map_size = LmdbStore::DEFAULT_MAP_SIZE;
+}
+
+
+NodeConfigIntentRef LmdbStoreConfig::MakeIntent(
+    std::string path, LmdbStoreOptions options
+) {
+  return std::make_shared<LmdbStoreIntent>(path, options);
+}
@@ -0,0 +1,49 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/lmdb/exceptions.h"
+
+#include <lmdb.h>
+#include <string>
+
+using sf::core::exception::SfException;
+using sf::ext::exception::LmdbCorruptStore;
+using sf::ext::exception::LmdbException;
+using sf::ext::exception::LmdbInvalidKey;
+
+
+LmdbException::LmdbException(int code, std::string action) : SfException(
+  "LMDB error while trying to " + action + ": " + mdb_strerror(code)
+) {
+  this->lmdb_code = code;
+}
+
+int LmdbException::getCode() const {
+  return -4300;
+}
+
+int LmdbException::lmdbCode() const {
+  return this->lmdb_code;
+}
+
+void LmdbException::checkLmdbError(int code, std::string action) {
+  if (code != MDB_SUCCESS) {
+    throw LmdbException(code, action);
+  }
+}
+
+
+LmdbCorruptStore::LmdbCorruptStore(std::string key) : SfException(
+  "Corrupt value for key '" + key + "' in LMDB store"
+) { }
+
+int LmdbCorruptStore::getCode() const {
+  return -4301;
+}
+
+
+LmdbInvalidKey::LmdbInvalidKey(std::string reason) : SfException(
+  "Invalid key for LMDB store: " + reason
+) { }
+
+int LmdbInvalidKey::getCode() const {
+  return -4302;
+}
@@ -0,0 +1,414 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/metadata/store/lmdb.h"
+
+#include <lmdb.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <chrono>
+#include <exception>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "ext/metadata/store/lmdb/exceptions.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::exception::LmdbCorruptStore;
+using sf::ext::exception::LmdbException;
+using sf::ext::exception::LmdbInvalidKey;
+using sf::ext::metadata::LmdbStore;
+
+
+const size_t LmdbStore::DEFAULT_MAP_SIZE = 1024UL * 1024 * 1024;
+const size_t LmdbStore::EXPIRE_BATCH = 64;
+
+//! Size of the expiry prefix of values and expiry index keys.
+static const size_t EXPIRY_SIZE = sizeof(uint64_t);
+
+
+//! Aborts the transaction unless it was committed.
+class LmdbTxn {
+ protected:
+  MDB_txn* txn_;
+
+ public:
+  LmdbTxn(MDB_env* env, unsigned int flags) {
+    this->txn_ = nullptr;
+    LmdbException::checkLmdbError(
+        mdb_txn_begin(env, nullptr, flags, &this->txn_), "begin transaction"
+    );
+  }
+
+  ~LmdbTxn() {
+    if (this->txn_ != nullptr) {
+      mdb_txn_abort(this->txn_);
+    }
+  }
+
+  MDB_txn* get() {
+    return this->txn_;
+  }
+
+  void commit() {
+    int code = mdb_txn_commit(this->txn_);
+    this->txn_ = nullptr;
+    LmdbException::checkLmdbError(code, "commit transaction");
+  }
+};
+
+
+//! Closes the cursor when it goes out of scope.
+class LmdbCursor {
+ protected:
+  MDB_cursor* cursor_;
+
+ public:
+  LmdbCursor(MDB_txn* txn, MDB_dbi dbi) {
+    this->cursor_ = nullptr;
+    LmdbException::checkLmdbError(
+        mdb_cursor_open(txn, dbi, &this->cursor_), "open cursor"
+    );
+  }
+
+  ~LmdbCursor() {
+    mdb_cursor_close(this->cursor_);
+  }
+
+  MDB_cursor* get() {
+    return this->cursor_;
+  }
+};
+
+
+//! Encodes a u64 as 8 big-endian bytes so it sorts as bytes.
+static void encode_expiry(uint64_t expires, uint8_t* buffer) {
+  for (size_t index = 0; index < EXPIRY_SIZE; index++) {
+    buffer[EXPIRY_SIZE - index - 1] = (expires >> (index * 8)) & 0xff;
+  }
+}
+
+static uint64_t decode_expiry(const uint8_t* buffer) {
+  uint64_t expires = 0;
+  for (size_t index = 0; index < EXPIRY_SIZE; index++) {
+    expires = (expires << 8) | buffer[index];
+  }
+  return expires;
+}
+
+//! Returns the expiry index key for a key.
+static std::vector<uint8_t> expiry_key(
+    uint64_t expires, const std::string& key
+) {
+  std::vector<uint8_t> buffer(EXPIRY_SIZE + key.size());
+  encode_expiry(expires, buffer.data());
+  memcpy(buffer.data() + EXPIRY_SIZE, key.data(), key.size());
+  return buffer;
+}
+
+static MDB_val make_val(const void* data, size_t size) {
+  MDB_val val;
+  val.mv_data = const_cast<void*>(data);
+  val.mv_size = size;
+  return val;
+}
+
+//! Returns the expiry of a stored value, checking its size.
+static uint64_t value_expiry(const std::string& key, const MDB_val& value) {
+  if (value.mv_size < EXPIRY_SIZE) {
+    throw LmdbCorruptStore(key);
+  }
+  return decode_expiry(static_cast<const uint8_t*>(value.mv_data));
+}
+
+
+uint64_t LmdbStore::now() const {
+  auto now = std::chrono::system_clock::now().time_since_epoch();
+  return std::chrono::duration_cast<std::chrono::seconds>(now).count();
+}
+
+json LmdbStore::read(std::function<json(MDB_txn*)> work) {
+  LmdbTxn txn(this->env_, MDB_RDONLY);
+  return work(txn.get());
+}
+
+void LmdbStore::write(std::function<void(MDB_txn*)> work) {
+  LmdbTxn txn(this->env_, 0);
+  this->purge(txn.get(), LmdbStore::EXPIRE_BATCH);
+  work(txn.get());
+  txn.commit();
+}
+
+void LmdbStore::checkKey(const std::string& key) const {
+  if (key.empty()) {
+    throw LmdbInvalidKey("keys can't be empty");
+  }
+  if (key.size() > this->max_key_size_) {
+    throw LmdbInvalidKey(
+        "key of " + std::to_string(key.size()) + " bytes is longer than " +
+        std::to_string(this->max_key_size_) + " bytes"
+    );
+  }
+}
+
+json LmdbStore::lookup(MDB_txn* txn, const std::string& key) {
+  this->checkKey(key);
+  MDB_val name = make_val(key.data(), key.size());
+  MDB_val value;
+  int code = mdb_get(txn, this->data_, &name, &value);
+  if (code == MDB_NOTFOUND) {
+    return nullptr;
+  }
+  LmdbException::checkLmdbError(code, "get key");
+
+  // Expired keys are missing, even if not purged yet.
+  uint64_t expires = value_expiry(key, value);
+  if (expires != 0 && expires <= this->now()) {
+    return nullptr;
+  }
+  const uint8_t* data = static_cast<const uint8_t*>(value.mv_data);
+  try {
+    return json::from_cbor(data + EXPIRY_SIZE, data + value.mv_size);
+  } catch (json::exception&) {
+    throw LmdbCorruptStore(key);
+  }
+}
+
+void LmdbStore::eraseKey(MDB_txn* txn, const std::string& key) {
+  this->checkKey(key);
+  MDB_val name = make_val(key.data(), key.size());
+  MDB_val value;
+  int code = mdb_get(txn, this->data_, &name, &value);
+  if (code == MDB_NOTFOUND) {
+    return;
+  }
+  LmdbException::checkLmdbError(code, "get key");
+
+  // Drop the expiry index entry before the value.
+  uint64_t expires = value_expiry(key, value);
+  if (expires != 0) {
+    std::vector<uint8_t> index = expiry_key(expires, key);
+    MDB_val index_key = make_val(index.data(), index.size());
+    code = mdb_del(txn, this->expiry_, &index_key, nullptr);
+    if (code != MDB_NOTFOUND) {
+      LmdbException::checkLmdbError(code, "erase expiry");
+    }
+  }
+  LmdbException::checkLmdbError(
+      mdb_del(txn, this->data_, &name, nullptr), "erase key"
+  );
+}
+
+void LmdbStore::setKey(
+    MDB_txn* txn, const std::string& key, const json& value, uint64_t expires
+) {
+  this->eraseKey(txn, key);
+  std::vector<uint8_t> encoded = json::to_cbor(value);
+  std::vector<uint8_t> buffer(EXPIRY_SIZE + encoded.size());
+  encode_expiry(expires, buffer.data());
+  memcpy(buffer.data() + EXPIRY_SIZE, encoded.data(), encoded.size());
+
+  MDB_val name = make_val(key.data(), key.size());
+  MDB_val data = make_val(buffer.data(), buffer.size());
+  LmdbException::checkLmdbError(
+      mdb_put(txn, this->data_, &name, &data, 0), "set key"
+  );
+  if (expires != 0) {
+    std::vector<uint8_t> index = expiry_key(expires, key);
+    MDB_val index_key = make_val(index.data(), index.size());
+    MDB_val empty = make_val("", 0);
+    LmdbException::checkLmdbError(
+        mdb_put(txn, this->expiry_, &index_key, &empty, 0), "set expiry"
+    );
+  }
+}
+
+size_t LmdbStore::purge(MDB_txn* txn, size_t limit) {
+  LmdbCursor cursor(txn, this->expiry_);
+  uint64_t now = this->now();
+  size_t purged = 0;
+  MDB_val index_key;
+  MDB_val empty;
+
+  // The index is sorted by expiry so stop at the first live key.
+  int code = mdb_cursor_get(cursor.get(), &index_key, &empty, MDB_FIRST);
+  while (code == MDB_SUCCESS && purged < limit) {
+    if (index_key.mv_size < EXPIRY_SIZE) {
+      throw LmdbCorruptStore("<expiry index>");
+    }
+    const uint8_t* data = static_cast<const uint8_t*>(index_key.mv_data);
+    if (decode_expiry(data) > now) {
+      return purged;
+    }
+    std::string key(
+        reinterpret_cast<const char*>(data) + EXPIRY_SIZE,
+        index_key.mv_size - EXPIRY_SIZE
+    );
+    MDB_val name = make_val(key.data(), key.size());
+    code = mdb_del(txn, this->data_, &name, nullptr);
+    if (code != MDB_NOTFOUND) {
+      LmdbException::checkLmdbError(code, "erase expired key");
+    }
+    LmdbException::checkLmdbError(
+        mdb_cursor_del(cursor.get(), 0), "erase expiry"
+    );
+    purged += 1;
+    code = mdb_cursor_get(cursor.get(), &index_key, &empty, MDB_NEXT);
+  }
+  if (code != MDB_SUCCESS && code != MDB_NOTFOUND) {
+    LmdbException::checkLmdbError(code, "read expiry index");
+  }
+  return purged;
+}
+
+
+LmdbStore::LmdbStore(std::string path, size_t map_size) {
+  this->path_ = path;
+  this->env_ = nullptr;
+  LmdbException::checkLmdbError(
+      mdb_env_create(&this->env_), "create environment"
+  );
+
+  // The store is a single file, with a lock file next to it.
+  // Transactions are not tied to threads so the store can be
+  // used from any event loop thread.
+  try {
+    LmdbException::checkLmdbError(
+        mdb_env_set_maxdbs(this->env_, 2), "configure environment"
+    );
+    LmdbException::checkLmdbError(
+        mdb_env_set_mapsize(this->env_, map_size), "configure environment"
+    );
+    LmdbException::checkLmdbError(
+        mdb_env_open(this->env_, path.c_str(), MDB_NOSUBDIR | MDB_NOTLS, 0644),
+        "open " + path
+    );
+    this->max_key_size_ = mdb_env_get_maxkeysize(this->env_) - EXPIRY_SIZE;
+    LmdbTxn txn(this->env_, 0);
+    LmdbException::checkLmdbError(
+        mdb_dbi_open(txn.get(), "data", MDB_CREATE, &this->data_),
+        "open data"
+    );
+    LmdbException::checkLmdbError(
+        mdb_dbi_open(txn.get(), "expiry", MDB_CREATE, &this->expiry_),
+        "open expiry index"
+    );
+    txn.commit();
+  } catch (...) {
+    mdb_env_close(this->env_);
+    throw;
+  }
+}
+
+LmdbStore::~LmdbStore() {
+  mdb_env_close(this->env_);
+}
+
+
+std::string LmdbStore::path() const {
+  return this->path_;
+}
+
+size_t LmdbStore::maxKeySize() const {
+  return this->max_key_size_;
+}
+
+size_t LmdbStore::expire() {
+  LmdbTxn txn(this->env_, 0);
+  size_t purged = this->purge(txn.get(), static_cast<size_t>(-1));
+  txn.commit();
+  return purged;
+}
+
+Promise LmdbStore::erase(std::string key) {
+  try {
+    this->write([this, &key](MDB_txn* txn) {
+      this->eraseKey(txn, key);
+    });
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::get(std::string key) {
+  try {
+    return Promise().settle(this->read([this, &key](MDB_txn* txn) {
+      return this->lookup(txn, key);
+    }));
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::set(std::string key, json value) {
+  try {
+    this->write([this, &key, &value](MDB_txn* txn) {
+      this->setKey(txn, key, value, 0);
+    });
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::set(
+    std::string key, json value, std::chrono::duration<int> ttl
+) {
+  // Like other stores a TTL of zero (or less) never expires.
+  uint64_t expires = 0;
+  if (ttl.count() > 0) {
+    expires = this->now() + ttl.count();
+  }
+  try {
+    this->write([this, &key, &value, expires](MDB_txn* txn) {
+      this->setKey(txn, key, value, expires);
+    });
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::eraseMany(std::vector<std::string> keys) {
+  try {
+    this->write([this, &keys](MDB_txn* txn) {
+      for (auto& key : keys) {
+        this->eraseKey(txn, key);
+      }
+    });
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::getMany(std::vector<std::string> keys) {
+  try {
+    return Promise().settle(this->read([this, &keys](MDB_txn* txn) {
+      json result = json::object();
+      for (auto& key : keys) {
+        result[key] = this->lookup(txn, key);
+      }
+      return result;
+    }));
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
+
+Promise LmdbStore::setMany(std::map<std::string, json> values) {
+  try {
+    this->write([this, &values](MDB_txn* txn) {
+      for (auto& pair : values) {
+        this->setKey(txn, pair.first, pair.second, 0);
+      }
+    });
+    return Promise().settle(nullptr);
+  } catch (...) {
+    return Promise().settle(std::current_exception());
+  }
+}
@@ -0,0 +1,23 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <string>
+
+#include "core/interface/lifecycle.h"
+#include "ext/metadata/store/lmdb/config.h"
+
+
+using sf::core::interface::BaseLifecycleArg;
+using sf::core::interface::BaseLifecycleHandler;
+
+using sf::ext::metadata::LmdbStoreConfig;
+
+
+class LmdbModuleInit : public BaseLifecycleHandler {
+ public:
+  void handle(std::string event, BaseLifecycleArg* arg) {
+    // Attach to LuaInit hook.
+    LmdbStoreConfig::AttachLuaInit();
+  }
+};
+
+
+LifecycleStaticOn("process::init", LmdbModuleInit);
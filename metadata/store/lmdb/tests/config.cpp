@@ -0,0 +1,181 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "core/context/context.h"
+#include "core/context/static.h"
+#include "core/exceptions/configuration.h"
+#include "core/exceptions/lua.h"
+
+#include "core/interface/config/node.h"
+#include "core/interface/config/node/hooks.h"
+#include "core/interface/posix.h"
+#include "core/utility/lua.h"
+
+#include "ext/metadata/store/lmdb/config.h"
+
+#include "core/testing/hooks.h"
+
+
+using sf::core::context::Context;
+using sf::core::context::ContextRef;
+using sf::core::context::Static;
+
+using sf::core::exception::InvalidConfiguration;
+using sf::core::exception::LuaRuntimeError;
+using sf::core::exception::LuaTypeError;
+
+using sf::core::hook::NodeConfig;
+using sf::core::interface::MetaDataStoreRef;
+using sf::core::interface::NodeConfigIntent;
+using sf::core::interface::NodeConfigIntentLuaProxy;
+using sf::core::interface::Posix;
+using sf::core::utility::Lua;
+
+using sf::ext::metadata::LmdbStoreConfig;
+
+using sf::core::testing::HookTest;
+
+
+class ConfigExtensionTest : public HookTest {
+ public:
+  Lua lua;
+  NodeConfigIntentLuaProxy type;
+
+  ConfigExtensionTest() : lua(), type(lua) {
+    this->trackHook(&NodeConfig::LuaInit);
+    this->trackHook(&NodeConfig::Collect);
+    this->clearHooks();
+
+    this->type.initType(this->lua);
+    this->lua.doString("metastores = {}");
+  }
+
+  ~ConfigExtensionTest() {
+    this->clearHooks();
+  }
+};
+
+
+TEST_F(ConfigExtensionTest, FactoryIsFunction) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Check that `metastores.lmdb` is a function.
+  this->lua.doString("return metastores.lmdb");
+  ASSERT_EQ(LUA_TFUNCTION, this->lua.stack()->type());
+}
+
+TEST_F(ConfigExtensionTest, FactoryReturnsIntent) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory and check return type.
+  this->lua.doString(
+      "return metastores.lmdb {store = '/some/path'}"
+  );
+  ASSERT_TRUE(this->type.typeOf(-1));
+}
+
+TEST_F(ConfigExtensionTest, FactoryReturnsIntentWithMapSize) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory and check return type.
+  this->lua.doString(
+      "return metastores.lmdb {store = '/some/path', map_size = 64}"
+  );
+  ASSERT_TRUE(this->type.typeOf(-1));
+}
+
+TEST_F(ConfigExtensionTest, FactoryRejectsEmptyMap) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory with an invalid map size.
+  ASSERT_THROW(
+      this->lua.doString(
+          "return metastores.lmdb {store = '/some/path', map_size = 0}"
+      ),
+      InvalidConfiguration
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRequiresArg) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory and check return type.
+  ASSERT_THROW(
+      this->lua.doString("return metastores.lmdb()"),
+      LuaRuntimeError
+  );
+}
+
+TEST_F(ConfigExtensionTest, FactoryRequiresStorePath) {
+  // Attach and trigger LuaInit handler.
+  LmdbStoreConfig::AttachLuaInit();
+  NodeConfig::LuaInit.trigger(this->lua);
+
+  // Invoke factory and check return type.
+  ASSERT_THROW(
+      this->lua.doString("return metastores.lmdb {}"),
+      LuaTypeError
+  );
+}
+
+
+class LmdbStoreIntentTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+
+ public:
+  LmdbStoreIntentTest() {
+    Static::initialise(new Posix());
+    char* path = strdup("tmp.sf-lmdb.config.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    free(path);
+  }
+
+  ~LmdbStoreIntentTest() {
+    Static::destroy();
+    unlink((this->tmp_dir_ + "/store").c_str());
+    unlink((this->tmp_dir_ + "/store-lock").c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+};
+
+
+TEST_F(LmdbStoreIntentTest, UpdatesTheContext) {
+  auto intent = LmdbStoreConfig::MakeIntent(this->tmp_dir_ + "/store");
+  ContextRef context(new Context());
+  intent->apply(context);
+  ASSERT_NO_THROW(context->metadata());
+}
+
+TEST_F(LmdbStoreIntentTest, VaildatePathIsDir) {
+  auto intent = LmdbStoreConfig::MakeIntent("/");
+  ContextRef context(new Context());
+  ASSERT_THROW(intent->verify(context), InvalidConfiguration);
+}
+
+TEST_F(LmdbStoreIntentTest, VaildatePathIsMissing) {
+  auto intent = LmdbStoreConfig::MakeIntent("/not/a/real/path");
+  ContextRef context(new Context());
+  ASSERT_THROW(intent->verify(context), InvalidConfiguration);
+}
+
+TEST_F(LmdbStoreIntentTest, VaildatePathIsValid) {
+  auto intent = LmdbStoreConfig::MakeIntent(this->tmp_dir_ + "/store");
+  ContextRef context(new Context());
+  ASSERT_NO_THROW(intent->verify(context));
+}
@@ -0,0 +1,132 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/interface/metadata/store.h"
+#include "core/testing/promise.h"
+#include "ext/metadata/store/jsonfs.h"
+#include "ext/metadata/store/lmdb.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::core::interface::MetaDataStoreRef;
+using sf::ext::metadata::JsonFsStore;
+using sf::ext::metadata::LmdbStore;
+
+
+//! Creates a store with files in the given directory.
+typedef std::function<MetaDataStoreRef(std::string dir)> StoreFactory;
+
+
+//! Tests the MetaDataStore behaviour all stores must share.
+class MetaDataStoreContractTest :
+    public ::testing::TestWithParam<StoreFactory> {
+ protected:
+  std::string tmp_dir_;
+  MetaDataStoreRef store;
+
+ public:
+  MetaDataStoreContractTest() {
+    char* path = strdup("tmp.sf-lmdb.contract.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    free(path);
+    this->store = GetParam()(this->tmp_dir_);
+  }
+
+  ~MetaDataStoreContractTest() {
+    this->store.reset();
+    unlink((this->tmp_dir_ + "/store").c_str());
+    unlink((this->tmp_dir_ + "/store-lock").c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  //! Returns the value of the key in the store.
+  json get(std::string key) {
+    json result;
+    Promise promise = this->store->get(key).then([&result](json value) {
+      result = value;
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(promise);
+    EXPECT_TRUE(promise.resolved());
+    return result;
+  }
+
+  //! Checks the promise resolved.
+  void wait(Promise promise) {
+    EXPECT_PROMISE_NO_THROW(promise);
+    ASSERT_TRUE(promise.resolved());
+  }
+};
+
+
+TEST_P(MetaDataStoreContractTest, EraseKey) {
+  this->wait(this->store->set("key", 42));
+  this->wait(this->store->erase("key"));
+  ASSERT_TRUE(this->get("key").is_null());
+}
+
+TEST_P(MetaDataStoreContractTest, EraseMissingKey) {
+  this->wait(this->store->erase("key"));
+}
+
+TEST_P(MetaDataStoreContractTest, GetMissingKey) {
+  ASSERT_TRUE(this->get("key").is_null());
+}
+
+TEST_P(MetaDataStoreContractTest, OverwriteKey) {
+  this->wait(this->store->set("key", 1));
+  this->wait(this->store->set("key", "two"));
+  ASSERT_EQ(json("two"), this->get("key"));
+}
+
+TEST_P(MetaDataStoreContractTest, StoreThenGet) {
+  json value = {{"name", "node"}, {"tags", {"a", "b"}}, {"port", 8080}};
+  this->wait(this->store->set("cluster.nodes.node", value));
+  ASSERT_EQ(value, this->get("cluster.nodes.node"));
+}
+
+TEST_P(MetaDataStoreContractTest, StoreWithTTL) {
+  this->wait(this->store->set("key", 42, std::chrono::seconds(60)));
+  ASSERT_EQ(json(42), this->get("key"));
+}
+
+TEST_P(MetaDataStoreContractTest, StoreWithZeroTTL) {
+  this->wait(this->store->set("key", 42, std::chrono::seconds(0)));
+  ASSERT_EQ(json(42), this->get("key"));
+}
+
+//! Key size limits are store specific.
+/*!
+ * JsonFS stores accept keys of any size while LMDB stores reject
+ * keys longer than LmdbStore::maxKeySize() with LmdbInvalidKey.
+ * Stores that reject a key reject reads of it as well.
+ */
+TEST_P(MetaDataStoreContractTest, LongKeyIsStoredOrRejected) {
+  std::string key(4096, 'k');
+  Promise set = this->store->set(key, 42);
+  ASSERT_TRUE(set.settled());
+  if (set.resolved()) {
+    ASSERT_EQ(json(42), this->get(key));
+  } else {
+    ASSERT_TRUE(this->store->get(key).rejected());
+  }
+}
+
+
+INSTANTIATE_TEST_CASE_P(Stores, MetaDataStoreContractTest, ::testing::Values(
+    [](std::string dir) -> MetaDataStoreRef {
+      return std::make_shared<JsonFsStore>(dir + "/store");
+    },
+    [](std::string dir) -> MetaDataStoreRef {
+      return std::make_shared<LmdbStore>(dir + "/store");
+    }
+));
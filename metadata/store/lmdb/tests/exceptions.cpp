@@ -0,0 +1,28 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+#include <lmdb.h>
+
+#include "ext/metadata/store/lmdb/exceptions.h"
+
+using sf::ext::exception::LmdbException;
+using sf::ext::exception::LmdbInvalidKey;
+
+
+TEST(LmdbException, ErrorCheck) {
+  ASSERT_NO_THROW(LmdbException::checkLmdbError(MDB_SUCCESS, "test"));
+  ASSERT_THROW(
+      LmdbException::checkLmdbError(MDB_NOTFOUND, "test"), LmdbException
+  );
+
+  try {
+    LmdbException::checkLmdbError(MDB_NOTFOUND, "test");
+
+  } catch (LmdbException& ex) {
+    ASSERT_EQ(-4300, ex.getCode());
+    ASSERT_EQ(MDB_NOTFOUND, ex.lmdbCode());
+  }
+}
+
+TEST(LmdbInvalidKey, Code) {
+  ASSERT_EQ(-4302, LmdbInvalidKey("test").getCode());
+}
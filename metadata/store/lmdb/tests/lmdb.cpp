@@ -0,0 +1,175 @@
+// Copyright 2017 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <exception>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/testing/promise.h"
+#include "ext/metadata/store/lmdb.h"
+#include "ext/metadata/store/lmdb/exceptions.h"
+
+
+using nlohmann::json;
+using poolqueue::Promise;
+
+using sf::ext::exception::LmdbException;
+using sf::ext::exception::LmdbInvalidKey;
+using sf::ext::metadata::LmdbStore;
+
+
+//! Store with a clock moved by the tests.
+class TestLmdbStore : public LmdbStore {
+ protected:
+  uint64_t now() const {
+    return this->clock;
+  }
+
+ public:
+  uint64_t clock;
+
+  explicit TestLmdbStore(std::string path) : LmdbStore(path) {
+    this->clock = 1000;
+  }
+};
+
+
+class LmdbStoreTest : public ::testing::Test {
+ protected:
+  std::string tmp_dir_;
+  std::string path_;
+  std::unique_ptr<TestLmdbStore> store;
+
+ public:
+  LmdbStoreTest() {
+    char* path = strdup("tmp.sf-lmdb.tests.XXXXXX");
+    this->tmp_dir_ = std::string(mkdtemp(path));
+    this->path_ = this->tmp_dir_ + "/store.mdb";
+    free(path);
+    this->store.reset(new TestLmdbStore(this->path_));
+  }
+
+  ~LmdbStoreTest() {
+    this->store.reset();
+    unlink(this->path_.c_str());
+    unlink((this->path_ + "-lock").c_str());
+    rmdir(this->tmp_dir_.c_str());
+  }
+
+  //! Returns the value of the key in the store.
+  json get(std::string key) {
+    json result;
+    Promise promise = this->store->get(key).then([&result](json value) {
+      result = value;
+      return nullptr;
+    });
+    EXPECT_PROMISE_NO_THROW(promise);
+    EXPECT_TRUE(promise.resolved());
+    return result;
+  }
+
+  //! Checks the promise resolved.
+  void wait(Promise promise) {
+    EXPECT_PROMISE_NO_THROW(promise);
+    ASSERT_TRUE(promise.resolved());
+  }
+
+  //! Rethrows the error the promise was rejected with.
+  void rethrow(Promise promise) {
+    std::exception_ptr error;
+    promise.except([&error](const std::exception_ptr& ex) {
+      error = ex;
+    });
+    ASSERT_TRUE(promise.rejected());
+    std::rethrow_exception(error);
+  }
+};
+
+
+TEST_F(LmdbStoreTest, DataIsKeptWhenReopened) {
+  this->wait(this->store->set("key", {{"a", 1}}));
+  this->store.reset(new TestLmdbStore(this->path_));
+  ASSERT_EQ(json({{"a", 1}}), this->get("key"));
+}
+
+TEST_F(LmdbStoreTest, ExpirePurgesKeys) {
+  this->wait(this->store->set("a", 1, std::chrono::seconds(10)));
+  this->wait(this->store->set("b", 2, std::chrono::seconds(20)));
+  this->wait(this->store->set("c", 3));
+  this->store->clock += 15;
+  ASSERT_EQ(1, this->store->expire());
+  ASSERT_EQ(0, this->store->expire());
+  this->store->clock += 10;
+  ASSERT_EQ(1, this->store->expire());
+  ASSERT_EQ(json(3), this->get("c"));
+}
+
+TEST_F(LmdbStoreTest, OpenMissingDirectoryFails) {
+  ASSERT_THROW(LmdbStore("/not/a/real/path/store.mdb"), LmdbException);
+}
+
+TEST_F(LmdbStoreTest, SetWithoutTtlClearsExpiry) {
+  this->wait(this->store->set("key", 1, std::chrono::seconds(10)));
+  this->wait(this->store->set("key", 2));
+  this->store->clock += 20;
+  ASSERT_EQ(0, this->store->expire());
+  ASSERT_EQ(json(2), this->get("key"));
+}
+
+TEST_F(LmdbStoreTest, TtlExpiresKeys) {
+  this->wait(this->store->set("key", 1, std::chrono::seconds(10)));
+  this->store->clock += 9;
+  ASSERT_EQ(json(1), this->get("key"));
+  this->store->clock += 1;
+  ASSERT_TRUE(this->get("key").is_null());
+}
+
+TEST_F(LmdbStoreTest, WritesPurgeExpiredKeys) {
+  this->wait(this->store->set("a", 1, std::chrono::seconds(10)));
+  this->store->clock += 20;
+  this->wait(this->store->set("b", 2));
+  ASSERT_EQ(0, this->store->expire());
+}
+
+TEST_F(LmdbStoreTest, BatchOperations) {
+  this->wait(this->store->setMany({{"a", 1}, {"b", 2}}));
+  json result;
+  this->wait(this->store->getMany({"a", "b", "c"}).then([&result](json v) {
+    result = v;
+    return nullptr;
+  }));
+  ASSERT_EQ(json({{"a", 1}, {"b", 2}, {"c", nullptr}}), result);
+  this->wait(this->store->eraseMany({"a", "b"}));
+  ASSERT_TRUE(this->get("a").is_null());
+  ASSERT_TRUE(this->get("b").is_null());
+}
+
+TEST_F(LmdbStoreTest, RejectsEmptyKeys) {
+  ASSERT_THROW(this->rethrow(this->store->set("", 1)), LmdbInvalidKey);
+  ASSERT_THROW(this->rethrow(this->store->get("")), LmdbInvalidKey);
+  ASSERT_THROW(this->rethrow(this->store->erase("")), LmdbInvalidKey);
+}
+
+TEST_F(LmdbStoreTest, RejectsLongKeys) {
+  std::string longest(this->store->maxKeySize(), 'k');
+  this->wait(this->store->set(longest, 1, std::chrono::seconds(10)));
+  ASSERT_EQ(json(1), this->get(longest));
+
+  std::string key = longest + "k";
+  ASSERT_THROW(this->rethrow(this->store->set(key, 1)), LmdbInvalidKey);
+  ASSERT_THROW(this->rethrow(this->store->get(key)), LmdbInvalidKey);
+  ASSERT_THROW(this->rethrow(this->store->erase(key)), LmdbInvalidKey);
+}
+
+TEST_F(LmdbStoreTest, InvalidKeysRejectTheBatch) {
+  std::string key(this->store->maxKeySize() + 1, 'k');
+  ASSERT_THROW(
+      this->rethrow(this->store->setMany({{"a", 1}, {key, 2}})),
+      LmdbInvalidKey
+  );
+  ASSERT_TRUE(this->get("a").is_null());
+}
@@ -3,9 +3,20 @@
 #define EXT_REPOSITORY_GIT_H_
 
 #include <git2.h>
+
+#include <mutex>
 #include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
 
 #include "core/model/repository.h"
+#include "ext/repository/git/blob.h"
+#include "ext/repository/git/cache.h"
+#include "ext/repository/git/diff.h"
+#include "ext/repository/git/pool.h"
+#include "ext/repository/git/revisions.h"
+#include "ext/repository/git/tree.h"
 
 
 namespace sf {
@@ -21,27 +32,87 @@ namespace repository {
    * 
    * A custom alias to resolve the <latest> version can be
    * specified, the default is master.
+   *
+   * Files of at least `stream_threshold` bytes are streamed from
+   * the object database in chunks of `stream_chunk` bytes instead
+   * of being loaded in memory in full.
+   * Objects the database can't stream (such as packed and delta
+   * compressed objects) are always loaded in full.
+   *
+   * Loaded blobs are kept in a cache of up to `cache_size` bytes
+   * shared by all the versions of the repository, so files that
+   * did not change between versions are not loaded again.
+   *
+   * Resolved revisions are cached as well (see GitRevisionCache)
+   * so repeated requests for the same version skip revparse.
+   * The last `VERSION_CACHE` versions are kept by tree id and
+   * shared by all requests for commits with that tree.
+   *
+   * Repositories and their versions can be used from multiple
+   * threads: libgit2 calls go through up to `handles` handles
+   * leased from a GitRepoPool.
    */
   class GitRepo : public sf::core::model::Repository {
     friend class GitRepoVersion;
 
+   public:
+    //! Default size above which files are streamed.
+    static const size_t STREAM_THRESHOLD;
+
+    //! Default size of chunks read from streamed files.
+    static const size_t STREAM_CHUNK;
+
+    //! Default memory limit of the blob cache.
+    static const size_t CACHE_SIZE;
+
+    //! Number of versions kept in memory.
+    static const size_t VERSION_CACHE;
+
+    //! Default number of libgit2 handles, one per core.
+    static const size_t HANDLES;
+
    protected:
     std::string latest_alias;
     std::string path;
-    git_repository* repo;
-
-    //! Ensures that the repository is initialised.
-    void ensure_repo_is_open();
+    GitRepoPool handles;
+    size_t stream_threshold;
+    size_t stream_chunk;
+    size_t cache_size;
+    GitBlobCache blobs;
+    GitRevisionCache revisions;
+    GitVersionCache versions;
 
     //! Resolves the given revision to a commit.
-    git_commit* resolveCommit(std::string revision);
+    git_commit* resolveCommit(git_repository* repo, std::string revision);
+
+    //! Resolves the given revision, using the cache if possible.
+    GitRevision resolveRevision(std::string revision);
+
+    //! Resolves a version, converting lookup errors to GitInvalidVersion.
+    GitRevision resolveChecked(const std::string version);
+
+    //! Returns the blob with the given id, from the cache if possible.
+    GitBlobRef lookupBlob(const git_oid* id);
 
    public:
     explicit GitRepo(
-        std::string path, std::string latest = "refs/heads/master"
+        std::string path, std::string latest = "refs/heads/master",
+        size_t stream_threshold = STREAM_THRESHOLD,
+        size_t stream_chunk = STREAM_CHUNK,
+        size_t cache_size = CACHE_SIZE,
+        size_t handles = HANDLES
     );
     ~GitRepo();
 
+    //! Returns the cache of blobs loaded from the repository.
+    GitBlobCache* cache();
+
+    //! Path to the git directory of the repository.
+    std::string gitdir();
+
+    //! Revision the <latest> version resolves.
+    std::string latestAlias() const;
+
     virtual sf::core::model::RepositoryVersionRef latest();
     virtual sf::core::model::RepositoryVersionRef version(
         std::string revision
@@ -49,14 +120,95 @@ namespace repository {
 
     virtual std::string resolveVersion(const std::string version);
     virtual void verifyVersion(const std::string version);
+
+    //! Lists the files that changed between two versions.
+    /*!
+     * Only the trees are compared: subtrees with the same id are
+     * skipped and no blob is loaded, so the cost is proportional
+     * to the size of the change rather than the repository.
+     * Type changes (such as a file becoming a symlink) are
+     * reported as modifications.
+     */
+    GitChanges diff(const std::string from, const std::string to);
   };
 
   //! GitRepo version manager.
+  /*!
+   * Versions memoize the tree entries paths resolve to, and the
+   * subtrees they are in, so repeated lookups of the same path or
+   * of paths in the same directory don't walk the tree again.
+   * Versions are shared and can be used from multiple threads.
+   *
+   * A directory can be prefetched to memoize all its entries and
+   * load all its files in one pass, after which lookups and reads
+   * of paths in it are served from memory.
+   */
   class GitRepoVersion : public sf::core::model::RepositoryVersion {
    protected:
+    //! Memoized tree entry, type is GIT_OBJ_BAD for missing paths.
+    struct Entry {
+      git_otype type;
+      git_oid id;
+    };
+
     GitRepo*  repo;
     git_tree* tree;
 
+    std::mutex lock;
+    std::unordered_map<std::string, Entry> entries;
+    std::unordered_map<std::string, git_tree*> subtrees;
+    std::unordered_map<std::string, GitBlobRef> blobs;
+    std::vector<std::string> complete;
+
+    //! Bytes of prefetched blobs, at most the repository cache_size.
+    size_t blobs_size;
+
+    //! Raw ids of the blobs counted in blobs_size.
+    /*!
+     * Blobs shared by several paths, or loaded by overlapping
+     * prefetches, are counted once.
+     */
+    std::unordered_set<std::string> blob_ids;
+
+    //! Looks up a path with git_tree_entry_bypath.
+    /*!
+     * The tree of the version belongs to the handle that loaded
+     * it, which another thread may be using, so the lookup is
+     * done on a copy of the tree from a leased handle.
+     */
+    int entryByPath(git_tree_entry** entry, const std::string& path);
+
+    //! Looks up the entry for a path, the lock must be held.
+    Entry lookupEntry(const std::string& path);
+
+    //! Looks up the tree for a directory, the lock must be held.
+    /*!
+     * Returns nullptr if the directory does not exist.
+     */
+    git_tree* lookupTree(const std::string& path);
+
+    //! Returns the tree for a directory, the lock must be held.
+    /*!
+     * Throws if the path is missing or is not a directory.
+     */
+    git_tree* directory(const std::string& path);
+
+    //! Returns the entry for a path.
+    Entry entry(const std::string& path);
+
+    //! Returns the prefetched blob at path or nullptr.
+    GitBlobRef prefetched(const std::string& path);
+
+    //! Returns the id of the blob at path.
+    git_oid blobId(const std::string path);
+
+    //! Streams a large object from the object database in chunks.
+    /*!
+     * Returns nullptr if the object is too small to be worth
+     * streaming or if the database can't stream it.
+     */
+    sf::core::model::IStreamRef streamObject(const git_oid* id);
+
    public:
     GitRepoVersion(GitRepo* repo, git_tree* tree);
     ~GitRepoVersion();
@@ -64,6 +216,42 @@ namespace repository {
     virtual bool exists(const std::string path);
     virtual std::string readFile(const std::string path);
     virtual sf::core::model::IStreamRef streamFile(const std::string path);
+
+    //! Reads many files in parallel.
+    /*!
+     * Returns the content of the files in the same order as paths.
+     * If any read fails the exception for the first failed path,
+     * in the order of paths, is thrown once all reads are done.
+     */
+    std::vector<std::string> readFiles(const std::vector<std::string>& paths);
+
+    //! Iterates over the entries of a directory (the root by default).
+    /*!
+     * See GitTreeIterator for how the pattern is matched.
+     */
+    GitTreeIteratorRef list(
+        const std::string dir = "", bool recursive = false,
+        const std::string pattern = ""
+    );
+
+    //! Loads all the files in a directory (the whole tree by default).
+    /*!
+     * The directory is walked once and the distinct blobs in it
+     * are loaded in parallel and kept in memory for the lifetime
+     * of the version.
+     *
+     * Files of at least `stream_threshold` bytes are not loaded
+     * so they can still be streamed and each version keeps up to
+     * `cache_size` bytes of prefetched files.
+     * Files that are not prefetched are read as usual.
+     */
+    void prefetch(const std::string dir = "");
+
+    //! Returns the blob at path without copying its content.
+    /*!
+     * GitBlob::data() is valid for as long as the reference is held.
+     */
+    GitBlobRef readBlob(const std::string path);
   };
 
 }  // namespace repository
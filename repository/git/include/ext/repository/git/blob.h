@@ -0,0 +1,48 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_BLOB_H_
+#define EXT_REPOSITORY_GIT_BLOB_H_
+
+#include <git2.h>
+
+#include <memory>
+#include <string>
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! Owning reference to a libgit2 blob.
+  /*!
+   * The blob is freed when the reference is destroyed.
+   * Pointers returned by data() are into libgit2's copy of the
+   * content and are only valid while the reference is alive.
+   */
+  class GitBlob {
+   protected:
+    git_blob* blob;
+
+   public:
+    //! Takes ownership of the given blob.
+    explicit GitBlob(git_blob* blob);
+    ~GitBlob();
+
+    GitBlob(const GitBlob&) = delete;
+    GitBlob& operator=(const GitBlob&) = delete;
+
+    //! Returns a pointer to the raw content of the blob.
+    const char* data() const;
+
+    //! Returns the size, in bytes, of the blob.
+    size_t size() const;
+
+    //! Copies the content of the blob into a string.
+    std::string str() const;
+  };
+  typedef std::shared_ptr<GitBlob> GitBlobRef;
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_BLOB_H_
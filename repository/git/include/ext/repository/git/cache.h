@@ -0,0 +1,104 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_CACHE_H_
+#define EXT_REPOSITORY_GIT_CACHE_H_
+
+#include <git2.h>
+
+#include <list>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include "core/model/repository.h"
+#include "ext/repository/git/blob.h"
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! Bounded LRU cache of blobs keyed by object id.
+  /*!
+   * Blobs are immutable and content addressed so a cached blob
+   * can be shared by any version that references the same id.
+   * The cache is bounded by the memory accounted to cached blobs
+   * (their content and key); blobs larger than the capacity
+   * are never cached.
+   *
+   * The cache can be used from multiple threads.
+   */
+  class GitBlobCache {
+   protected:
+    typedef std::pair<std::string, GitBlobRef> Entry;
+
+    size_t capacity;
+    size_t used;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::mutex lock;
+
+    //! Evicts least recently used blobs until used <= capacity.
+    void evict();
+
+   public:
+    explicit GitBlobCache(size_t capacity);
+
+    //! Returns the cached blob or nullptr.
+    GitBlobRef get(const git_oid* id);
+
+    //! Adds a blob to the cache.
+    void put(const git_oid* id, GitBlobRef blob);
+
+    //! Drops all cached blobs.
+    void clear();
+
+    //! Number of cached blobs.
+    size_t count();
+
+    //! Memory, in bytes, accounted to the cached blobs.
+    size_t size();
+  };
+
+
+  //! Bounded LRU cache of repository versions keyed by tree id.
+  /*!
+   * Commits with the same tree have the same content so they
+   * can share a version (and the lookups it has memoized).
+   *
+   * The cache can be used from multiple threads.
+   */
+  class GitVersionCache {
+   protected:
+    typedef std::pair<
+      std::string, sf::core::model::RepositoryVersionRef
+    > Entry;
+
+    size_t capacity;
+    std::list<Entry> entries;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index;
+    std::mutex lock;
+
+   public:
+    explicit GitVersionCache(size_t capacity);
+
+    //! Returns the cached version or nullptr.
+    sf::core::model::RepositoryVersionRef get(const git_oid* tree);
+
+    //! Adds a version to the cache.
+    void put(
+        const git_oid* tree, sf::core::model::RepositoryVersionRef version
+    );
+
+    //! Drops all cached versions.
+    void clear();
+
+    //! Number of cached versions.
+    size_t count();
+  };
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_CACHE_H_
@@ -0,0 +1,39 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_DIFF_H_
+#define EXT_REPOSITORY_GIT_DIFF_H_
+
+#include <git2.h>
+
+#include <string>
+#include <vector>
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! How a file changed between two versions.
+  enum class GitChangeType {
+    ADDED,
+    MODIFIED,
+    REMOVED
+  };
+
+  //! File changed between two versions.
+  /*!
+   * The id of the blob before the change is zero for added files
+   * and the id after the change is zero for removed files.
+   */
+  struct GitChange {
+    GitChangeType type;
+    std::string path;
+    git_oid old_id;
+    git_oid new_id;
+  };
+  typedef std::vector<GitChange> GitChanges;
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_DIFF_H_
@@ -6,8 +6,10 @@
 
 #include <istream>
 #include <streambuf>
+#include <vector>
 
 #include "core/model/repository.h"
+#include "ext/repository/git/blob.h"
 
 
 namespace sf {
@@ -15,23 +17,50 @@ namespace ext {
 namespace repository {
 
   //! Readable stream buffer to wrap gitlib2 blobs.
+  /*!
+   * The get area points directly at the content of the blob
+   * so no copy is made; the buffer keeps a reference to the
+   * blob for as long as it exists.
+   */
   class GitBlobStreamBuf : public std::streambuf {
    protected:
-    char* content;
-    git_off_t size;
+    GitBlobRef blob;
 
    public:
+    //! Streams the blob, the caller retains ownership of it.
     explicit GitBlobStreamBuf(git_blob* blob);
-    ~GitBlobStreamBuf();
+
+    //! Streams a blob shared with other references.
+    explicit GitBlobStreamBuf(GitBlobRef blob);
+  };
+
+  //! Readable stream buffer that pulls chunks from an ODB read stream.
+  /*!
+   * Only one chunk is held in memory at any time so the memory
+   * used to read an object is bounded by the chunk size.
+   * The buffer takes ownership of the stream and keeps a reference
+   * to the object database it was opened from.
+   */
+  class GitOdbStreamBuf : public std::streambuf {
+   protected:
+    git_odb* odb;
+    git_odb_stream* stream;
+    std::vector<char> chunk;
+
+    int_type underflow();
+
+   public:
+    GitOdbStreamBuf(git_odb* odb, git_odb_stream* stream, size_t chunk);
+    ~GitOdbStreamBuf();
   };
 
-  //! Read stream to delete the underling GitBlobStreamBuf.
+  //! Read stream to delete the underling stream buffer.
   class GitBlobStream : public std::istream {
    protected:
-    GitBlobStreamBuf* buffer;
+    std::streambuf* buffer;
 
    public:
-    explicit GitBlobStream(GitBlobStreamBuf* buffer);
+    explicit GitBlobStream(std::streambuf* buffer);
     ~GitBlobStream();
   };
 
@@ -0,0 +1,79 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_POOL_H_
+#define EXT_REPOSITORY_GIT_POOL_H_
+
+#include <git2.h>
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! Pool of libgit2 handles to the same repository.
+  /*!
+   * A git_repository must not be used by more than one thread
+   * at a time so each thread leases its own handle from the pool.
+   * Handles are opened when needed, up to the pool capacity,
+   * after which threads wait for a handle to be released.
+   *
+   * Objects looked up through a handle remain valid after the
+   * handle is released and can be read from any thread.
+   * Calls that load more objects (such as git_tree_entry_bypath
+   * and git_tree_walk) use the handle that owns the object, so
+   * they must be given objects looked up through a leased handle.
+   */
+  class GitRepoPool {
+   public:
+    //! Leases a handle for the lifetime of the instance.
+    class Handle {
+     protected:
+      GitRepoPool* pool;
+      git_repository* repo;
+
+     public:
+      explicit Handle(GitRepoPool* pool);
+      ~Handle();
+
+      Handle(const Handle&) = delete;
+      Handle& operator=(const Handle&) = delete;
+
+      git_repository* get() const;
+    };
+
+   protected:
+    std::string path;
+    std::string git_path;
+    size_t capacity;
+    size_t opened;
+
+    std::mutex lock;
+    std::condition_variable released;
+    std::vector<git_repository*> idle;
+
+    //! Returns an idle handle, opening one if possible.
+    git_repository* acquire();
+
+    //! Returns a handle to the pool.
+    void release(git_repository* repo);
+
+   public:
+    GitRepoPool(std::string path, size_t capacity);
+    ~GitRepoPool();
+
+    //! Maximum number of handles the pool opens.
+    size_t size() const;
+
+    //! Path to the git directory, opens the repository if needed.
+    std::string gitdir();
+  };
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_POOL_H_
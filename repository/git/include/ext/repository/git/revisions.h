@@ -0,0 +1,85 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_REVISIONS_H_
+#define EXT_REPOSITORY_GIT_REVISIONS_H_
+
+#include <git2.h>
+
+#include <map>
+#include <mutex>
+#include <string>
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! Commit and tree a revision resolved to.
+  struct GitRevision {
+    git_oid commit;
+    git_oid tree;
+  };
+
+  //! Cache of resolved revisions.
+  /*!
+   * Full commit ids never change what they resolve to and are
+   * cached as they are.
+   * Reference names are cached along with a stamp of the files
+   * git reads to resolve them (packed-refs and the candidate loose
+   * references) so updating a reference invalidates the entry.
+   * Other revision expressions are never cached.
+   *
+   * Once the cache holds `capacity` revisions it is cleared.
+   * The cache can be used from multiple threads.
+   */
+  class GitRevisionCache {
+   protected:
+    struct Entry {
+      GitRevision revision;
+      std::string stamp;
+    };
+
+    size_t capacity;
+    std::map<std::string, Entry> entries;
+    std::mutex lock;
+
+   public:
+    //! Checks if a revision can be cached.
+    static bool IsCacheable(const std::string& revision);
+
+    //! Stamps the reference files a revision may resolve through.
+    /*!
+     * Full commit ids don't depend on references and have an
+     * empty stamp.
+     */
+    static std::string RefsStamp(
+        const std::string& gitdir, const std::string& revision
+    );
+
+   public:
+    explicit GitRevisionCache(size_t capacity = 1024);
+
+    //! Looks up a revision resolved when references had the given stamp.
+    bool get(
+        const std::string& revision, const std::string& stamp,
+        GitRevision* resolved
+    );
+
+    //! Caches a resolved revision.
+    /*!
+     * The stamp must be computed before the revision is resolved
+     * so that concurrent reference updates invalidate the entry.
+     */
+    void put(
+        const std::string& revision, const std::string& stamp,
+        const GitRevision& resolved
+    );
+
+    //! Drops all cached revisions.
+    void clear();
+  };
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_REVISIONS_H_
@@ -0,0 +1,87 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_TREE_H_
+#define EXT_REPOSITORY_GIT_TREE_H_
+
+#include <git2.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ext/repository/git/pool.h"
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  //! Entry in a git tree, as returned by GitTreeIterator.
+  struct GitTreeEntry {
+    //! Path relative to the root of the repository.
+    std::string path;
+    std::string name;
+    git_otype type;
+    git_filemode_t mode;
+    git_oid id;
+  };
+
+  //! Lazy iterator over the entries of a git tree.
+  /*!
+   * Entries are returned in tree order, directories before their
+   * content when iterating recursively.
+   * Subtrees are only looked up when the iterator enters them
+   * and blobs are never loaded.
+   *
+   * If a glob pattern is given only matching entries are returned
+   * (directories are still entered when iterating recursively).
+   * Like in .gitignore files, patterns without a slash are matched
+   * against the entry name and patterns with a slash against the
+   * path relative to the iterated directory.
+   *
+   * Iterators must not outlive the repository they come from.
+   */
+  class GitTreeIterator {
+   protected:
+    struct Frame {
+      git_tree* tree;
+      std::string prefix;
+      size_t index;
+    };
+
+    GitRepoPool* handles;
+    std::string base;
+    bool recursive;
+    std::string pattern;
+    std::vector<Frame> stack;
+
+    //! Checks if an entry matches the pattern.
+    bool matches(const GitTreeEntry& entry) const;
+
+   public:
+    //! Checks a path against a glob pattern.
+    static bool Matches(const std::string& pattern, const std::string& path);
+
+   public:
+    //! Iterates over a tree, found at path dir, taking a reference to it.
+    GitTreeIterator(
+        GitRepoPool* handles, git_tree* tree, std::string dir,
+        bool recursive, std::string pattern
+    );
+    ~GitTreeIterator();
+
+    GitTreeIterator(const GitTreeIterator&) = delete;
+    GitTreeIterator& operator=(const GitTreeIterator&) = delete;
+
+    //! Fetches the next entry, returns false when done.
+    bool next(GitTreeEntry* entry);
+
+    //! Collects all the remaining entries.
+    std::vector<GitTreeEntry> all();
+  };
+  typedef std::shared_ptr<GitTreeIterator> GitTreeIteratorRef;
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_TREE_H_
@@ -0,0 +1,94 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#ifndef EXT_REPOSITORY_GIT_WATCH_H_
+#define EXT_REPOSITORY_GIT_WATCH_H_
+
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "core/model/event.h"
+
+
+namespace sf {
+namespace ext {
+namespace repository {
+
+  class GitRepo;
+
+
+  //! A watched reference moved to a different commit.
+  struct GitRefChange {
+    std::string ref;
+    std::string old_commit;
+    std::string new_commit;
+  };
+
+  //! Callback invoked when a watched reference moves.
+  typedef std::function<void(const GitRefChange&)> GitRefCallback;
+
+
+  //! Event emitted by GitRefWatcher, handling it invokes the callback.
+  class GitRefEvent : public sf::core::model::Event {
+   protected:
+    GitRefChange change_;
+    GitRefCallback callback;
+
+   public:
+    GitRefEvent(GitRefChange change, GitRefCallback callback);
+
+    //! The change the event is about.
+    const GitRefChange& change() const;
+
+    void handle();
+  };
+
+
+  //! Event source notified when a reference moves.
+  /*!
+   * Uses inotify to watch the git directory (for packed-refs) and
+   * the directories the loose reference can be in, so git's
+   * lock-and-rename updates are detected as they happen.
+   * On changes the reference is resolved again (only the reference
+   * files are checked if it did not move) and an event is emitted
+   * when it resolves to a different commit.
+   *
+   * Deleted or invalid references are logged and ignored
+   * until they resolve again.
+   */
+  class GitRefWatcher : public sf::core::model::EventSource {
+   protected:
+    int inotify_fd;
+    std::shared_ptr<GitRepo> repo;
+    std::string ref;
+    std::string commit_;
+    GitRefCallback callback;
+
+    //! Watches a directory, if it exists.
+    void watch(const std::string& path);
+
+    //! Resolves the reference, returns "" if it can't be resolved.
+    std::string resolve();
+
+    //! Emits an event if the reference moved.
+    sf::core::model::EventRef parse();
+
+   public:
+    //! Watches a reference, the repository's latest alias by default.
+    GitRefWatcher(
+        std::string id, std::shared_ptr<GitRepo> repo,
+        GitRefCallback callback, std::string ref = ""
+    );
+    ~GitRefWatcher();
+
+    int fd();
+
+    //! Commit the reference resolved to last.
+    std::string commit() const;
+  };
+  typedef std::shared_ptr<GitRefWatcher> GitRefWatcherRef;
+
+}  // namespace repository
+}  // namespace ext
+}  // namespace sf
+
+#endif  // EXT_REPOSITORY_GIT_WATCH_H_
@@ -0,0 +1,28 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/blob.h"
+
+#include <git2.h>
+#include <string>
+
+using sf::ext::repository::GitBlob;
+
+
+GitBlob::GitBlob(git_blob* blob) {
+  this->blob = blob;
+}
+
+GitBlob::~GitBlob() {
+  git_blob_free(this->blob);
+}
+
+const char* GitBlob::data() const {
+  return reinterpret_cast<const char*>(git_blob_rawcontent(this->blob));
+}
+
+size_t GitBlob::size() const {
+  return static_cast<size_t>(git_blob_rawsize(this->blob));
+}
+
+std::string GitBlob::str() const {
+  return std::string(this->data(), this->size());
+}
@@ -0,0 +1,135 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/cache.h"
+
+#include <git2.h>
+
+#include <mutex>
+#include <string>
+
+using sf::core::model::RepositoryVersionRef;
+
+using sf::ext::repository::GitBlobCache;
+using sf::ext::repository::GitBlobRef;
+using sf::ext::repository::GitVersionCache;
+
+
+//! Returns the raw bytes of an object id, used as cache key.
+static std::string oid_key(const git_oid* id) {
+  return std::string(reinterpret_cast<const char*>(id->id), GIT_OID_RAWSZ);
+}
+
+//! Memory accounted to a cached blob: its content and its key.
+static size_t blob_cost(const GitBlobRef& blob) {
+  return blob->size() + GIT_OID_RAWSZ;
+}
+
+
+GitBlobCache::GitBlobCache(size_t capacity) {
+  this->capacity = capacity;
+  this->used = 0;
+}
+
+void GitBlobCache::evict() {
+  while (this->used > this->capacity && !this->entries.empty()) {
+    Entry& oldest = this->entries.back();
+    this->used -= blob_cost(oldest.second);
+    this->index.erase(oldest.first);
+    this->entries.pop_back();
+  }
+}
+
+GitBlobRef GitBlobCache::get(const git_oid* id) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto entry = this->index.find(oid_key(id));
+  if (entry == this->index.end()) {
+    return nullptr;
+  }
+  this->entries.splice(this->entries.begin(), this->entries, entry->second);
+  return entry->second->second;
+}
+
+void GitBlobCache::put(const git_oid* id, GitBlobRef blob) {
+  if (blob_cost(blob) > this->capacity) {
+    return;
+  }
+
+  std::string key = oid_key(id);
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto entry = this->index.find(key);
+  if (entry != this->index.end()) {
+    this->entries.splice(this->entries.begin(), this->entries, entry->second);
+    return;
+  }
+
+  this->entries.emplace_front(key, blob);
+  this->index[key] = this->entries.begin();
+  this->used += blob_cost(blob);
+  this->evict();
+}
+
+void GitBlobCache::clear() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->index.clear();
+  this->entries.clear();
+  this->used = 0;
+}
+
+size_t GitBlobCache::count() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->entries.size();
+}
+
+size_t GitBlobCache::size() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->used;
+}
+
+
+GitVersionCache::GitVersionCache(size_t capacity) {
+  this->capacity = capacity;
+}
+
+RepositoryVersionRef GitVersionCache::get(const git_oid* tree) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto entry = this->index.find(oid_key(tree));
+  if (entry == this->index.end()) {
+    return nullptr;
+  }
+  this->entries.splice(this->entries.begin(), this->entries, entry->second);
+  return entry->second->second;
+}
+
+void GitVersionCache::put(
+    const git_oid* tree, RepositoryVersionRef version
+) {
+  if (this->capacity == 0) {
+    return;
+  }
+
+  std::string key = oid_key(tree);
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto entry = this->index.find(key);
+  if (entry != this->index.end()) {
+    entry->second->second = version;
+    this->entries.splice(this->entries.begin(), this->entries, entry->second);
+    return;
+  }
+
+  this->entries.emplace_front(key, version);
+  this->index[key] = this->entries.begin();
+  if (this->entries.size() > this->capacity) {
+    this->index.erase(this->entries.back().first);
+    this->entries.pop_back();
+  }
+}
+
+void GitVersionCache::clear() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->index.clear();
+  this->entries.clear();
+}
+
+size_t GitVersionCache::count() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->entries.size();
+}
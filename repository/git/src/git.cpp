@@ -2,11 +2,24 @@
 #include "ext/repository/git.h"
 
 #include <git2.h>
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
 #include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 #include "core/model/repository.h"
+#include "ext/repository/git/blob.h"
 #include "ext/repository/git/exceptions.h"
 #include "ext/repository/git/istream.h"
+#include "ext/repository/git/pool.h"
+#include "ext/repository/git/tree.h"
 
 using sf::core::model::IStreamRef;
 using sf::core::model::RepositoryVersionRef;
@@ -16,48 +29,202 @@ using sf::ext::exception::GitInvalidVersion;
 using sf::ext::exception::GitTypeError;
 
 using sf::ext::repository::GitRepo;
+using sf::ext::repository::GitRepoPool;
 using sf::ext::repository::GitRepoVersion;
-
+using sf::ext::repository::GitRevision;
+using sf::ext::repository::GitRevisionCache;
+using sf::ext::repository::GitTreeIterator;
+using sf::ext::repository::GitTreeIteratorRef;
+
+using sf::ext::repository::GitBlob;
+using sf::ext::repository::GitBlobCache;
+using sf::ext::repository::GitVersionCache;
+using sf::ext::repository::GitBlobRef;
 using sf::ext::repository::GitBlobStream;
+using sf::ext::repository::GitChange;
+using sf::ext::repository::GitChanges;
+using sf::ext::repository::GitChangeType;
 using sf::ext::repository::GitBlobStreamBuf;
+using sf::ext::repository::GitOdbStreamBuf;
 
 
-void GitRepo::ensure_repo_is_open() {
-  // Return if repository is open valid.
-  if (this->repo) {
-    return;
-  }
-  int error = git_repository_open(&this->repo, this->path.c_str());
+const size_t GitRepo::STREAM_THRESHOLD = 1024 * 1024;
+const size_t GitRepo::STREAM_CHUNK = 64 * 1024;
+const size_t GitRepo::CACHE_SIZE = 16 * 1024 * 1024;
+const size_t GitRepo::VERSION_CACHE = 8;
+const size_t GitRepo::HANDLES = std::max(
+    1u, std::thread::hardware_concurrency()
+);
+
+
+//! Returns the raw bytes of an id, to use it as a map key.
+static std::string oid_key(const git_oid* id) {
+  return std::string(reinterpret_cast<const char*>(id->id), GIT_OID_RAWSZ);
+}
+
+//! Returns the size of an object without loading it.
+static size_t object_size(GitRepoPool* pool, const git_oid* id) {
+  GitRepoPool::Handle handle(pool);
+  git_odb* odb = nullptr;
+  int error = git_repository_odb(&odb, handle.get());
+  GitException::checkGitError(error);
+
+  size_t size = 0;
+  git_otype type = GIT_OBJ_BAD;
+  error = git_odb_read_header(&size, &type, odb, id);
+  git_odb_free(odb);
   GitException::checkGitError(error);
+  return size;
+}
+
+
+//! Runs work(idx) for each idx in [0, count) on up to workers threads.
+/*!
+ * The calling thread is one of the workers.
+ * If any call fails the exception for the lowest failed index
+ * is thrown once all calls are done.
+ */
+static void run_parallel(
+    size_t count, size_t workers, std::function<void(size_t)> work
+) {
+  std::vector<std::exception_ptr> errors(count);
+  std::atomic<size_t> next(0);
+  auto worker = [count, &errors, &next, &work]() {
+    for (size_t idx = next++; idx < count; idx = next++) {
+      try {
+        work(idx);
+      } catch (...) {
+        errors[idx] = std::current_exception();
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t idx = 1; idx < std::min(count, workers); idx++) {
+    threads.emplace_back(worker);
+  }
+  worker();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  for (auto& error : errors) {
+    if (error) {
+      std::rethrow_exception(error);
+    }
+  }
 }
 
-git_commit* GitRepo::resolveCommit(std::string revision) {
-  this->ensure_repo_is_open();
 
+git_commit* GitRepo::resolveCommit(
+    git_repository* repo, std::string revision
+) {
   // Get object named by revision.
   git_object* object = nullptr;
-  int error = git_revparse_single(&object, this->repo, revision.c_str());
+  int error = git_revparse_single(&object, repo, revision.c_str());
   GitException::checkGitError(error);
 
   // Check type is commit.
-  if (git_object_type(object) != GIT_OBJ_COMMIT) {
+  git_otype type = git_object_type(object);
+  if (type != GIT_OBJ_COMMIT) {
     git_object_free(object);
-    throw GitTypeError(GIT_OBJ_COMMIT, git_object_type(object));
+    throw GitTypeError(GIT_OBJ_COMMIT, type);
   }
   return reinterpret_cast<git_commit*>(object);
 }
 
+GitRevision GitRepo::resolveRevision(std::string revision) {
+  bool cacheable = GitRevisionCache::IsCacheable(revision);
+  std::string stamp;
+  GitRevision resolved;
+
+  // Stamp references before resolving so updates are never missed.
+  if (cacheable) {
+    stamp = GitRevisionCache::RefsStamp(this->handles.gitdir(), revision);
+    if (this->revisions.get(revision, stamp, &resolved)) {
+      return resolved;
+    }
+  }
+
+  GitRepoPool::Handle handle(&this->handles);
+  git_commit* commit = this->resolveCommit(handle.get(), revision);
+  resolved.commit = *git_commit_id(commit);
+  resolved.tree = *git_commit_tree_id(commit);
+  git_commit_free(commit);
+
+  if (cacheable) {
+    this->revisions.put(revision, stamp, resolved);
+  }
+  return resolved;
+}
+
+GitRevision GitRepo::resolveChecked(const std::string version) {
+  try {
+    // Resolve <latest> special version.
+    if (version == "<latest>") {
+      return this->resolveRevision(this->latest_alias);
+    }
+    return this->resolveRevision(version);
+
+  } catch (GitTypeError&) {
+    throw GitInvalidVersion(version);
 
-GitRepo::GitRepo(std::string path, std::string latest) {
+  } catch (GitException& exc) {
+    // If the version cannot be parsed or the commit
+    // cannot be found throw an exception.
+    int code = exc.gitCode();
+    if (code == GIT_ENOTFOUND || code == GIT_EAMBIGUOUS) {
+      throw GitInvalidVersion(version);
+    }
+
+    // Otherwise propagate the original exception.
+    throw;
+  }
+}
+
+GitBlobRef GitRepo::lookupBlob(const git_oid* id) {
+  GitBlobRef blob = this->blobs.get(id);
+  if (blob) {
+    return blob;
+  }
+
+  GitRepoPool::Handle handle(&this->handles);
+  git_blob* raw = nullptr;
+  int error = git_blob_lookup(&raw, handle.get(), id);
+  GitException::checkGitError(error);
+  blob = GitBlobRef(new GitBlob(raw));
+  this->blobs.put(id, blob);
+  return blob;
+}
+
+
+GitRepo::GitRepo(
+    std::string path, std::string latest,
+    size_t stream_threshold, size_t stream_chunk, size_t cache_size,
+    size_t handles
+) : handles(path, handles), blobs(cache_size), versions(VERSION_CACHE) {
   this->latest_alias = latest;
   this->path = path;
-  this->repo = nullptr;
+  this->stream_threshold = stream_threshold;
+  this->stream_chunk = stream_chunk;
+  this->cache_size = cache_size;
 }
 
 GitRepo::~GitRepo() {
-  if (this->repo) {
-    git_repository_free(this->repo);
-  }
+  this->versions.clear();
+  this->blobs.clear();
+}
+
+GitBlobCache* GitRepo::cache() {
+  return &this->blobs;
+}
+
+std::string GitRepo::gitdir() {
+  return this->handles.gitdir();
+}
+
+std::string GitRepo::latestAlias() const {
+  return this->latest_alias;
 }
 
 RepositoryVersionRef GitRepo::latest() {
@@ -65,129 +232,449 @@ RepositoryVersionRef GitRepo::latest() {
 }
 
 RepositoryVersionRef GitRepo::version(std::string revision) {
-  git_commit* commit = this->resolveCommit(revision);
-  git_tree*   tree   = nullptr;
-
-  int error = git_commit_tree(&tree, commit);
-  git_commit_free(commit);
+  GitRevision resolved = this->resolveRevision(revision);
+  RepositoryVersionRef version = this->versions.get(&resolved.tree);
+  if (version) {
+    return version;
+  }
 
+  GitRepoPool::Handle handle(&this->handles);
+  git_tree* tree = nullptr;
+  int error = git_tree_lookup(&tree, handle.get(), &resolved.tree);
   GitException::checkGitError(error);
-  return RepositoryVersionRef(new GitRepoVersion(this, tree));
+  version = RepositoryVersionRef(new GitRepoVersion(this, tree));
+  this->versions.put(&resolved.tree, version);
+  return version;
 }
 
 std::string GitRepo::resolveVersion(const std::string version) {
-  this->verifyVersion(version);
-  git_commit* commit = nullptr;
-
-  // Resolve <latest> special version.
-  if (version == "<latest>") {
-    commit = this->resolveCommit(this->latest_alias);
-  } else {
-    commit = this->resolveCommit(version);
-  }
+  GitRevision resolved = this->resolveChecked(version);
 
   // Get commit ID.
   char oidstr[GIT_OID_HEXSZ + 1];
-  git_oid_tostr(oidstr, sizeof(oidstr), git_commit_id(commit));
-
-  git_commit_free(commit);
+  git_oid_tostr(oidstr, sizeof(oidstr), &resolved.commit);
   return std::string(oidstr);
 }
 
 void GitRepo::verifyVersion(const std::string version) {
-  // Try to resolve the commit.
-  try {
-    // Resolve <latest> special version.
-    if (version == "<latest>") {
-      this->resolveCommit(this->latest_alias);
-    } else {
-      this->resolveCommit(version);
-    }
+  this->resolveChecked(version);
+}
 
-  } catch (GitTypeError&) {
-    throw GitInvalidVersion(version);
+GitChanges GitRepo::diff(const std::string from, const std::string to) {
+  GitRevision old_revision = this->resolveChecked(from);
+  GitRevision new_revision = this->resolveChecked(to);
+  GitChanges changes;
+  if (git_oid_equal(&old_revision.tree, &new_revision.tree)) {
+    return changes;
+  }
 
-  } catch (GitException& exc) {
-    // If the version cannot be parsed or the commit
-    // cannot be found throw an exception.
-    int code = exc.gitCode();
-    if (code == GIT_ENOTFOUND || code == GIT_EAMBIGUOUS) {
-      throw GitInvalidVersion(version);
-    }
+  // Look the trees up and diff them.
+  GitRepoPool::Handle handle(&this->handles);
+  git_tree* old_tree = nullptr;
+  git_tree* new_tree = nullptr;
+  git_diff* diff = nullptr;
+  int error = git_tree_lookup(&old_tree, handle.get(), &old_revision.tree);
+  if (error == 0) {
+    error = git_tree_lookup(&new_tree, handle.get(), &new_revision.tree);
+  }
+  if (error == 0) {
+    git_diff_options options = GIT_DIFF_OPTIONS_INIT;
+    options.flags |= GIT_DIFF_SKIP_BINARY_CHECK;
+    options.flags |= GIT_DIFF_INCLUDE_TYPECHANGE;
+    error = git_diff_tree_to_tree(
+        &diff, handle.get(), old_tree, new_tree, &options
+    );
+  }
+  git_tree_free(old_tree);
+  git_tree_free(new_tree);
+  GitException::checkGitError(error);
 
-    // Otherwise propagate the original exception.
-    throw;
+  // Convert deltas to changes.
+  size_t count = git_diff_num_deltas(diff);
+  changes.reserve(count);
+  for (size_t idx = 0; idx < count; idx++) {
+    const git_diff_delta* delta = git_diff_get_delta(diff, idx);
+    GitChange change;
+    change.old_id = delta->old_file.id;
+    change.new_id = delta->new_file.id;
+    change.path = delta->new_file.path;
+
+    switch (delta->status) {
+      case GIT_DELTA_ADDED:
+        change.type = GitChangeType::ADDED;
+        break;
+      case GIT_DELTA_DELETED:
+        change.type = GitChangeType::REMOVED;
+        change.path = delta->old_file.path;
+        break;
+      case GIT_DELTA_MODIFIED:
+      case GIT_DELTA_TYPECHANGE:
+        change.type = GitChangeType::MODIFIED;
+        break;
+      default:
+        continue;
+    }
+    changes.push_back(change);
   }
+  git_diff_free(diff);
+  return changes;
 }
 
 
 GitRepoVersion::GitRepoVersion(GitRepo* repo, git_tree* tree) {
   this->repo = repo;
   this->tree = tree;
+  this->blobs_size = 0;
 }
 
 GitRepoVersion::~GitRepoVersion() {
+  for (auto& subtree : this->subtrees) {
+    if (subtree.second) {
+      git_tree_free(subtree.second);
+    }
+  }
   git_tree_free(this->tree);
 }
 
-bool GitRepoVersion::exists(const std::string path) {
-  git_tree_entry* entry = nullptr;
-  int error = git_tree_entry_bypath(&entry, this->tree, path.c_str());
-  if (error == GIT_ENOTFOUND) {
-    return false;
+int GitRepoVersion::entryByPath(
+    git_tree_entry** entry, const std::string& path
+) {
+  GitRepoPool::Handle handle(&this->repo->handles);
+  git_tree* root = nullptr;
+  int error = git_tree_lookup(&root, handle.get(), git_tree_id(this->tree));
+  if (error != 0) {
+    return error;
   }
+  error = git_tree_entry_bypath(entry, root, path.c_str());
+  git_tree_free(root);
+  return error;
+}
 
-  GitException::checkGitError(error);
-  git_tree_entry_free(entry);
-  return true;
+GitRepoVersion::Entry GitRepoVersion::lookupEntry(const std::string& path) {
+  auto memo = this->entries.find(path);
+  if (memo != this->entries.end()) {
+    return memo->second;
+  }
+
+  Entry entry = {GIT_OBJ_BAD, {{0}}};
+
+  // Leave paths with empty components to libgit2.
+  if (path.empty() || path.front() == '/' || path.back() == '/' ||
+      path.find("//") != std::string::npos) {
+    git_tree_entry* found = nullptr;
+    int error = this->entryByPath(&found, path);
+    if (error == 0) {
+      entry.type = git_tree_entry_type(found);
+      entry.id = *git_tree_entry_id(found);
+      git_tree_entry_free(found);
+    } else if (error != GIT_ENOTFOUND) {
+      GitException::checkGitError(error);
+    }
+    this->entries[path] = entry;
+    return entry;
+  }
+
+  // Prefetched directories have all their entries memoized.
+  for (auto& dir : this->complete) {
+    if (dir.empty() || path.compare(0, dir.size() + 1, dir + "/") == 0) {
+      this->entries[path] = entry;
+      return entry;
+    }
+  }
+
+  // Look the name up in the (memoized) parent directory.
+  std::string dir;
+  std::string name = path;
+  size_t slash = path.rfind('/');
+  if (slash != std::string::npos) {
+    dir = path.substr(0, slash);
+    name = path.substr(slash + 1);
+  }
+
+  git_tree* parent = this->lookupTree(dir);
+  if (parent) {
+    const git_tree_entry* found = git_tree_entry_byname(parent, name.c_str());
+    if (found) {
+      entry.type = git_tree_entry_type(found);
+      entry.id = *git_tree_entry_id(found);
+    }
+  }
+  this->entries[path] = entry;
+  return entry;
 }
 
-std::string GitRepoVersion::readFile(const std::string path) {
-  // Get tree entry from path.
-  git_tree_entry* entry = nullptr;
-  int error = git_tree_entry_bypath(&entry, this->tree, path.c_str());
-  GitException::checkGitError(error);
+git_tree* GitRepoVersion::lookupTree(const std::string& path) {
+  if (path.empty()) {
+    return this->tree;
+  }
+  auto memo = this->subtrees.find(path);
+  if (memo != this->subtrees.end()) {
+    return memo->second;
+  }
+
+  git_tree* subtree = nullptr;
+  Entry entry = this->lookupEntry(path);
+  if (entry.type == GIT_OBJ_TREE) {
+    GitRepoPool::Handle handle(&this->repo->handles);
+    int error = git_tree_lookup(&subtree, handle.get(), &entry.id);
+    GitException::checkGitError(error);
+  }
+  this->subtrees[path] = subtree;
+  return subtree;
+}
+
+git_tree* GitRepoVersion::directory(const std::string& path) {
+  if (path.empty()) {
+    return this->tree;
+  }
+
+  // Let libgit2 report missing paths with its usual error.
+  Entry entry = this->lookupEntry(path);
+  if (entry.type == GIT_OBJ_BAD) {
+    git_tree_entry* missing = nullptr;
+    int error = this->entryByPath(&missing, path);
+    GitException::checkGitError(error);
+    git_tree_entry_free(missing);
+  }
+  if (entry.type != GIT_OBJ_TREE) {
+    throw GitTypeError(GIT_OBJ_TREE, entry.type);
+  }
+  return this->lookupTree(path);
+}
+
+GitRepoVersion::Entry GitRepoVersion::entry(const std::string& path) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  return this->lookupEntry(path);
+}
+
+bool GitRepoVersion::exists(const std::string path) {
+  return this->entry(path).type != GIT_OBJ_BAD;
+}
+
+git_oid GitRepoVersion::blobId(const std::string path) {
+  Entry entry = this->entry(path);
+
+  // Let libgit2 report missing paths with its usual error.
+  if (entry.type == GIT_OBJ_BAD) {
+    git_tree_entry* missing = nullptr;
+    int error = this->entryByPath(&missing, path);
+    GitException::checkGitError(error);
+    git_tree_entry_free(missing);
+  }
 
   // Check type is blob.
-  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB) {
-    git_tree_entry_free(entry);
-    throw GitTypeError(GIT_OBJ_BLOB, git_tree_entry_type(entry));
+  if (entry.type != GIT_OBJ_BLOB) {
+    throw GitTypeError(GIT_OBJ_BLOB, entry.type);
   }
+  return entry.id;
+}
 
-  // Convert to blob.
-  git_blob* blob = nullptr;
-  error = git_blob_lookup(&blob, this->repo->repo, git_tree_entry_id(entry));
-  git_tree_entry_free(entry);
+IStreamRef GitRepoVersion::streamObject(const git_oid* id) {
+  GitRepoPool::Handle handle(&this->repo->handles);
+  git_odb* odb = nullptr;
+  int error = git_repository_odb(&odb, handle.get());
   GitException::checkGitError(error);
 
-  // Copy the blob as a string.
-  const char* raw_string = reinterpret_cast<const char*>(
-      git_blob_rawcontent(blob)
+  // Small objects are cheaper to load in one go.
+  size_t size = 0;
+  git_otype type = GIT_OBJ_BAD;
+  error = git_odb_read_header(&size, &type, odb, id);
+  if (error != 0) {
+    git_odb_free(odb);
+    GitException::checkGitError(error);
+  }
+  if (size < this->repo->stream_threshold) {
+    git_odb_free(odb);
+    return nullptr;
+  }
+
+  // Not all backends can stream objects (packs can't).
+  git_odb_stream* stream = nullptr;
+  error = git_odb_open_rstream(&stream, odb, id);
+  if (error != 0) {
+    giterr_clear();
+    git_odb_free(odb);
+    return nullptr;
+  }
+
+  GitOdbStreamBuf* buffer = new GitOdbStreamBuf(
+      odb, stream, this->repo->stream_chunk
   );
-  auto size = git_blob_rawsize(blob);
-  return std::string(raw_string, size);
+  return IStreamRef(new GitBlobStream(buffer));
 }
 
-IStreamRef GitRepoVersion::streamFile(const std::string path) {
-  // Get tree entry from path.
-  git_tree_entry* entry = nullptr;
-  int error = git_tree_entry_bypath(&entry, this->tree, path.c_str());
-  GitException::checkGitError(error);
+GitBlobRef GitRepoVersion::prefetched(const std::string& path) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto blob = this->blobs.find(path);
+  if (blob == this->blobs.end()) {
+    return nullptr;
+  }
+  return blob->second;
+}
 
-  // Check type is blob.
-  if (git_tree_entry_type(entry) != GIT_OBJ_BLOB) {
-    git_tree_entry_free(entry);
-    throw GitTypeError(GIT_OBJ_BLOB, git_tree_entry_type(entry));
+GitBlobRef GitRepoVersion::readBlob(const std::string path) {
+  GitBlobRef blob = this->prefetched(path);
+  if (blob) {
+    return blob;
   }
+  git_oid id = this->blobId(path);
+  return this->repo->lookupBlob(&id);
+}
 
-  // Convert to blob.
-  git_blob* blob = nullptr;
-  error = git_blob_lookup(&blob, this->repo->repo, git_tree_entry_id(entry));
-  git_tree_entry_free(entry);
-  GitException::checkGitError(error);
+std::string GitRepoVersion::readFile(const std::string path) {
+  return this->readBlob(path)->str();
+}
+
+IStreamRef GitRepoVersion::streamFile(const std::string path) {
+  GitBlobRef blob = this->prefetched(path);
+  if (blob) {
+    return IStreamRef(new GitBlobStream(new GitBlobStreamBuf(blob)));
+  }
+
+  git_oid id = this->blobId(path);
+  IStreamRef stream = this->streamObject(&id);
+  if (stream) {
+    return stream;
+  }
 
-  // Build stream and return.
-  GitBlobStreamBuf* buffer = new GitBlobStreamBuf(blob);
-  git_blob_free(blob);
+  GitBlobStreamBuf* buffer = new GitBlobStreamBuf(
+      this->repo->lookupBlob(&id)
+  );
   return IStreamRef(new GitBlobStream(buffer));
 }
+
+std::vector<std::string> GitRepoVersion::readFiles(
+    const std::vector<std::string>& paths
+) {
+  std::vector<std::string> contents(paths.size());
+  run_parallel(
+      paths.size(), this->repo->handles.size(),
+      [this, &paths, &contents](size_t idx) {
+        contents[idx] = this->readFile(paths[idx]);
+      }
+  );
+  return contents;
+}
+
+GitTreeIteratorRef GitRepoVersion::list(
+    const std::string dir, bool recursive, const std::string pattern
+) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  git_tree* tree = this->directory(dir);
+  return GitTreeIteratorRef(new GitTreeIterator(
+      &this->repo->handles, tree, dir, recursive, pattern
+  ));
+}
+
+void GitRepoVersion::prefetch(const std::string dir) {
+  struct Walk {
+    GitRepoVersion* version;
+    std::string prefix;
+    std::vector<std::pair<std::string, git_oid>> files;
+  };
+  Walk walk = {this, dir.empty() ? "" : dir + "/", {}};
+
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    git_tree* root = this->directory(dir);
+
+    // Walk a copy of the tree from a leased handle, as subtrees
+    // are looked up through the handle that owns the tree.
+    GitRepoPool::Handle handle(&this->repo->handles);
+    git_tree* walked = nullptr;
+    int error = git_tree_lookup(&walked, handle.get(), git_tree_id(root));
+    GitException::checkGitError(error);
+
+    // Memoize every entry in the tree in one pass.
+    error = git_tree_walk(walked, GIT_TREEWALK_PRE, [](
+        const char* parent, const git_tree_entry* found, void* payload
+    ) {
+      Walk* walk = reinterpret_cast<Walk*>(payload);
+      std::string path = walk->prefix + parent + git_tree_entry_name(found);
+      Entry entry = {git_tree_entry_type(found), *git_tree_entry_id(found)};
+      walk->version->entries[path] = entry;
+      bool loaded = walk->version->blobs.count(path) > 0;
+      if (entry.type == GIT_OBJ_BLOB && !loaded) {
+        walk->files.emplace_back(path, entry.id);
+      }
+      return 0;
+    }, &walk);
+    git_tree_free(walked);
+    GitException::checkGitError(error);
+    this->complete.push_back(dir);
+  }
+
+  // Load each distinct blob once, outside the lock.
+  std::unordered_map<std::string, size_t> unique;
+  std::vector<git_oid> ids;
+  for (auto& file : walk.files) {
+    if (unique.emplace(oid_key(&file.second), ids.size()).second) {
+      ids.push_back(file.second);
+    }
+  }
+
+  std::vector<size_t> sizes(ids.size());
+  run_parallel(
+      ids.size(), this->repo->handles.size(),
+      [this, &ids, &sizes](size_t idx) {
+        sizes[idx] = object_size(&this->repo->handles, &ids[idx]);
+      }
+  );
+
+  // Leave files that are streamed and those past the limit.
+  // The budget is reserved under the lock so concurrent prefetches
+  // can't exceed it together, blobs already counted are free.
+  std::vector<size_t> selected;
+  std::vector<size_t> reserved;
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    for (size_t idx = 0; idx < ids.size(); idx++) {
+      if (sizes[idx] >= this->repo->stream_threshold) {
+        continue;
+      }
+      std::string key = oid_key(&ids[idx]);
+      if (this->blob_ids.count(key) == 0) {
+        if (this->blobs_size + sizes[idx] > this->repo->cache_size) {
+          continue;
+        }
+        this->blobs_size += sizes[idx];
+        this->blob_ids.insert(key);
+        reserved.push_back(idx);
+      }
+      selected.push_back(idx);
+    }
+  }
+
+  std::vector<GitBlobRef> loaded(ids.size());
+  std::exception_ptr error;
+  try {
+    run_parallel(
+        selected.size(), this->repo->handles.size(),
+        [this, &ids, &loaded, &selected](size_t idx) {
+          size_t id = selected[idx];
+          loaded[id] = this->repo->lookupBlob(&ids[id]);
+        }
+    );
+  } catch (...) {
+    error = std::current_exception();
+  }
+
+  // Release the budget of blobs that failed to load and keep
+  // the others, paths prefetched meanwhile are left alone.
+  std::lock_guard<std::mutex> guard(this->lock);
+  for (size_t idx : reserved) {
+    if (!loaded[idx]) {
+      this->blobs_size -= sizes[idx];
+      this->blob_ids.erase(oid_key(&ids[idx]));
+    }
+  }
+  for (auto& file : walk.files) {
+    GitBlobRef blob = loaded[unique[oid_key(&file.second)]];
+    if (blob) {
+      this->blobs.emplace(file.first, blob);
+    }
+  }
+  if (error) {
+    std::rethrow_exception(error);
+  }
+}
@@ -1,33 +1,74 @@
 // Copyright 2015 Stefano Pogliani <stefano@spogliani.net>
-#include <algorithm>
-
 #include "ext/repository/git/istream.h"
 
+#include <git2.h>
+
+#include "ext/repository/git/exceptions.h"
+
+using sf::ext::exception::GitException;
+
+using sf::ext::repository::GitBlob;
+using sf::ext::repository::GitBlobRef;
 using sf::ext::repository::GitBlobStreamBuf;
 using sf::ext::repository::GitBlobStream;
+using sf::ext::repository::GitOdbStreamBuf;
 
 
-GitBlobStreamBuf::GitBlobStreamBuf(git_blob* blob) {
-  const char* src = reinterpret_cast<const char*>(git_blob_rawcontent(blob));
-  this->size = git_blob_rawsize(blob);
-  this->content = nullptr;
+//! Takes a new reference to a blob without copying its content.
+static GitBlobRef dup_blob(git_blob* blob) {
+  git_object* copy = nullptr;
+  int error = git_object_dup(&copy, reinterpret_cast<git_object*>(blob));
+  GitException::checkGitError(error);
+  return GitBlobRef(new GitBlob(reinterpret_cast<git_blob*>(copy)));
+}
 
-  if (this->size != 0) {
-    this->content = new char[this->size];
-    std::copy(src, src + this->size, this->content);
-  }
 
-  this->setg(this->content, this->content, this->content + this->size);
+GitBlobStreamBuf::GitBlobStreamBuf(git_blob* blob) :
+    GitBlobStreamBuf(dup_blob(blob)) {}
+
+GitBlobStreamBuf::GitBlobStreamBuf(GitBlobRef blob) {
+  this->blob = blob;
+
+  // The get area is never written to so the const_cast is safe.
+  char* content = const_cast<char*>(this->blob->data());
+  this->setg(content, content, content + this->blob->size());
 }
 
-GitBlobStreamBuf::~GitBlobStreamBuf() {
-  if (this->content) {
-    delete [] content;
+
+GitOdbStreamBuf::GitOdbStreamBuf(
+    git_odb* odb, git_odb_stream* stream, size_t chunk
+) {
+  this->odb = odb;
+  this->stream = stream;
+  this->chunk.resize(chunk > 0 ? chunk : 1);
+  this->setg(nullptr, nullptr, nullptr);
+}
+
+GitOdbStreamBuf::~GitOdbStreamBuf() {
+  git_odb_stream_free(this->stream);
+  git_odb_free(this->odb);
+}
+
+GitOdbStreamBuf::int_type GitOdbStreamBuf::underflow() {
+  if (this->gptr() < this->egptr()) {
+    return traits_type::to_int_type(*this->gptr());
+  }
+
+  // Refill the buffer with the next chunk.
+  char* start = this->chunk.data();
+  int read = git_odb_stream_read(this->stream, start, this->chunk.size());
+  if (read < 0) {
+    GitException::checkGitError(read);
+  }
+  if (read == 0) {
+    return traits_type::eof();
   }
+  this->setg(start, start, start + read);
+  return traits_type::to_int_type(*this->gptr());
 }
 
 
-GitBlobStream::GitBlobStream(GitBlobStreamBuf* buffer) : std::istream(buffer) {
+GitBlobStream::GitBlobStream(std::streambuf* buffer) : std::istream(buffer) {
   this->buffer = buffer;
 }
 
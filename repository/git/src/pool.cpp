@@ -0,0 +1,92 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/pool.h"
+
+#include <git2.h>
+
+#include <mutex>
+#include <string>
+
+#include "ext/repository/git/exceptions.h"
+
+using sf::ext::exception::GitException;
+using sf::ext::repository::GitRepoPool;
+
+
+GitRepoPool::Handle::Handle(GitRepoPool* pool) {
+  this->pool = pool;
+  this->repo = pool->acquire();
+}
+
+GitRepoPool::Handle::~Handle() {
+  this->pool->release(this->repo);
+}
+
+git_repository* GitRepoPool::Handle::get() const {
+  return this->repo;
+}
+
+
+git_repository* GitRepoPool::acquire() {
+  std::unique_lock<std::mutex> guard(this->lock);
+  this->released.wait(guard, [this]() {
+    return !this->idle.empty() || this->opened < this->capacity;
+  });
+  if (!this->idle.empty()) {
+    git_repository* repo = this->idle.back();
+    this->idle.pop_back();
+    return repo;
+  }
+
+  // Open a new handle without blocking other threads.
+  this->opened += 1;
+  guard.unlock();
+  git_repository* repo = nullptr;
+  int error = git_repository_open(&repo, this->path.c_str());
+  guard.lock();
+
+  if (error != 0) {
+    this->opened -= 1;
+    this->released.notify_one();
+    GitException::checkGitError(error);
+  }
+  if (this->git_path.empty()) {
+    this->git_path = git_repository_path(repo);
+  }
+  return repo;
+}
+
+void GitRepoPool::release(git_repository* repo) {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    this->idle.push_back(repo);
+  }
+  this->released.notify_one();
+}
+
+
+GitRepoPool::GitRepoPool(std::string path, size_t capacity) {
+  this->path = path;
+  this->capacity = capacity > 0 ? capacity : 1;
+  this->opened = 0;
+}
+
+GitRepoPool::~GitRepoPool() {
+  for (git_repository* repo : this->idle) {
+    git_repository_free(repo);
+  }
+}
+
+size_t GitRepoPool::size() const {
+  return this->capacity;
+}
+
+std::string GitRepoPool::gitdir() {
+  {
+    std::lock_guard<std::mutex> guard(this->lock);
+    if (!this->git_path.empty()) {
+      return this->git_path;
+    }
+  }
+  Handle handle(this);
+  return git_repository_path(handle.get());
+}
@@ -0,0 +1,112 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/revisions.h"
+
+#include <sys/stat.h>
+
+#include <mutex>
+#include <string>
+
+using sf::ext::repository::GitRevision;
+using sf::ext::repository::GitRevisionCache;
+
+
+//! Checks if a revision is a full, hex encoded, commit id.
+static bool is_full_id(const std::string& revision) {
+  if (revision.size() != GIT_OID_HEXSZ) {
+    return false;
+  }
+  return revision.find_first_not_of("0123456789abcdef") == std::string::npos;
+}
+
+//! Appends the identity of a file to a stamp.
+static void stamp_file(std::string* stamp, const std::string& path) {
+  struct stat info;
+  if (stat(path.c_str(), &info) != 0) {
+    *stamp += "-;";
+    return;
+  }
+  *stamp += std::to_string(info.st_ino) + ":" +
+    std::to_string(info.st_mtim.tv_sec) + "." +
+    std::to_string(info.st_mtim.tv_nsec) + ":" +
+    std::to_string(info.st_size) + ";";
+}
+
+
+bool GitRevisionCache::IsCacheable(const std::string& revision) {
+  if (revision.empty()) {
+    return false;
+  }
+  if (is_full_id(revision)) {
+    return true;
+  }
+
+  // HEAD is symbolic and can move without its file changing.
+  if (revision.find("HEAD") != std::string::npos) {
+    return false;
+  }
+  if (revision.find("..") != std::string::npos) {
+    return false;
+  }
+
+  // Only plain reference names, expressions like `master~1` are not.
+  const char* allowed =
+    "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789._-/";
+  return revision.find_first_not_of(allowed) == std::string::npos;
+}
+
+std::string GitRevisionCache::RefsStamp(
+    const std::string& gitdir, const std::string& revision
+) {
+  if (is_full_id(revision)) {
+    return "";
+  }
+
+  // Same lookup order git uses to expand reference names.
+  std::string dir = gitdir;
+  if (!dir.empty() && dir.back() != '/') {
+    dir += "/";
+  }
+  std::string stamp;
+  stamp_file(&stamp, dir + "packed-refs");
+  stamp_file(&stamp, dir + revision);
+  stamp_file(&stamp, dir + "refs/" + revision);
+  stamp_file(&stamp, dir + "refs/tags/" + revision);
+  stamp_file(&stamp, dir + "refs/heads/" + revision);
+  stamp_file(&stamp, dir + "refs/remotes/" + revision);
+  return stamp;
+}
+
+
+GitRevisionCache::GitRevisionCache(size_t capacity) {
+  this->capacity = capacity;
+}
+
+bool GitRevisionCache::get(
+    const std::string& revision, const std::string& stamp,
+    GitRevision* resolved
+) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  auto entry = this->entries.find(revision);
+  if (entry == this->entries.end() || entry->second.stamp != stamp) {
+    return false;
+  }
+  *resolved = entry->second.revision;
+  return true;
+}
+
+void GitRevisionCache::put(
+    const std::string& revision, const std::string& stamp,
+    const GitRevision& resolved
+) {
+  std::lock_guard<std::mutex> guard(this->lock);
+  if (this->entries.size() >= this->capacity) {
+    this->entries.clear();
+  }
+  Entry entry = {resolved, stamp};
+  this->entries[revision] = entry;
+}
+
+void GitRevisionCache::clear() {
+  std::lock_guard<std::mutex> guard(this->lock);
+  this->entries.clear();
+}
@@ -0,0 +1,106 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/tree.h"
+
+#include <fnmatch.h>
+#include <git2.h>
+
+#include <string>
+#include <vector>
+
+#include "ext/repository/git/exceptions.h"
+#include "ext/repository/git/pool.h"
+
+using sf::ext::exception::GitException;
+
+using sf::ext::repository::GitRepoPool;
+using sf::ext::repository::GitTreeEntry;
+using sf::ext::repository::GitTreeIterator;
+
+
+bool GitTreeIterator::Matches(
+    const std::string& pattern, const std::string& path
+) {
+  if (pattern.empty()) {
+    return true;
+  }
+  if (pattern.find('/') != std::string::npos) {
+    return fnmatch(pattern.c_str(), path.c_str(), FNM_PATHNAME) == 0;
+  }
+
+  size_t slash = path.rfind('/');
+  std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+  return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+bool GitTreeIterator::matches(const GitTreeEntry& entry) const {
+  return GitTreeIterator::Matches(
+      this->pattern, entry.path.substr(this->base.size())
+  );
+}
+
+
+GitTreeIterator::GitTreeIterator(
+    GitRepoPool* handles, git_tree* tree, std::string dir,
+    bool recursive, std::string pattern
+) {
+  this->handles = handles;
+  this->base = dir.empty() ? "" : dir + "/";
+  this->recursive = recursive;
+  this->pattern = pattern;
+
+  git_object* root = nullptr;
+  int error = git_object_dup(&root, reinterpret_cast<git_object*>(tree));
+  GitException::checkGitError(error);
+  Frame frame = {reinterpret_cast<git_tree*>(root), this->base, 0};
+  this->stack.push_back(frame);
+}
+
+GitTreeIterator::~GitTreeIterator() {
+  for (auto& frame : this->stack) {
+    git_tree_free(frame.tree);
+  }
+}
+
+bool GitTreeIterator::next(GitTreeEntry* entry) {
+  while (!this->stack.empty()) {
+    Frame& top = this->stack.back();
+    if (top.index >= git_tree_entrycount(top.tree)) {
+      git_tree_free(top.tree);
+      this->stack.pop_back();
+      continue;
+    }
+
+    const git_tree_entry* found = git_tree_entry_byindex(
+        top.tree, top.index++
+    );
+    entry->name = git_tree_entry_name(found);
+    entry->path = top.prefix + entry->name;
+    entry->type = git_tree_entry_type(found);
+    entry->mode = git_tree_entry_filemode(found);
+    entry->id = *git_tree_entry_id(found);
+
+    // Enter subtrees after their entry is returned.
+    if (this->recursive && entry->type == GIT_OBJ_TREE) {
+      GitRepoPool::Handle handle(this->handles);
+      git_tree* subtree = nullptr;
+      int error = git_tree_lookup(&subtree, handle.get(), &entry->id);
+      GitException::checkGitError(error);
+      Frame frame = {subtree, entry->path + "/", 0};
+      this->stack.push_back(frame);
+    }
+
+    if (this->matches(*entry)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+std::vector<GitTreeEntry> GitTreeIterator::all() {
+  std::vector<GitTreeEntry> entries;
+  GitTreeEntry entry;
+  while (this->next(&entry)) {
+    entries.push_back(entry);
+  }
+  return entries;
+}
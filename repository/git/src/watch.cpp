@@ -0,0 +1,135 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include "ext/repository/git/watch.h"
+
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <exception>
+#include <string>
+
+#include "core/context/context.h"
+#include "core/exceptions/base.h"
+#include "core/model/logger.h"
+
+#include "ext/repository/git.h"
+
+
+using sf::core::context::ProxyLogger;
+using sf::core::exception::ErrNoException;
+using sf::core::model::Event;
+using sf::core::model::EventRef;
+using sf::core::model::EventSource;
+using sf::core::model::LogInfo;
+
+using sf::ext::repository::GitRefCallback;
+using sf::ext::repository::GitRefChange;
+using sf::ext::repository::GitRefEvent;
+using sf::ext::repository::GitRefWatcher;
+using sf::ext::repository::GitRepo;
+
+
+static ProxyLogger logger("ext.repository.git");
+
+
+GitRefEvent::GitRefEvent(
+    GitRefChange change, GitRefCallback callback
+) : Event(change.new_commit, "NULL") {
+  this->change_ = change;
+  this->callback = callback;
+}
+
+const GitRefChange& GitRefEvent::change() const {
+  return this->change_;
+}
+
+void GitRefEvent::handle() {
+  this->callback(this->change_);
+}
+
+
+void GitRefWatcher::watch(const std::string& path) {
+  struct stat info;
+  if (::stat(path.c_str(), &info) != 0 || !S_ISDIR(info.st_mode)) {
+    return;
+  }
+  int watch = inotify_add_watch(
+      this->inotify_fd, path.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO
+  );
+  if (watch < 0) {
+    throw ErrNoException("Unable to watch git references in " + path);
+  }
+}
+
+std::string GitRefWatcher::resolve() {
+  try {
+    return this->repo->resolveVersion(this->ref);
+  } catch (std::exception& ex) {
+    LogInfo vars = {{"ref", this->ref}, {"error", ex.what()}};
+    WARNINGV(logger, "Unable to resolve git reference ${ref}: ${error}", vars);
+    return "";
+  }
+}
+
+EventRef GitRefWatcher::parse() {
+  // Drain all queued events, any of them may have moved the reference.
+  char buffer[4096]
+    __attribute__((aligned(__alignof__(struct inotify_event))));
+  while (::read(this->inotify_fd, buffer, sizeof(buffer)) > 0) {
+    continue;
+  }
+
+  std::string commit = this->resolve();
+  if (commit.empty() || commit == this->commit_) {
+    return EventRef();
+  }
+  GitRefChange change = {this->ref, this->commit_, commit};
+  this->commit_ = commit;
+  return EventRef(new GitRefEvent(change, this->callback));
+}
+
+
+GitRefWatcher::GitRefWatcher(
+    std::string id, std::shared_ptr<GitRepo> repo,
+    GitRefCallback callback, std::string ref
+) : EventSource(id) {
+  this->repo = repo;
+  this->ref = ref.empty() ? repo->latestAlias() : ref;
+  this->callback = callback;
+  this->inotify_fd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+  if (this->inotify_fd < 0) {
+    throw ErrNoException("Unable to create git inotify instance");
+  }
+
+  // Watch where git may store the reference (see GitRevisionCache).
+  try {
+    std::string gitdir = repo->gitdir();
+    std::string name = this->ref;
+    size_t slash = name.rfind('/');
+    std::string parent = slash == std::string::npos ? "" : name.substr(
+        0, slash + 1
+    );
+    this->watch(gitdir);
+    this->watch(gitdir + parent);
+    this->watch(gitdir + "refs/" + parent);
+    this->watch(gitdir + "refs/tags/" + parent);
+    this->watch(gitdir + "refs/heads/" + parent);
+    this->watch(gitdir + "refs/remotes/" + parent);
+  } catch (...) {
+    ::close(this->inotify_fd);
+    throw;
+  }
+  this->commit_ = this->resolve();
+}
+
+GitRefWatcher::~GitRefWatcher() {
+  ::close(this->inotify_fd);
+}
+
+int GitRefWatcher::fd() {
+  return this->inotify_fd;
+}
+
+std::string GitRefWatcher::commit() const {
+  return this->commit_;
+}
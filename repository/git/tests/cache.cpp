@@ -0,0 +1,200 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+
+#include "core/model/repository.h"
+#include "ext/repository/git/blob.h"
+#include "ext/repository/git/cache.h"
+#include "ext/repository/git/exceptions.h"
+
+using sf::core::model::IStreamRef;
+using sf::core::model::RepositoryVersion;
+using sf::core::model::RepositoryVersionRef;
+
+using sf::ext::exception::GitException;
+
+using sf::ext::repository::GitBlob;
+using sf::ext::repository::GitBlobCache;
+using sf::ext::repository::GitBlobRef;
+using sf::ext::repository::GitVersionCache;
+
+
+class GitBlobCacheTest : public ::testing::Test {
+ protected:
+  std::string path;
+  git_repository* repo;
+
+ public:
+  GitBlobCacheTest() {
+    git_libgit2_init();
+    char dir[] = "/tmp/sf-git-cache-XXXXXX";
+    this->path = mkdtemp(dir);
+    int error = git_repository_init(&this->repo, this->path.c_str(), 1);
+    GitException::checkGitError(error);
+  }
+
+  ~GitBlobCacheTest() {
+    git_repository_free(this->repo);
+    std::string cmd = "rm -rf " + this->path;
+    system(cmd.c_str());
+  }
+
+  //! Writes a blob and loads it back, returning its id.
+  GitBlobRef blob(std::string content, git_oid* id) {
+    int error = git_blob_create_frombuffer(
+        id, this->repo, content.data(), content.size()
+    );
+    GitException::checkGitError(error);
+
+    git_blob* blob = nullptr;
+    error = git_blob_lookup(&blob, this->repo, id);
+    GitException::checkGitError(error);
+    return GitBlobRef(new GitBlob(blob));
+  }
+};
+
+
+TEST_F(GitBlobCacheTest, Miss) {
+  git_oid id;
+  this->blob("content", &id);
+  GitBlobCache cache(1024);
+  ASSERT_EQ(nullptr, cache.get(&id));
+}
+
+TEST_F(GitBlobCacheTest, Hit) {
+  git_oid id;
+  GitBlobRef blob = this->blob("content", &id);
+  GitBlobCache cache(1024);
+  cache.put(&id, blob);
+  ASSERT_EQ(blob, cache.get(&id));
+  ASSERT_EQ(1, cache.count());
+  ASSERT_EQ(7 + GIT_OID_RAWSZ, cache.size());
+}
+
+TEST_F(GitBlobCacheTest, PutTwice) {
+  git_oid id;
+  GitBlobRef blob = this->blob("content", &id);
+  GitBlobCache cache(1024);
+  cache.put(&id, blob);
+  cache.put(&id, blob);
+  ASSERT_EQ(1, cache.count());
+  ASSERT_EQ(7 + GIT_OID_RAWSZ, cache.size());
+}
+
+TEST_F(GitBlobCacheTest, SkipsLargeBlobs) {
+  git_oid id;
+  GitBlobRef blob = this->blob(std::string(100, 'a'), &id);
+  GitBlobCache cache(64);
+  cache.put(&id, blob);
+  ASSERT_EQ(nullptr, cache.get(&id));
+  ASSERT_EQ(0, cache.size());
+}
+
+TEST_F(GitBlobCacheTest, EvictsLeastRecentlyUsed) {
+  git_oid first;
+  git_oid second;
+  git_oid third;
+  GitBlobRef blob1 = this->blob(std::string(20, 'a'), &first);
+  GitBlobRef blob2 = this->blob(std::string(20, 'b'), &second);
+  GitBlobRef blob3 = this->blob(std::string(20, 'c'), &third);
+
+  GitBlobCache cache(2 * (20 + GIT_OID_RAWSZ));
+  cache.put(&first, blob1);
+  cache.put(&second, blob2);
+  cache.get(&first);
+  cache.put(&third, blob3);
+
+  ASSERT_EQ(blob1, cache.get(&first));
+  ASSERT_EQ(nullptr, cache.get(&second));
+  ASSERT_EQ(blob3, cache.get(&third));
+  ASSERT_EQ(2 * (20 + GIT_OID_RAWSZ), cache.size());
+}
+
+TEST_F(GitBlobCacheTest, EvictedBlobsStayValid) {
+  git_oid first;
+  git_oid second;
+  GitBlobRef blob = this->blob("first", &first);
+  GitBlobCache cache(5 + GIT_OID_RAWSZ);
+  cache.put(&first, blob);
+  cache.put(&second, this->blob("other", &second));
+
+  ASSERT_EQ(nullptr, cache.get(&first));
+  ASSERT_EQ("first", blob->str());
+}
+
+TEST_F(GitBlobCacheTest, Clear) {
+  git_oid id;
+  GitBlobCache cache(1024);
+  cache.put(&id, this->blob("content", &id));
+  cache.clear();
+  ASSERT_EQ(nullptr, cache.get(&id));
+  ASSERT_EQ(0, cache.count());
+  ASSERT_EQ(0, cache.size());
+}
+
+
+class TestVersion : public RepositoryVersion {
+ public:
+  bool exists(const std::string path) {
+    return false;
+  }
+
+  std::string readFile(const std::string path) {
+    return "";
+  }
+
+  IStreamRef streamFile(const std::string path) {
+    return nullptr;
+  }
+};
+
+
+class GitVersionCacheTest : public ::testing::Test {
+ public:
+  git_oid tree(unsigned char marker) {
+    git_oid id;
+    memset(id.id, marker, GIT_OID_RAWSZ);
+    return id;
+  }
+};
+
+
+TEST_F(GitVersionCacheTest, Miss) {
+  GitVersionCache cache(2);
+  git_oid tree = this->tree(1);
+  ASSERT_EQ(nullptr, cache.get(&tree));
+}
+
+TEST_F(GitVersionCacheTest, Hit) {
+  GitVersionCache cache(2);
+  git_oid tree = this->tree(1);
+  RepositoryVersionRef version(new TestVersion());
+  cache.put(&tree, version);
+  ASSERT_EQ(version, cache.get(&tree));
+}
+
+TEST_F(GitVersionCacheTest, EvictsLeastRecentlyUsed) {
+  GitVersionCache cache(2);
+  git_oid first = this->tree(1);
+  git_oid second = this->tree(2);
+  git_oid third = this->tree(3);
+  cache.put(&first, RepositoryVersionRef(new TestVersion()));
+  cache.put(&second, RepositoryVersionRef(new TestVersion()));
+  cache.get(&first);
+  cache.put(&third, RepositoryVersionRef(new TestVersion()));
+
+  ASSERT_NE(nullptr, cache.get(&first));
+  ASSERT_EQ(nullptr, cache.get(&second));
+  ASSERT_NE(nullptr, cache.get(&third));
+  ASSERT_EQ(2, cache.count());
+}
+
+TEST_F(GitVersionCacheTest, Disabled) {
+  GitVersionCache cache(0);
+  git_oid tree = this->tree(1);
+  cache.put(&tree, RepositoryVersionRef(new TestVersion()));
+  ASSERT_EQ(nullptr, cache.get(&tree));
+}
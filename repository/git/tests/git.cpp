@@ -1,11 +1,17 @@
 // Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
 #include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
 
 #include <memory>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include "core/model/repository.h"
 #include "ext/repository/git.h"
 #include "ext/repository/git/exceptions.h"
+#include "ext/repository/git/istream.h"
 
 //#include "testing/options.h"
 
@@ -14,7 +20,13 @@ using sf::core::model::IStreamRef;
 
 using sf::ext::exception::GitException;
 using sf::ext::exception::GitInvalidVersion;
+using sf::ext::exception::GitTypeError;
+using sf::ext::repository::GitBlobRef;
+using sf::ext::repository::GitChanges;
+using sf::ext::repository::GitChangeType;
+using sf::ext::repository::GitOdbStreamBuf;
 using sf::ext::repository::GitRepo;
+using sf::ext::repository::GitRepoVersion;
 
 typedef std::shared_ptr<GitRepo> GitRepoRef;
 
@@ -50,6 +62,12 @@ class GitRepoTest : public ::testing::Test {
   GitRepoRef getFixture() {
     return this->make("../snow-fox");
   }
+
+  GitRepoRef getStreamingFixture() {
+    return GitRepoRef(
+        new GitRepo("../snow-fox", "refs/heads/master", 0, 4)
+    );
+  }
 };
 
 
@@ -130,3 +148,319 @@ TEST_F(GitRepoTest, StreamFileRaw) {
   std::getline(*stream, line);
   EXPECT_EQ("File with some content", line);
 }
+
+TEST_F(GitRepoTest, ReadFile) {
+  GitRepoRef repo = this->getFixture();
+  std::string content = repo->version(BRANCH_NAME)->readFile(
+      "fixtures/content"
+  );
+  ASSERT_EQ(0, content.find("File with some content\n"));
+}
+
+TEST_F(GitRepoTest, ReadBlobOutlivesVersion) {
+  GitRepoRef repo = this->getFixture();
+  auto version = repo->version(BRANCH_NAME);
+  GitBlobRef blob = std::static_pointer_cast<GitRepoVersion>(
+      version
+  )->readBlob("fixtures/content");
+  version.reset();
+
+  std::string line(blob->data(), 22);
+  ASSERT_EQ("File with some content", line);
+}
+
+TEST_F(GitRepoTest, StreamFileInChunks) {
+  GitRepoRef repo = this->getStreamingFixture();
+  IStreamRef stream = repo->version(BRANCH_NAME)->streamFile(
+      "fixtures/content"
+  );
+  ASSERT_NE(nullptr, stream);
+
+  std::string line;
+  std::getline(*stream, line);
+  EXPECT_EQ("File with some content", line);
+  std::getline(*stream, line);
+  EXPECT_EQ("And a couple of lines", line);
+}
+
+TEST_F(GitRepoTest, StreamEmptyFileInChunks) {
+  GitRepoRef repo = this->getStreamingFixture();
+  IStreamRef stream = repo->version(BRANCH_NAME)->streamFile(
+      "fixtures/exists"
+  );
+  ASSERT_NE(nullptr, stream);
+  EXPECT_EQ(-1, stream->get());
+  EXPECT_TRUE(stream->eof());
+}
+
+TEST_F(GitRepoTest, VersionsShareCachedBlobs) {
+  GitRepoRef repo = this->getFixture();
+  auto branch = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  auto commit = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_COMMIT)
+  );
+
+  GitBlobRef first = branch->readBlob("fixtures/content");
+  GitBlobRef second = commit->readBlob("fixtures/content");
+  ASSERT_EQ(first, second);
+  ASSERT_EQ(1, repo->cache()->count());
+}
+
+TEST_F(GitRepoTest, CacheCanBeDisabled) {
+  GitRepoRef repo(new GitRepo(
+      "../snow-fox", "refs/heads/master",
+      GitRepo::STREAM_THRESHOLD, GitRepo::STREAM_CHUNK, 0
+  ));
+  repo->version(BRANCH_NAME)->readFile("fixtures/content");
+  ASSERT_EQ(0, repo->cache()->count());
+}
+
+TEST_F(GitRepoTest, ResolveBranchTwice) {
+  GitRepoRef repo = this->getFixture();
+  ASSERT_EQ(BRANCH_COMMIT, repo->resolveVersion(BRANCH_NAME));
+  ASSERT_EQ(BRANCH_COMMIT, repo->resolveVersion(BRANCH_NAME));
+}
+
+TEST_F(GitRepoTest, VersionFromCachedRevision) {
+  GitRepoRef repo = this->getFixture();
+  repo->resolveVersion(BRANCH_NAME);
+  ASSERT_TRUE(repo->version(BRANCH_NAME)->exists("fixtures/content"));
+}
+
+TEST_F(GitRepoTest, VersionsWithSameTreeAreShared) {
+  GitRepoRef repo = this->getFixture();
+  auto branch = repo->version(BRANCH_NAME);
+  auto commit = repo->version(BRANCH_COMMIT);
+  ASSERT_EQ(branch, commit);
+}
+
+TEST_F(GitRepoTest, NestedPathExists) {
+  GitRepoRef repo = this->getFixture();
+  auto version = repo->version(BRANCH_NAME);
+  ASSERT_TRUE(version->exists("fixtures"));
+  ASSERT_TRUE(version->exists("fixtures/content"));
+  ASSERT_TRUE(version->exists("fixtures/exists"));
+  ASSERT_FALSE(version->exists("fixtures/missing"));
+  ASSERT_FALSE(version->exists("fixtures/content/missing"));
+  ASSERT_FALSE(version->exists("missing/content"));
+}
+
+TEST_F(GitRepoTest, ReadFileTwice) {
+  GitRepoRef repo = this->getFixture();
+  auto version = repo->version(BRANCH_NAME);
+  std::string first = version->readFile("fixtures/content");
+  ASSERT_EQ(first, version->readFile("fixtures/content"));
+}
+
+TEST_F(GitRepoTest, ReadMissingFile) {
+  GitRepoRef repo = this->getFixture();
+  auto version = repo->version(BRANCH_NAME);
+  ASSERT_THROW(version->readFile("fixtures/missing"), GitException);
+  ASSERT_THROW(version->readFile("fixtures/missing"), GitException);
+}
+
+TEST_F(GitRepoTest, ReadDirectory) {
+  GitRepoRef repo = this->getFixture();
+  auto version = repo->version(BRANCH_NAME);
+  ASSERT_THROW(version->readFile("fixtures"), GitTypeError);
+}
+
+TEST_F(GitRepoTest, ReadFiles) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  std::vector<std::string> paths = {
+    "fixtures/content", "fixtures/exists", "fixtures/content"
+  };
+
+  std::vector<std::string> contents = version->readFiles(paths);
+  ASSERT_EQ(3, contents.size());
+  ASSERT_EQ(version->readFile("fixtures/content"), contents[0]);
+  ASSERT_EQ("", contents[1]);
+  ASSERT_EQ(contents[0], contents[2]);
+}
+
+TEST_F(GitRepoTest, ReadFilesFails) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  std::vector<std::string> paths = {"fixtures/content", "fixtures/missing"};
+  ASSERT_THROW(version->readFiles(paths), GitException);
+}
+
+TEST_F(GitRepoTest, ReadFromManyThreads) {
+  GitRepoRef repo = this->getFixture();
+  std::vector<std::thread> threads;
+  for (int idx = 0; idx < 8; idx++) {
+    threads.emplace_back([repo]() {
+      for (int round = 0; round < 20; round++) {
+        auto version = repo->version(BRANCH_NAME);
+        ASSERT_TRUE(version->exists("fixtures/content"));
+        std::string content = version->readFile("fixtures/content");
+        ASSERT_EQ(0, content.find("File with some content"));
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_F(GitRepoTest, PrefetchTree) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  std::string expected = version->readFile("fixtures/content");
+  version->prefetch();
+
+  ASSERT_TRUE(version->exists("Readme.md"));
+  ASSERT_TRUE(version->exists("fixtures/content"));
+  ASSERT_FALSE(version->exists("fixtures/missing"));
+  ASSERT_EQ(expected, version->readFile("fixtures/content"));
+  ASSERT_EQ(version->readBlob("fixtures/content"), version->readBlob(
+      "fixtures/content"
+  ));
+}
+
+TEST_F(GitRepoTest, PrefetchDirectory) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  version->prefetch("fixtures");
+
+  ASSERT_TRUE(version->exists("fixtures/exists"));
+  ASSERT_FALSE(version->exists("fixtures/missing"));
+  ASSERT_TRUE(version->exists("Readme.md"));
+
+  IStreamRef stream = version->streamFile("fixtures/content");
+  std::string line;
+  std::getline(*stream, line);
+  ASSERT_EQ("File with some content", line);
+}
+
+TEST_F(GitRepoTest, PrefetchOverlapping) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  version->prefetch("fixtures");
+  GitBlobRef blob = version->readBlob("fixtures/content");
+  version->prefetch();
+
+  // Files prefetched already are kept as they are.
+  ASSERT_EQ(blob, version->readBlob("fixtures/content"));
+  ASSERT_TRUE(version->exists("Readme.md"));
+}
+
+TEST_F(GitRepoTest, PrefetchLeavesStreamedFiles) {
+  GitRepoRef repo = this->getStreamingFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  version->prefetch();
+  ASSERT_EQ(0, repo->cache()->count());
+  ASSERT_TRUE(version->exists("fixtures/content"));
+
+  IStreamRef stream = version->streamFile("fixtures/content");
+  ASSERT_NE(nullptr, dynamic_cast<GitOdbStreamBuf*>(stream->rdbuf()));
+  std::string line;
+  std::getline(*stream, line);
+  ASSERT_EQ("File with some content", line);
+}
+
+TEST_F(GitRepoTest, PrefetchMissingDirectory) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  ASSERT_THROW(version->prefetch("missing"), GitException);
+}
+
+TEST_F(GitRepoTest, PrefetchFile) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  ASSERT_THROW(version->prefetch("fixtures/content"), GitTypeError);
+}
+
+TEST_F(GitRepoTest, DiffSameVersion) {
+  GitRepoRef repo = this->getFixture();
+  ASSERT_EQ(0, repo->diff(BRANCH_NAME, BRANCH_COMMIT).size());
+}
+
+TEST_F(GitRepoTest, DiffInvalidVersion) {
+  GitRepoRef repo = this->getFixture();
+  ASSERT_THROW(repo->diff(BRANCH_NAME, NOT_COMMIT), GitInvalidVersion);
+}
+
+TEST_F(GitRepoTest, DiffVersions) {
+  GitRepoRef repo = this->getFixture();
+  GitChanges changes = repo->diff(TAG_NAME, BRANCH_NAME);
+  ASSERT_LT(0, changes.size());
+
+  git_oid zero;
+  memset(&zero, 0, sizeof(zero));
+  for (auto& change : changes) {
+    ASSERT_NE("", change.path);
+    switch (change.type) {
+      case GitChangeType::ADDED:
+        ASSERT_TRUE(git_oid_equal(&zero, &change.old_id));
+        ASSERT_FALSE(git_oid_equal(&zero, &change.new_id));
+        break;
+      case GitChangeType::REMOVED:
+        ASSERT_FALSE(git_oid_equal(&zero, &change.old_id));
+        ASSERT_TRUE(git_oid_equal(&zero, &change.new_id));
+        break;
+      case GitChangeType::MODIFIED:
+        ASSERT_FALSE(git_oid_equal(&change.old_id, &change.new_id));
+        break;
+    }
+  }
+}
+
+TEST_F(GitRepoTest, DiffIsSymmetric) {
+  GitRepoRef repo = this->getFixture();
+  GitChanges forward = repo->diff(TAG_NAME, BRANCH_NAME);
+  GitChanges backward = repo->diff(BRANCH_NAME, TAG_NAME);
+  ASSERT_EQ(forward.size(), backward.size());
+}
+
+TEST_F(GitRepoTest, DiffMatchesContent) {
+  GitRepoRef repo = this->getFixture();
+  auto version = std::static_pointer_cast<GitRepoVersion>(
+      repo->version(BRANCH_NAME)
+  );
+  for (auto& change : repo->diff(TAG_NAME, BRANCH_NAME)) {
+    if (change.type == GitChangeType::REMOVED) {
+      ASSERT_FALSE(version->exists(change.path));
+    } else {
+      ASSERT_TRUE(version->exists(change.path));
+    }
+  }
+}
+
+TEST_F(GitRepoTest, DiffTypeChange) {
+  char dir[] = "/tmp/sf-git-diff-XXXXXX";
+  std::string path = mkdtemp(dir);
+  std::string cmd = "cd " + path + " && git init -q && "
+    "git config user.name test && git config user.email test@test && "
+    "echo content > file && git add file && git commit -qm file && "
+    "git tag before && rm file && ln -s target file && "
+    "git add file && git commit -qm link && git tag after";
+  ASSERT_EQ(0, system(cmd.c_str()));
+
+  GitRepoRef repo = this->make(path);
+  GitChanges changes = repo->diff("before", "after");
+  cmd = "rm -rf " + path;
+  system(cmd.c_str());
+  ASSERT_EQ(1, changes.size());
+  ASSERT_EQ("file", changes[0].path);
+  ASSERT_EQ(GitChangeType::MODIFIED, changes[0].type);
+}
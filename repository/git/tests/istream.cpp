@@ -1,5 +1,9 @@
 // Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
 #include <gtest/gtest.h>
+#include <stdlib.h>
+
+#include <iterator>
+#include <string>
 
 #include "ext/repository/git/exceptions.h"
 #include "ext/repository/git/istream.h"
@@ -7,8 +11,11 @@
 using sf::ext::exception::GitException;
 using sf::ext::exception::GitTypeError;
 
+using sf::ext::repository::GitBlob;
+using sf::ext::repository::GitBlobRef;
 using sf::ext::repository::GitBlobStreamBuf;
 using sf::ext::repository::GitBlobStream;
+using sf::ext::repository::GitOdbStreamBuf;
 
 const std::string BRANCH_NAME = "ext.repo.git.fixture";
 
@@ -136,3 +143,99 @@ TEST_F(GitBlobStreamBufTest, ReadBlobThroughStream) {
   std::getline(stream, text);
   ASSERT_EQ("File with some content", text);
 }
+
+TEST_F(GitBlobStreamBufTest, WholeBlobIsAvailable) {
+  git_blob* blob = this->getBlob("fixtures/content");
+  GitBlobStreamBuf buffer(blob);
+  std::streamsize size = git_blob_rawsize(blob);
+  git_blob_free(blob);
+
+  std::istream stream(&buffer);
+  ASSERT_EQ(size, buffer.in_avail());
+  std::string text;
+  std::getline(stream, text);
+  ASSERT_EQ("File with some content", text);
+}
+
+TEST_F(GitBlobStreamBufTest, ReadSharedBlob) {
+  GitBlobRef blob(new GitBlob(this->getBlob("fixtures/content")));
+  GitBlobStream stream(new GitBlobStreamBuf(blob));
+  blob.reset();
+
+  std::string text;
+  std::getline(stream, text);
+  ASSERT_EQ("File with some content", text);
+}
+
+
+class GitOdbStreamBufTest : public ::testing::Test {
+ protected:
+  std::string path;
+  git_repository* repo;
+
+ public:
+  GitOdbStreamBufTest() {
+    git_libgit2_init();
+    char dir[] = "/tmp/sf-git-odb-XXXXXX";
+    this->path = mkdtemp(dir);
+    int error = git_repository_init(&this->repo, this->path.c_str(), 1);
+    GitException::checkGitError(error);
+  }
+
+  ~GitOdbStreamBufTest() {
+    git_repository_free(this->repo);
+    std::string cmd = "rm -rf " + this->path;
+    system(cmd.c_str());
+  }
+
+  //! Writes a loose blob and opens a stream buffer on it.
+  GitOdbStreamBuf* stream(std::string content, size_t chunk) {
+    git_oid id;
+    int error = git_blob_create_frombuffer(
+        &id, this->repo, content.data(), content.size()
+    );
+    GitException::checkGitError(error);
+
+    git_odb* odb = nullptr;
+    error = git_repository_odb(&odb, this->repo);
+    GitException::checkGitError(error);
+
+    git_odb_stream* stream = nullptr;
+    error = git_odb_open_rstream(&stream, odb, &id);
+    if (error != 0) {
+      git_odb_free(odb);
+      GitException::checkGitError(error);
+    }
+    return new GitOdbStreamBuf(odb, stream, chunk);
+  }
+};
+
+
+TEST_F(GitOdbStreamBufTest, ReadEmptyObject) {
+  GitBlobStream stream(this->stream("", 16));
+  ASSERT_EQ(-1, stream.get());
+  ASSERT_TRUE(stream.eof());
+}
+
+TEST_F(GitOdbStreamBufTest, ReadObjectInChunks) {
+  std::string content;
+  for (int idx = 0; idx < 1000; idx++) {
+    content += "line " + std::to_string(idx) + "\n";
+  }
+
+  GitBlobStream stream(this->stream(content, 16));
+  std::string text(
+      (std::istreambuf_iterator<char>(stream)),
+      std::istreambuf_iterator<char>()
+  );
+  ASSERT_EQ(content, text);
+}
+
+TEST_F(GitOdbStreamBufTest, ReadLines) {
+  GitBlobStream stream(this->stream("first line\nsecond line\n", 4));
+  std::string text;
+  std::getline(stream, text);
+  ASSERT_EQ("first line", text);
+  std::getline(stream, text);
+  ASSERT_EQ("second line", text);
+}
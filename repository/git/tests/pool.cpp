@@ -0,0 +1,88 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ext/repository/git/exceptions.h"
+#include "ext/repository/git/pool.h"
+
+using sf::ext::exception::GitException;
+using sf::ext::repository::GitRepoPool;
+
+
+class GitRepoPoolTest : public ::testing::Test {
+ public:
+  GitRepoPoolTest() {
+    git_libgit2_init();
+  }
+};
+
+
+TEST_F(GitRepoPoolTest, RepoNotFound) {
+  GitRepoPool pool("not a valid repo", 2);
+  ASSERT_THROW(GitRepoPool::Handle handle(&pool), GitException);
+}
+
+TEST_F(GitRepoPoolTest, FailedOpenDoesNotUseCapacity) {
+  GitRepoPool pool("not a valid repo", 1);
+  ASSERT_THROW(GitRepoPool::Handle handle(&pool), GitException);
+  ASSERT_THROW(GitRepoPool::Handle handle(&pool), GitException);
+}
+
+TEST_F(GitRepoPoolTest, ReusesReleasedHandles) {
+  GitRepoPool pool("../snow-fox", 2);
+  git_repository* first = nullptr;
+  {
+    GitRepoPool::Handle handle(&pool);
+    first = handle.get();
+  }
+  GitRepoPool::Handle handle(&pool);
+  ASSERT_EQ(first, handle.get());
+}
+
+TEST_F(GitRepoPoolTest, LeasesDistinctHandles) {
+  GitRepoPool pool("../snow-fox", 2);
+  GitRepoPool::Handle first(&pool);
+  GitRepoPool::Handle second(&pool);
+  ASSERT_NE(first.get(), second.get());
+}
+
+TEST_F(GitRepoPoolTest, WaitsForReleasedHandle) {
+  GitRepoPool pool("../snow-fox", 1);
+  git_repository* leased = nullptr;
+  git_repository* waited = nullptr;
+  std::thread waiter;
+  {
+    GitRepoPool::Handle handle(&pool);
+    leased = handle.get();
+    waiter = std::thread([&pool, &waited]() {
+      GitRepoPool::Handle handle(&pool);
+      waited = handle.get();
+    });
+  }
+  waiter.join();
+  ASSERT_EQ(leased, waited);
+}
+
+TEST_F(GitRepoPoolTest, ManyThreads) {
+  GitRepoPool pool("../snow-fox", 2);
+  std::vector<std::thread> threads;
+  for (int idx = 0; idx < 8; idx++) {
+    threads.emplace_back([&pool]() {
+      for (int round = 0; round < 100; round++) {
+        GitRepoPool::Handle handle(&pool);
+        ASSERT_NE(nullptr, handle.get());
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+}
+
+TEST_F(GitRepoPoolTest, GitDir) {
+  GitRepoPool pool("../snow-fox", 1);
+  ASSERT_NE("", pool.gitdir());
+}
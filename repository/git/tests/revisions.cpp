@@ -0,0 +1,120 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <fstream>
+#include <string>
+
+#include "ext/repository/git/revisions.h"
+
+using sf::ext::repository::GitRevision;
+using sf::ext::repository::GitRevisionCache;
+
+
+const std::string COMMIT = "1e57e7732f46f526ae1166f4653a83964e75e3a6";
+
+
+class GitRevisionCacheTest : public ::testing::Test {
+ protected:
+  std::string gitdir;
+
+ public:
+  GitRevisionCacheTest() {
+    char dir[] = "/tmp/sf-git-revs-XXXXXX";
+    this->gitdir = std::string(mkdtemp(dir)) + "/";
+    std::string cmd = "mkdir -p " + this->gitdir + "refs/heads";
+    system(cmd.c_str());
+  }
+
+  ~GitRevisionCacheTest() {
+    std::string cmd = "rm -rf " + this->gitdir;
+    system(cmd.c_str());
+  }
+
+  void writeRef(std::string path, std::string content) {
+    std::ofstream ref(this->gitdir + path);
+    ref << content << std::endl;
+  }
+
+  GitRevision revision(unsigned char marker) {
+    GitRevision revision;
+    memset(&revision, marker, sizeof(revision));
+    return revision;
+  }
+};
+
+
+TEST_F(GitRevisionCacheTest, CacheableRevisions) {
+  ASSERT_TRUE(GitRevisionCache::IsCacheable(COMMIT));
+  ASSERT_TRUE(GitRevisionCache::IsCacheable("master"));
+  ASSERT_TRUE(GitRevisionCache::IsCacheable("refs/heads/master"));
+  ASSERT_TRUE(GitRevisionCache::IsCacheable("v0.0.3"));
+  ASSERT_TRUE(GitRevisionCache::IsCacheable("ext.repo.git.fixture"));
+}
+
+TEST_F(GitRevisionCacheTest, NotCacheableRevisions) {
+  ASSERT_FALSE(GitRevisionCache::IsCacheable(""));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("HEAD"));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("origin/HEAD"));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("master~1"));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("master^{tree}"));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("master@{1}"));
+  ASSERT_FALSE(GitRevisionCache::IsCacheable("master..next"));
+}
+
+TEST_F(GitRevisionCacheTest, FullIdsHaveNoStamp) {
+  this->writeRef("packed-refs", "");
+  ASSERT_EQ("", GitRevisionCache::RefsStamp(this->gitdir, COMMIT));
+}
+
+TEST_F(GitRevisionCacheTest, StampIsStable) {
+  this->writeRef("refs/heads/master", COMMIT);
+  std::string stamp = GitRevisionCache::RefsStamp(this->gitdir, "master");
+  ASSERT_EQ(stamp, GitRevisionCache::RefsStamp(this->gitdir, "master"));
+}
+
+TEST_F(GitRevisionCacheTest, StampChangesWithLooseRef) {
+  std::string stamp = GitRevisionCache::RefsStamp(this->gitdir, "master");
+  this->writeRef("refs/heads/master", COMMIT);
+  ASSERT_NE(stamp, GitRevisionCache::RefsStamp(this->gitdir, "master"));
+}
+
+TEST_F(GitRevisionCacheTest, StampChangesWithPackedRefs) {
+  std::string stamp = GitRevisionCache::RefsStamp(this->gitdir, "master");
+  this->writeRef("packed-refs", COMMIT + " refs/heads/master");
+  ASSERT_NE(stamp, GitRevisionCache::RefsStamp(this->gitdir, "master"));
+}
+
+TEST_F(GitRevisionCacheTest, Miss) {
+  GitRevisionCache cache;
+  GitRevision resolved;
+  ASSERT_FALSE(cache.get("master", "stamp", &resolved));
+}
+
+TEST_F(GitRevisionCacheTest, Hit) {
+  GitRevisionCache cache;
+  GitRevision expected = this->revision(1);
+  GitRevision resolved;
+  cache.put("master", "stamp", expected);
+  ASSERT_TRUE(cache.get("master", "stamp", &resolved));
+  ASSERT_TRUE(git_oid_equal(&expected.commit, &resolved.commit));
+  ASSERT_TRUE(git_oid_equal(&expected.tree, &resolved.tree));
+}
+
+TEST_F(GitRevisionCacheTest, StaleStampMisses) {
+  GitRevisionCache cache;
+  GitRevision resolved;
+  cache.put("master", "old", this->revision(1));
+  ASSERT_FALSE(cache.get("master", "new", &resolved));
+}
+
+TEST_F(GitRevisionCacheTest, ClearedWhenFull) {
+  GitRevisionCache cache(2);
+  GitRevision resolved;
+  cache.put("a", "", this->revision(1));
+  cache.put("b", "", this->revision(2));
+  cache.put("c", "", this->revision(3));
+  ASSERT_FALSE(cache.get("a", "", &resolved));
+  ASSERT_TRUE(cache.get("c", "", &resolved));
+}
@@ -0,0 +1,150 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "ext/repository/git.h"
+#include "ext/repository/git/exceptions.h"
+#include "ext/repository/git/tree.h"
+
+using sf::ext::exception::GitException;
+using sf::ext::exception::GitTypeError;
+
+using sf::ext::repository::GitRepo;
+using sf::ext::repository::GitRepoVersion;
+using sf::ext::repository::GitTreeEntry;
+using sf::ext::repository::GitTreeIterator;
+using sf::ext::repository::GitTreeIteratorRef;
+
+typedef std::shared_ptr<GitRepo> GitRepoRef;
+typedef std::shared_ptr<GitRepoVersion> GitRepoVersionRef;
+
+const std::string BRANCH_NAME = "ext.repo.git.fixture";
+
+
+class GitTreeIteratorTest : public ::testing::Test {
+ protected:
+  GitRepoRef repo;
+
+ public:
+  GitTreeIteratorTest() {
+    git_libgit2_init();
+    this->repo = GitRepoRef(new GitRepo("../snow-fox"));
+  }
+
+  GitRepoVersionRef version() {
+    return std::static_pointer_cast<GitRepoVersion>(
+        this->repo->version(BRANCH_NAME)
+    );
+  }
+
+  std::vector<std::string> paths(GitTreeIteratorRef iterator) {
+    std::vector<std::string> paths;
+    for (auto& entry : iterator->all()) {
+      paths.push_back(entry.path);
+    }
+    return paths;
+  }
+
+  bool contains(const std::vector<std::string>& paths, std::string path) {
+    for (auto& item : paths) {
+      if (item == path) {
+        return true;
+      }
+    }
+    return false;
+  }
+};
+
+
+TEST_F(GitTreeIteratorTest, MatchesAnything) {
+  ASSERT_TRUE(GitTreeIterator::Matches("", "a/b/c.lua"));
+}
+
+TEST_F(GitTreeIteratorTest, MatchesNames) {
+  ASSERT_TRUE(GitTreeIterator::Matches("*.lua", "init.lua"));
+  ASSERT_TRUE(GitTreeIterator::Matches("*.lua", "services/init.lua"));
+  ASSERT_FALSE(GitTreeIterator::Matches("*.lua", "services/init.json"));
+  ASSERT_FALSE(GitTreeIterator::Matches("*.lua", "init.lua/readme"));
+}
+
+TEST_F(GitTreeIteratorTest, MatchesPaths) {
+  ASSERT_TRUE(GitTreeIterator::Matches("services/*", "services/web"));
+  ASSERT_FALSE(GitTreeIterator::Matches("services/*", "services/web/init"));
+  ASSERT_FALSE(GitTreeIterator::Matches("services/*", "other/web"));
+  ASSERT_TRUE(GitTreeIterator::Matches("*/init.lua", "web/init.lua"));
+}
+
+TEST_F(GitTreeIteratorTest, ListRoot) {
+  auto iterator = this->version()->list();
+  std::vector<GitTreeEntry> entries = iterator->all();
+  bool found_readme = false;
+  bool found_fixtures = false;
+  for (auto& entry : entries) {
+    if (entry.path == "Readme.md") {
+      found_readme = true;
+      ASSERT_EQ(GIT_OBJ_BLOB, entry.type);
+      ASSERT_EQ(GIT_FILEMODE_BLOB, entry.mode);
+    }
+    if (entry.path == "fixtures") {
+      found_fixtures = true;
+      ASSERT_EQ(GIT_OBJ_TREE, entry.type);
+      ASSERT_EQ(GIT_FILEMODE_TREE, entry.mode);
+    }
+    ASSERT_EQ(std::string::npos, entry.path.find('/'));
+  }
+  ASSERT_TRUE(found_readme);
+  ASSERT_TRUE(found_fixtures);
+}
+
+TEST_F(GitTreeIteratorTest, ListDirectory) {
+  auto paths = this->paths(this->version()->list("fixtures"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/content"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/exists"));
+  ASSERT_FALSE(this->contains(paths, "Readme.md"));
+}
+
+TEST_F(GitTreeIteratorTest, ListRecursive) {
+  auto paths = this->paths(this->version()->list("", true));
+  ASSERT_TRUE(this->contains(paths, "Readme.md"));
+  ASSERT_TRUE(this->contains(paths, "fixtures"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/content"));
+}
+
+TEST_F(GitTreeIteratorTest, ListWithGlob) {
+  auto paths = this->paths(this->version()->list("", true, "content"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/content"));
+  ASSERT_FALSE(this->contains(paths, "fixtures"));
+  ASSERT_FALSE(this->contains(paths, "fixtures/exists"));
+}
+
+TEST_F(GitTreeIteratorTest, ListWithPathGlob) {
+  auto paths = this->paths(this->version()->list("", true, "fixtures/*"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/content"));
+  ASSERT_TRUE(this->contains(paths, "fixtures/exists"));
+  ASSERT_FALSE(this->contains(paths, "Readme.md"));
+}
+
+TEST_F(GitTreeIteratorTest, EntryIdMatchesBlob) {
+  auto version = this->version();
+  GitTreeEntry entry;
+  auto iterator = version->list("fixtures", false, "content");
+  ASSERT_TRUE(iterator->next(&entry));
+  ASSERT_EQ("content", entry.name);
+
+  std::string content = version->readFile("fixtures/content");
+  git_oid expected;
+  git_odb_hash(&expected, content.data(), content.size(), GIT_OBJ_BLOB);
+  ASSERT_TRUE(git_oid_equal(&expected, &entry.id));
+  ASSERT_FALSE(iterator->next(&entry));
+}
+
+TEST_F(GitTreeIteratorTest, ListMissingDirectory) {
+  ASSERT_THROW(this->version()->list("missing"), GitException);
+}
+
+TEST_F(GitTreeIteratorTest, ListFile) {
+  ASSERT_THROW(this->version()->list("Readme.md"), GitTypeError);
+}
@@ -0,0 +1,138 @@
+// Copyright 2016 Stefano Pogliani <stefano@spogliani.net>
+#include <gtest/gtest.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "core/model/event.h"
+
+#include "ext/repository/git.h"
+#include "ext/repository/git/exceptions.h"
+#include "ext/repository/git/watch.h"
+
+using sf::core::model::EventRef;
+
+using sf::ext::exception::GitException;
+
+using sf::ext::repository::GitRefChange;
+using sf::ext::repository::GitRefEvent;
+using sf::ext::repository::GitRefWatcher;
+using sf::ext::repository::GitRepo;
+
+typedef std::shared_ptr<GitRepo> GitRepoRef;
+
+
+const std::string BRANCH_COMMIT = "1e57e7732f46f526ae1166f4653a83964e75e3a6";
+const std::string TAG_COMMIT    = "9bf19d1c8f978927b8c85bd4ec0b8ed5426da4b8";
+
+
+class GitRefWatcherTest : public ::testing::Test {
+ protected:
+  std::string path;
+  GitRepoRef repo;
+  std::vector<GitRefChange> changes;
+
+ public:
+  GitRefWatcherTest() {
+    git_libgit2_init();
+    char dir[] = "/tmp/sf-git-watch-XXXXXX";
+    this->path = std::string(mkdtemp(dir)) + "/repo.git";
+
+    // Work on a clone to move references freely.
+    git_repository* clone = nullptr;
+    git_clone_options options = GIT_CLONE_OPTIONS_INIT;
+    options.bare = 1;
+    int error = git_clone(&clone, "../snow-fox", this->path.c_str(), &options);
+    GitException::checkGitError(error);
+    git_repository_free(clone);
+
+    this->moveRef("refs/heads/watched", BRANCH_COMMIT);
+    this->repo = GitRepoRef(new GitRepo(this->path, "refs/heads/watched"));
+  }
+
+  ~GitRefWatcherTest() {
+    std::string cmd = "rm -rf " + this->path.substr(0, this->path.rfind('/'));
+    system(cmd.c_str());
+  }
+
+  //! Updates a loose reference the way git does.
+  void moveRef(std::string ref, std::string commit) {
+    std::string target = this->path + "/" + ref;
+    std::string lock = target + ".lock";
+    {
+      std::ofstream file(lock);
+      file << commit << std::endl;
+    }
+    rename(lock.c_str(), target.c_str());
+  }
+
+  std::shared_ptr<GitRefWatcher> watcher(std::string ref = "") {
+    return std::make_shared<GitRefWatcher>(
+        "git-watch", this->repo, [this](const GitRefChange& change) {
+          this->changes.push_back(change);
+        }, ref
+    );
+  }
+};
+
+
+TEST_F(GitRefWatcherTest, ResolvesRefOnCreation) {
+  auto watcher = this->watcher("watched");
+  ASSERT_EQ(BRANCH_COMMIT, watcher->commit());
+}
+
+TEST_F(GitRefWatcherTest, WatchesLatestByDefault) {
+  auto watcher = this->watcher();
+  ASSERT_EQ(BRANCH_COMMIT, watcher->commit());
+}
+
+TEST_F(GitRefWatcherTest, NoEventIfRefDidNotMove) {
+  auto watcher = this->watcher();
+  ASSERT_EQ(nullptr, watcher->fetch());
+}
+
+TEST_F(GitRefWatcherTest, EventWhenRefMoves) {
+  auto watcher = this->watcher();
+  this->moveRef("refs/heads/watched", TAG_COMMIT);
+
+  EventRef event = watcher->fetch();
+  ASSERT_NE(nullptr, event);
+  auto ref_event = std::static_pointer_cast<GitRefEvent>(event);
+  ASSERT_EQ("refs/heads/watched", ref_event->change().ref);
+  ASSERT_EQ(BRANCH_COMMIT, ref_event->change().old_commit);
+  ASSERT_EQ(TAG_COMMIT, ref_event->change().new_commit);
+  ASSERT_EQ(TAG_COMMIT, watcher->commit());
+
+  event->handle();
+  ASSERT_EQ(1, this->changes.size());
+  ASSERT_EQ(TAG_COMMIT, this->changes[0].new_commit);
+}
+
+TEST_F(GitRefWatcherTest, NoEventForOtherRefs) {
+  auto watcher = this->watcher();
+  this->moveRef("refs/heads/other", TAG_COMMIT);
+  ASSERT_EQ(nullptr, watcher->fetch());
+}
+
+TEST_F(GitRefWatcherTest, WatchesShortNames) {
+  auto watcher = this->watcher("watched");
+  this->moveRef("refs/heads/watched", TAG_COMMIT);
+  EventRef event = watcher->fetch();
+  ASSERT_NE(nullptr, event);
+  ASSERT_EQ("watched", std::static_pointer_cast<GitRefEvent>(
+      event
+  )->change().ref);
+}
+
+TEST_F(GitRefWatcherTest, IgnoresDeletedRef) {
+  auto watcher = this->watcher();
+  std::string ref = this->path + "/refs/heads/watched";
+  unlink(ref.c_str());
+  ASSERT_EQ(nullptr, watcher->fetch());
+  ASSERT_EQ(BRANCH_COMMIT, watcher->commit());
+}